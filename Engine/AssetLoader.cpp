@@ -0,0 +1,75 @@
+// User-defined Headers
+#include "AssetLoader.h"
+#include "Profiler.h"
+
+// System Headers
+#include <memory>
+#include <stdexcept>
+
+Engine::AssetLoader::~AssetLoader()
+{
+	Shutdown();
+}
+
+void Engine::AssetLoader::Init(JobSystem* jobSystem)
+{
+	jobs = jobSystem;
+	stopping = false;
+}
+
+void Engine::AssetLoader::Shutdown()
+{
+	if (!jobs) return;
+
+	// Queued loads see the flag and return without decoding
+	stopping = true;
+	jobs->Wait(loading);
+	jobs = nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	decoded.clear();
+}
+
+void Engine::AssetLoader::Load(const std::string& name, std::function<void()> decode, std::function<void()> finish)
+{
+	std::shared_ptr<Job> job(new Job{ name, std::move(decode), std::move(finish), std::string() });
+	jobs->RunBackground([this, job] { Decode(*job); }, &loading);
+}
+
+size_t Engine::AssetLoader::Poll()
+{
+	std::vector<Job> finished;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.swap(decoded);
+	}
+
+	for (auto& job : finished) {
+		if (!job.error.empty()) {
+			throw std::runtime_error("Failed to load " + job.name + ": " + job.error);
+		}
+		job.finish();
+	}
+	return loading.GetPending();
+}
+
+void Engine::AssetLoader::WaitIdle()
+{
+	jobs->Wait(loading);
+}
+
+void Engine::AssetLoader::Decode(Job& job)
+{
+	PROFILE_SCOPE("DecodeAsset");
+	if (stopping) return;
+
+	try {
+		job.decode();
+	}
+	catch (const std::exception& e) {
+		job.error = e.what();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	decoded.push_back(std::move(job));
+}
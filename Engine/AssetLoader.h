@@ -0,0 +1,64 @@
+#pragma once
+
+// User-defined Headers
+#include "JobSystem.h"
+
+// System Headers
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace Engine {
+
+	/*
+	* Runs the CPU side of asset loading (file I/O, image decoding, mip and
+	* block compression) as background jobs, so startup does not wait for it.
+	*
+	* Every load is a decode function run on a job worker and a finish function run
+	* on the thread calling Poll, normally the render loop, which creates the
+	* Vulkan objects and submits the upload. Data flows from one to the other
+	* through whatever both functions capture
+	*/
+	class AssetLoader {
+	public:
+		~AssetLoader();
+
+		void Init(JobSystem* jobSystem);
+		// Drops queued loads and waits for the running ones, loads already decoded are never finished
+		void Shutdown();
+
+		void Load(const std::string& name, std::function<void()> decode, std::function<void()> finish);
+
+		/*
+		* Runs finish of every load decoded since the last call and returns the
+		* number of loads still queued or decoding. An exception thrown by a
+		* decode function is rethrown here as std::runtime_error
+		*/
+		size_t Poll();
+
+		// Blocks until no load is queued or decoding
+		void WaitIdle();
+
+	private:
+		struct Job {
+			std::string name;
+			std::function<void()> decode;
+			std::function<void()> finish;
+			std::string error;
+		};
+
+		void Decode(Job& job);
+
+		JobSystem* jobs = nullptr;
+		// Loads queued or decoding
+		JobCounter loading;
+		std::atomic<bool> stopping{ false };
+
+		// Decoded loads waiting for Poll, guarded by mutex
+		std::vector<Job> decoded;
+		std::mutex mutex;
+	};
+}
@@ -0,0 +1,190 @@
+// User-defined Headers
+#include "Benchmark.h"
+
+// System Headers
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+	void WriteString(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (char c : text) {
+			if (c == '"' || c == '\\') out << '\\';
+			out << c;
+		}
+		out << '"';
+	}
+
+	// Nearest rank percentile of sorted values
+	double Percentile(const std::vector<double>& sorted, double percent)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+		return sorted[std::max<size_t>(rank, 1) - 1];
+	}
+
+	void WriteDistribution(std::ostream& out, const std::vector<double>& values)
+	{
+		if (values.empty()) {
+			out << "null";
+			return;
+		}
+		std::vector<double> sorted = values;
+		std::sort(sorted.begin(), sorted.end());
+		double total = 0.0;
+		for (double value : sorted) {
+			total += value;
+		}
+
+		out << "{\"samples\": " << sorted.size()
+			<< ", \"min\": " << sorted.front()
+			<< ", \"mean\": " << total / sorted.size()
+			<< ", \"p50\": " << Percentile(sorted, 50.0)
+			<< ", \"p95\": " << Percentile(sorted, 95.0)
+			<< ", \"p99\": " << Percentile(sorted, 99.0)
+			<< ", \"max\": " << sorted.back() << "}";
+	}
+}
+
+glm::vec3 Engine::CameraKey::Position() const
+{
+	float lon = glm::radians(longitude);
+	float lat = glm::radians(latitude);
+	// Same mapping as the globe's texture, see DirectionToLatLon in Terrain.cpp: longitude 0 faces -x, 90 degrees east +z
+	return glm::vec3(-std::cos(lat) * std::cos(lon), std::sin(lat), std::cos(lat) * std::sin(lon)) * distance;
+}
+
+void Engine::CameraPath::Load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		throw std::runtime_error("Failed to open camera path " + path + "!");
+	}
+
+	keys.clear();
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') continue;
+
+		std::istringstream fields(line);
+		CameraKey key;
+		if (!(fields >> key.time >> key.distance >> key.longitude >> key.latitude)) {
+			throw std::runtime_error("Invalid camera key in " + path + " line " + std::to_string(lineNumber) + "!");
+		}
+		if (!keys.empty() && key.time <= keys.back().time) {
+			throw std::runtime_error("Camera key times must increase, " + path + " line " + std::to_string(lineNumber) + "!");
+		}
+		if (!(key.distance > 1.0f)) {
+			throw std::runtime_error("Camera keys must stay above the globe, " + path + " line " + std::to_string(lineNumber) + "!");
+		}
+		keys.push_back(key);
+	}
+
+	if (keys.empty()) {
+		throw std::runtime_error("Camera path " + path + " has no keys!");
+	}
+}
+
+Engine::CameraKey Engine::CameraPath::Sample(float time) const
+{
+	if (keys.empty()) {
+		CameraKey key;
+		key.time = time;
+		return key;
+	}
+	if (time <= keys.front().time) return keys.front();
+	if (time >= keys.back().time) return keys.back();
+
+	auto next = std::upper_bound(keys.begin(), keys.end(), time,
+		[](float t, const CameraKey& key) { return t < key.time; });
+	const CameraKey& a = *(next - 1);
+	const CameraKey& b = *next;
+	float f = (time - a.time) / (b.time - a.time);
+
+	CameraKey key;
+	key.time = time;
+	key.distance = glm::mix(a.distance, b.distance, f);
+	key.longitude = glm::mix(a.longitude, b.longitude, f);
+	key.latitude = glm::mix(a.latitude, b.latitude, f);
+	return key;
+}
+
+uint64_t Engine::GetPeakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+	// Kilobytes on Linux
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+void Engine::WriteBenchmarkJson(std::ostream& out, const BenchmarkReport& report)
+{
+	out << std::setprecision(6);
+	out << "{\n";
+	out << "  \"device\": ";
+	WriteString(out, report.deviceName);
+	out << ",\n  \"cameraPath\": ";
+	WriteString(out, report.cameraPath);
+	out << ",\n  \"width\": " << report.width
+		<< ",\n  \"height\": " << report.height
+		<< ",\n  \"framesInFlight\": " << report.framesInFlight
+		<< ",\n  \"warmupFrames\": " << report.warmupFrames
+		<< ",\n  \"measuredFrames\": " << report.frameMs.size()
+		<< ",\n  \"timestep\": " << report.timestep;
+
+	out << ",\n  \"configuration\": {";
+	for (size_t i = 0; i < report.configuration.size(); i++) {
+		out << (i == 0 ? "" : ", ");
+		WriteString(out, report.configuration[i].first);
+		out << ": ";
+		WriteString(out, report.configuration[i].second);
+	}
+	out << "}";
+
+	out << ",\n  \"frameMs\": ";
+	WriteDistribution(out, report.frameMs);
+	out << ",\n  \"cpuMs\": ";
+	WriteDistribution(out, report.cpuMs);
+
+	out << ",\n  \"gpuMs\": {";
+	for (size_t i = 0; i < report.gpuScopesMs.size(); i++) {
+		out << (i == 0 ? "\n    " : ",\n    ");
+		WriteString(out, report.gpuScopesMs[i].first);
+		out << ": ";
+		WriteDistribution(out, report.gpuScopesMs[i].second);
+	}
+	out << (report.gpuScopesMs.empty() ? "}" : "\n  }");
+
+	out << ",\n  \"memory\": {\"gpuUsedBytes\": " << report.gpuUsedBytes
+		<< ", \"gpuReservedBytes\": " << report.gpuReservedBytes
+		<< ", \"peakResidentBytes\": " << report.peakResidentBytes << "}";
+	out << "\n}\n";
+}
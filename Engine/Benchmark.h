@@ -0,0 +1,75 @@
+#pragma once
+
+// External Headers
+#include <glm/glm.hpp>
+
+// System Headers
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Engine {
+
+	// Camera on a sphere around the globe's center, above the given longitude and latitude of the unrotated globe in degrees
+	struct CameraKey {
+		float time = 0.0f;
+		float distance = 2.83f;
+		float longitude = 135.0f;
+		float latitude = 0.0f;
+
+		glm::vec3 Position() const;
+	};
+
+	/*
+	* Recorded camera path driving --benchmark runs. The file holds one key per
+	* line, "time distance longitude latitude", with time in seconds increasing
+	* from line to line and distance in globe radii. Empty lines and lines
+	* starting with # are skipped. The camera moves linearly between keys and
+	* holds the first and last key outside of them
+	*/
+	class CameraPath {
+	public:
+		void Load(const std::string& path);
+
+		CameraKey Sample(float time) const;
+		float GetDuration() const { return keys.empty() ? 0.0f : keys.back().time; }
+
+	private:
+		std::vector<CameraKey> keys;
+	};
+
+	// Everything a benchmark run measured, the series hold one value per measured frame
+	struct BenchmarkReport {
+		std::string deviceName;
+		std::string cameraPath;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t framesInFlight = 0;
+		uint32_t warmupFrames = 0;
+		double timestep = 0.0;
+		// Settings that select what is measured, e.g. the globe and transform path
+		std::vector<std::pair<std::string, std::string>> configuration;
+
+		// Wall time of each frame, and the part of it the CPU was not blocked on the GPU
+		std::vector<double> frameMs;
+		std::vector<double> cpuMs;
+		// GPU time per profiler scope
+		std::vector<std::pair<std::string, std::vector<double>>> gpuScopesMs;
+
+		uint64_t gpuUsedBytes = 0;
+		uint64_t gpuReservedBytes = 0;
+		// Peak resident memory of the process, 0 where unknown
+		uint64_t peakResidentBytes = 0;
+	};
+
+	// Peak working set on Windows, peak resident set size elsewhere
+	uint64_t GetPeakResidentBytes();
+
+	/*
+	* Writes the report as JSON. Every series is summarized as min, mean,
+	* p50, p95, p99 and max, the percentiles by nearest rank
+	*/
+	void WriteBenchmarkJson(std::ostream& out, const BenchmarkReport& report);
+}
@@ -0,0 +1,153 @@
+// User-defined Headers
+#include "CommandRecorder.h"
+
+// System Headers
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+Engine::CommandRecorder::~CommandRecorder()
+{
+	Destroy();
+}
+
+void Engine::CommandRecorder::Init(VkDevice logicalDevice, uint32_t queueFamily, uint32_t frameCount, JobSystem* jobSystem, uint32_t rangeLimit)
+{
+	device = logicalDevice;
+	jobs = jobSystem;
+	uint32_t threadCount = jobs->GetThreadCount();
+	maxRanges = rangeLimit == 0 ? threadCount : rangeLimit;
+
+	frames.resize(frameCount);
+	for (FrameCommands& frame : frames) {
+		frame.pools.resize(threadCount);
+		frame.secondaries.resize(threadCount);
+		frame.secondariesUsed.assign(threadCount, 0);
+
+		for (VkCommandPool& pool : frame.pools) {
+			VkCommandPoolCreateInfo poolInfo = {};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = queueFamily;
+			// Everything allocated from the pool lives for one frame and is reset with the pool
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create frame Command Pool!");
+			}
+		}
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.pools[0];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &frame.primary) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate Command Buffers!");
+		}
+	}
+}
+
+void Engine::CommandRecorder::Destroy()
+{
+	// Destroying a pool frees its command buffers
+	for (FrameCommands& frame : frames) {
+		for (VkCommandPool pool : frame.pools) {
+			vkDestroyCommandPool(device, pool, nullptr);
+		}
+	}
+	frames.clear();
+}
+
+VkCommandBuffer Engine::CommandRecorder::BeginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex;
+	FrameCommands& frame = frames[frameIndex];
+
+	for (size_t i = 0; i < frame.pools.size(); i++) {
+		vkResetCommandPool(device, frame.pools[i], 0);
+		frame.secondariesUsed[i] = 0;
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(frame.primary, &beginInfo);
+	return frame.primary;
+}
+
+std::vector<VkCommandBuffer> Engine::CommandRecorder::RecordSecondaries(const VkCommandBufferInheritanceInfo& inheritance,
+	uint32_t itemCount, uint32_t minItemsPerBuffer, const RecordFunction& record)
+{
+	minItemsPerBuffer = std::max(1u, minItemsPerBuffer);
+	uint32_t ranges = std::max(1u, std::min(maxRanges, (itemCount + minItemsPerBuffer - 1) / minItemsPerBuffer));
+
+	// Each range gets its own slot, so the order of the draw list survives whichever thread records it
+	std::vector<VkCommandBuffer> recorded(ranges, VK_NULL_HANDLE);
+	JobCounter counter;
+	for (uint32_t range = 1; range < ranges; range++) {
+		uint32_t first = static_cast<uint32_t>(uint64_t(itemCount) * range / ranges);
+		uint32_t last = static_cast<uint32_t>(uint64_t(itemCount) * (range + 1) / ranges);
+		jobs->Run([&, range, first, last] {
+			recorded[range] = RecordRange(inheritance, record, first, last - first);
+		}, &counter);
+	}
+
+	std::string error;
+	try {
+		recorded[0] = RecordRange(inheritance, record, 0, static_cast<uint32_t>(uint64_t(itemCount) / ranges));
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+	}
+	try {
+		jobs->Wait(counter);
+	}
+	catch (const std::exception& e) {
+		if (error.empty()) error = e.what();
+	}
+
+	if (!error.empty()) {
+		throw std::runtime_error("Failed to record secondary Command Buffer: " + error);
+	}
+	return recorded;
+}
+
+VkCommandBuffer Engine::CommandRecorder::RecordRange(const VkCommandBufferInheritanceInfo& inheritance, const RecordFunction& record, uint32_t first, uint32_t count)
+{
+	VkCommandBuffer commandBuffer = AcquireSecondary(jobs->GetThreadIndex());
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritance;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	record(commandBuffer, first, count);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record secondary Command Buffer!");
+	}
+	return commandBuffer;
+}
+
+VkCommandBuffer Engine::CommandRecorder::AcquireSecondary(uint32_t thread)
+{
+	FrameCommands& frame = frames[currentFrame];
+	std::vector<VkCommandBuffer>& secondaries = frame.secondaries[thread];
+
+	if (frame.secondariesUsed[thread] == secondaries.size()) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.pools[thread];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate secondary Command Buffer!");
+		}
+		secondaries.push_back(commandBuffer);
+	}
+	return secondaries[frame.secondariesUsed[thread]++];
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+// User-defined Headers
+#include "JobSystem.h"
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+namespace Engine {
+
+	/*
+	* Records the command buffers of a frame on the job system's threads.
+	*
+	* Every frame slot owns one transient command pool per job system thread.
+	* BeginFrame resets all pools of the slot at once, which is cheaper than
+	* resetting command buffers one by one, and begins the slot's primary
+	* command buffer. RecordSecondaries splits a draw list into contiguous
+	* ranges, each recorded by a job into a secondary command buffer from the
+	* pool of the thread running it, so no pool is ever used by two threads.
+	* The calling thread helps recording while it waits, it must be the only
+	* thread outside the job system recording with this CommandRecorder.
+	*
+	* The primary command buffer executes the returned secondaries in order
+	* inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+	*/
+	class CommandRecorder {
+	public:
+		// Records the draw list items [first, first + count) into a secondary command buffer
+		typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)> RecordFunction;
+
+		~CommandRecorder();
+
+		// maxRanges bounds the secondaries per draw list, 0 allows one per job system thread
+		void Init(VkDevice device, uint32_t queueFamily, uint32_t frameCount, JobSystem* jobSystem, uint32_t maxRanges);
+		// Destroys the pools, the GPU must be done with every frame slot
+		void Destroy();
+
+		// Called after the fence of frameIndex has been waited on
+		VkCommandBuffer BeginFrame(uint32_t frameIndex);
+
+		/*
+		* Records itemCount draw list items into at most maxRanges secondary
+		* command buffers, but never fewer than minItemsPerBuffer items per
+		* buffer, so short lists are not spread thin. The returned buffers stay
+		* valid until the frame slot's next BeginFrame. An exception thrown by
+		* record is rethrown here as std::runtime_error
+		*/
+		std::vector<VkCommandBuffer> RecordSecondaries(const VkCommandBufferInheritanceInfo& inheritance,
+			uint32_t itemCount, uint32_t minItemsPerBuffer, const RecordFunction& record);
+
+	private:
+		// The pools of one frame slot, indexed by recording thread
+		struct FrameCommands {
+			std::vector<VkCommandPool> pools;
+			VkCommandBuffer primary = VK_NULL_HANDLE;
+			// Secondaries allocated from each pool, reused after the pool is reset
+			std::vector<std::vector<VkCommandBuffer>> secondaries;
+			std::vector<uint32_t> secondariesUsed;
+		};
+
+		VkCommandBuffer RecordRange(const VkCommandBufferInheritanceInfo& inheritance, const RecordFunction& record, uint32_t first, uint32_t count);
+		VkCommandBuffer AcquireSecondary(uint32_t thread);
+
+		VkDevice device = VK_NULL_HANDLE;
+		JobSystem* jobs = nullptr;
+		uint32_t maxRanges = 1;
+		std::vector<FrameCommands> frames;
+		uint32_t currentFrame = 0;
+	};
+}
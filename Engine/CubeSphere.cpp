@@ -0,0 +1,476 @@
+// User-defined Headers
+#include "CubeSphere.h"
+#include "Profiler.h"
+
+// System Headers
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	const float kPi = 3.14159265358979f;
+
+	// Patches are never drawn coarser than this, so no patch spans a pole
+	const uint32_t kMinLevel = 1;
+
+	// Patches generated per frame, bounds the CPU cost of flying into new areas
+	const uint32_t kPatchesPerFrame = 16;
+
+	/*
+	* Surface detail a flat grid cell cannot represent, relative to the cell size.
+	* A perfect sphere would otherwise barely refine when seen from up close
+	*/
+	const float kReliefPerCell = 1.0f / 64.0f;
+
+	// Skirt depth as a fraction of the angular size of a patch
+	const float kSkirtScale = 0.05f;
+
+	// Fraction of the switch distance to the parent level at which morphing starts
+	const float kMorphStart = 0.7f;
+
+	/*
+	* Tangent axes of a cube face, chosen so that uAxis x vAxis points out of
+	* the cube. Triangles wound from +u to +v then face outward
+	*/
+	void FaceAxes(uint32_t face, glm::vec3& normal, glm::vec3& uAxis, glm::vec3& vAxis)
+	{
+		const glm::vec3 axes[3] = { glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+		uint32_t axis = face / 2;
+		bool negative = (face & 1) != 0;
+
+		normal = negative ? -axes[axis] : axes[axis];
+		uAxis = axes[(axis + (negative ? 2 : 1)) % 3];
+		vAxis = axes[(axis + (negative ? 1 : 2)) % 3];
+	}
+
+	/*
+	* Maps a point on the unit cube to the unit sphere. Unlike normalizing,
+	* this mapping keeps the cells close to equal area across the face
+	*/
+	glm::vec3 CubeToSphere(const glm::vec3& p)
+	{
+		glm::vec3 p2 = p * p;
+		return glm::vec3(
+			p.x * std::sqrt(std::max(0.0f, 1.0f - p2.y * 0.5f - p2.z * 0.5f + p2.y * p2.z / 3.0f)),
+			p.y * std::sqrt(std::max(0.0f, 1.0f - p2.z * 0.5f - p2.x * 0.5f + p2.z * p2.x / 3.0f)),
+			p.z * std::sqrt(std::max(0.0f, 1.0f - p2.x * 0.5f - p2.y * 0.5f + p2.x * p2.y / 3.0f)));
+	}
+
+	// Angle covered by one patch edge at a level
+	float PatchAngle(uint32_t level)
+	{
+		return 0.5f * kPi / float(1u << level);
+	}
+
+	/*
+	* Grid vertex k (0..N) along patch edge e. The edges are walked counter clockwise
+	* seen from outside the globe: bottom, right, top, left
+	*/
+	uint32_t EdgeVertex(uint32_t edge, uint32_t k)
+	{
+		const uint32_t n = Engine::CubeSphere::kPatchResolution;
+		switch (edge) {
+		case 0: return k;
+		case 1: return k * (n + 1) + n;
+		case 2: return n * (n + 1) + (n - k);
+		default: return (n - k) * (n + 1);
+		}
+	}
+
+	// Same equirectangular mapping as CreateSphere, with U unwrapped around the patch center
+	glm::vec2 TexCoord(const glm::vec3& direction, float centerU)
+	{
+		float u = centerU;
+		if (direction.x * direction.x + direction.z * direction.z > 1e-12f) {
+			u = std::atan2(direction.z, direction.x) / (2.0f * kPi);
+			if (u - centerU > 0.5f) u -= 1.0f;
+			if (u - centerU < -0.5f) u += 1.0f;
+		}
+		float v = std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / kPi;
+		return glm::vec2(-u, v);
+	}
+
+	/*
+	* Full precision vertices of a patch in grid order, grid vertices followed
+	* by the skirts. gridVertex is the grid vertex each vertex takes its grid
+	* position from, for skirt vertices that of the edge vertex above them
+	*/
+	void SamplePatch(const Engine::PatchKey& key, float radius, glm::vec3* directions, float* radii, glm::vec2* texCoords, uint32_t* gridVertex)
+	{
+		const uint32_t n = Engine::CubeSphere::kPatchResolution;
+		const uint32_t gridVertices = (n + 1) * (n + 1);
+
+		glm::vec3 centerDirection = Engine::CubeSphere::PatchDirection(key, 0.5f, 0.5f);
+		float centerU = std::atan2(centerDirection.z, centerDirection.x) / (2.0f * kPi);
+
+		for (uint32_t j = 0; j <= n; j++) {
+			for (uint32_t i = 0; i <= n; i++) {
+				uint32_t v = j * (n + 1) + i;
+				directions[v] = Engine::CubeSphere::PatchDirection(key, i / float(n), j / float(n));
+				radii[v] = radius;
+				texCoords[v] = TexCoord(directions[v], centerU);
+				gridVertex[v] = v;
+			}
+		}
+
+		// Skirts hang below the edges, deep enough to cover the sag of coarser neighbours
+		float skirtRadius = radius * (1.0f - kSkirtScale * PatchAngle(key.level));
+		for (uint32_t edge = 0; edge < 4; edge++) {
+			for (uint32_t k = 0; k <= n; k++) {
+				uint32_t v = gridVertices + edge * (n + 1) + k;
+				uint32_t top = EdgeVertex(edge, k);
+				directions[v] = directions[top];
+				radii[v] = skirtRadius;
+				texCoords[v] = texCoords[top];
+				gridVertex[v] = top;
+			}
+		}
+	}
+}
+
+glm::vec3 Engine::CubeSphere::PatchDirection(const PatchKey& key, float s, float t)
+{
+	glm::vec3 normal, uAxis, vAxis;
+	FaceAxes(key.face, normal, uAxis, vAxis);
+
+	float scale = 2.0f / float(1u << key.level);
+	float a = -1.0f + (key.x + s) * scale;
+	float b = -1.0f + (key.y + t) * scale;
+	return glm::normalize(CubeToSphere(normal + uAxis * a + vAxis * b));
+}
+
+std::vector<uint32_t> Engine::CubeSphere::BuildPatchIndices()
+{
+	const uint32_t n = kPatchResolution;
+	std::vector<uint32_t> indices;
+	indices.reserve(6 * n * n + 4 * 6 * n);
+
+	for (uint32_t j = 0; j < n; j++) {
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t a = j * (n + 1) + i;
+			uint32_t b = a + 1;
+			uint32_t c = a + n + 2;
+			uint32_t d = a + n + 1;
+			indices.insert(indices.end(), { a, b, c, a, c, d });
+		}
+	}
+
+	// Skirt walls face away from the patch, following the edge walk of EdgeVertex
+	const uint32_t skirtBase = (n + 1) * (n + 1);
+	for (uint32_t edge = 0; edge < 4; edge++) {
+		for (uint32_t k = 0; k < n; k++) {
+			uint32_t top0 = EdgeVertex(edge, k);
+			uint32_t top1 = EdgeVertex(edge, k + 1);
+			uint32_t bottom0 = skirtBase + edge * (n + 1) + k;
+			uint32_t bottom1 = bottom0 + 1;
+			indices.insert(indices.end(), { top0, bottom0, bottom1, top0, bottom1, top1 });
+		}
+	}
+	return indices;
+}
+
+const Engine::CubeSphere::PatchMesh& Engine::CubeSphere::GetPatchMesh()
+{
+	static const PatchMesh mesh = [] {
+		PatchMesh patchMesh;
+		std::vector<uint32_t> indices = BuildPatchIndices();
+
+		// All patches have the same shape up to scale, one at the minimum level stands in for them
+		glm::vec3 directions[kVerticesPerPatch];
+		float radii[kVerticesPerPatch];
+		glm::vec2 texCoords[kVerticesPerPatch];
+		uint32_t gridVertex[kVerticesPerPatch];
+		SamplePatch({ 0, kMinLevel, 0, 0 }, 1.0f, directions, radii, texCoords, gridVertex);
+
+		std::vector<glm::vec3> positions(kVerticesPerPatch);
+		for (uint32_t v = 0; v < kVerticesPerPatch; v++) {
+			positions[v] = directions[v] * radii[v];
+		}
+		patchMesh.optimization = OptimizeMesh(indices, positions);
+		patchMesh.indices = MeshIndices(indices, kVerticesPerPatch);
+		return patchMesh;
+	}();
+	return mesh;
+}
+
+void Engine::CubeSphere::GeneratePatch(const PatchKey& key, float radius, PatchVertex* vertices, PatchBounds& bounds)
+{
+	const uint32_t n = kPatchResolution;
+	const std::vector<uint32_t>& remap = GetPatchMesh().optimization.remap;
+
+	// Full precision vertices first, they are quantized once the bounds are known
+	glm::vec3 directions[kVerticesPerPatch];
+	float radii[kVerticesPerPatch];
+	glm::vec2 texCoords[kVerticesPerPatch];
+	uint32_t gridVertex[kVerticesPerPatch];
+	SamplePatch(key, radius, directions, radii, texCoords, gridVertex);
+
+	glm::vec3 minPosition(1e30f), maxPosition(-1e30f);
+	glm::vec2 minTexCoord(1e30f), maxTexCoord(-1e30f);
+	for (uint32_t v = 0; v < kVerticesPerPatch; v++) {
+		minPosition = glm::min(minPosition, directions[v] * radii[v]);
+		maxPosition = glm::max(maxPosition, directions[v] * radii[v]);
+		minTexCoord = glm::min(minTexCoord, texCoords[v]);
+		maxTexCoord = glm::max(maxTexCoord, texCoords[v]);
+	}
+	glm::vec3 positionExtent = maxPosition - minPosition;
+	float positionSize = std::max(std::max(positionExtent.x, positionExtent.y), std::max(positionExtent.z, 1e-30f));
+	glm::vec2 texCoordSize = glm::max(maxTexCoord - minTexCoord, glm::vec2(1e-30f));
+	bounds.position = glm::vec4(minPosition, positionSize);
+	bounds.texCoord = glm::vec4(minTexCoord, texCoordSize);
+
+	for (uint32_t v = 0; v < kVerticesPerPatch; v++) {
+		PatchVertex& vertex = vertices[remap[v]];
+		glm::vec3 position = (directions[v] * radii[v] - minPosition) / positionSize;
+		vertex.pos[0] = QuantizeUnorm16(position.x);
+		vertex.pos[1] = QuantizeUnorm16(position.y);
+		vertex.pos[2] = QuantizeUnorm16(position.z);
+		vertex.pos[3] = static_cast<uint16_t>(gridVertex[v] % (n + 1) | (gridVertex[v] / (n + 1)) << 8);
+		EncodeOctahedral(directions[v], vertex.normal);
+		glm::vec2 texCoord = (texCoords[v] - minTexCoord) / texCoordSize;
+		vertex.texCoord[0] = QuantizeUnorm16(texCoord.x);
+		vertex.texCoord[1] = QuantizeUnorm16(texCoord.y);
+	}
+}
+
+void Engine::CubeSphere::Init(float sphereRadius, PatchVertex* vertexPool, uint32_t patchCapacity, uint32_t frames, JobSystem* jobs)
+{
+	jobSystem = jobs;
+	radius = sphereRadius;
+	pool = vertexPool;
+	framesInFlight = frames;
+	frame = 0;
+
+	slots.assign(patchCapacity, Slot());
+	residentPatches.clear();
+
+	// The roots and the minimum level are generated up front and stay resident
+	for (uint32_t face = 0; face < 6; face++) {
+		requests.push_back({ { face, 0, 0, 0 }, 0.0f });
+		for (uint32_t i = 0; i < 4; i++) {
+			requests.push_back({ { face, kMinLevel, i & 1, i >> 1 }, 0.0f });
+		}
+	}
+	size_t firstGenerated = generated.size();
+	for (const auto& request : requests) {
+		uint32_t slot = static_cast<uint32_t>(residentPatches.size());
+		slots[slot].key = request.key.Hash();
+		slots[slot].used = true;
+		residentPatches[request.key.Hash()] = slot;
+		generated.push_back({ request.key, slot });
+	}
+	GeneratePatches(firstGenerated);
+	requests.clear();
+}
+
+void Engine::CubeSphere::TakeGeneratedPatches(std::vector<GeneratedPatch>& patches)
+{
+	patches.clear();
+	patches.swap(generated);
+}
+
+int32_t Engine::CubeSphere::FindSlot(const PatchKey& key) const
+{
+	auto it = residentPatches.find(key.Hash());
+	return it == residentPatches.end() ? -1 : static_cast<int32_t>(it->second);
+}
+
+/*
+* How far the flat triangles of a grid cell sag below the sphere, plus the
+* relief a cell is assumed to hide
+*/
+float Engine::CubeSphere::GeometricError(uint32_t level) const
+{
+	float cellAngle = PatchAngle(level) / kPatchResolution;
+	return radius * (1.0f - std::cos(cellAngle * 0.5f)) + radius * cellAngle * kReliefPerCell;
+}
+
+bool Engine::CubeSphere::IsResident(const PatchKey& key)
+{
+	auto it = residentPatches.find(key.Hash());
+	if (it == residentPatches.end()) return false;
+
+	// Resident patches close to the view are kept alive even when not drawn
+	slots[it->second].lastUsedFrame = frame;
+	return true;
+}
+
+void Engine::CubeSphere::Select(const glm::vec3& cameraPosition, const glm::mat4& viewProjection, float pixelsPerRadian, float maxErrorPixels)
+{
+	PROFILE_SCOPE("SelectPatches");
+	frame++;
+	drawList.clear();
+	requests.clear();
+	stats.drawnPatches = 0;
+	stats.generatedPatches = 0;
+	stats.culledPatches = 0;
+	stats.deepestLevel = 0;
+
+	// Frustum planes in model space, Vulkan clip space has z in [0, w]
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	glm::vec4 frustum[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[2], rows[3] - rows[2]
+	};
+	for (auto& plane : frustum) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	jobSystem->ParallelFor(6, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t face = begin; face < end; face++) {
+			FaceSelection& selection = faceSelections[face];
+			selection.drawList.clear();
+			selection.requests.clear();
+			selection.culledPatches = 0;
+			selection.deepestLevel = 0;
+			Visit({ face, 0, 0, 0 }, cameraPosition, frustum, pixelsPerRadian, maxErrorPixels, selection);
+		}
+	});
+
+	// Merged in face order, so the draw list does not depend on which thread walked which face
+	for (const FaceSelection& selection : faceSelections) {
+		drawList.insert(drawList.end(), selection.drawList.begin(), selection.drawList.end());
+		requests.insert(requests.end(), selection.requests.begin(), selection.requests.end());
+		stats.culledPatches += selection.culledPatches;
+		stats.deepestLevel = std::max(stats.deepestLevel, selection.deepestLevel);
+	}
+	stats.drawnPatches = static_cast<uint32_t>(drawList.size());
+
+	StreamRequests();
+	stats.residentPatches = static_cast<uint32_t>(residentPatches.size());
+}
+
+void Engine::CubeSphere::Visit(const PatchKey& key, const glm::vec3& cameraPosition, const glm::vec4 frustum[6], float pixelsPerRadian, float maxErrorPixels, FaceSelection& selection)
+{
+	uint32_t slot = residentPatches.find(key.Hash())->second;
+	slots[slot].lastUsedFrame = frame;
+
+	// Bounding sphere around the patch center, reaching out to the corners
+	glm::vec3 centerDirection = PatchDirection(key, 0.5f, 0.5f);
+	glm::vec3 center = centerDirection * radius;
+	float cosAngularRadius = 1.0f;
+	float boundRadius = 0.0f;
+	for (uint32_t i = 0; i < 4; i++) {
+		glm::vec3 corner = PatchDirection(key, float(i & 1), float(i >> 1));
+		cosAngularRadius = std::min(cosAngularRadius, glm::dot(corner, centerDirection));
+		boundRadius = std::max(boundRadius, glm::length(corner * radius - center));
+	}
+
+	// Terrain may rise above the sphere anywhere on the patch
+	boundRadius += maxElevation;
+
+	/*
+	* Horizon culling: the whole patch lies beyond the horizon seen from the camera.
+	* Mountains up to maxElevation stay visible slightly past the horizon
+	*/
+	float cameraDistance = glm::length(cameraPosition);
+	if (cameraDistance > radius) {
+		float horizonAngle = std::acos(radius / cameraDistance) + std::acos(radius / (radius + maxElevation));
+		float centerAngle = std::acos(glm::clamp(glm::dot(centerDirection, cameraPosition / cameraDistance), -1.0f, 1.0f));
+		if (centerAngle - std::acos(glm::clamp(cosAngularRadius, -1.0f, 1.0f)) > horizonAngle) {
+			selection.culledPatches++;
+			return;
+		}
+	}
+
+	// Frustum culling of the bounding sphere
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(frustum[i]), center) + frustum[i].w < -boundRadius) {
+			selection.culledPatches++;
+			return;
+		}
+	}
+
+	// Geometric error projected to pixels at the closest possible distance of the patch
+	float distance = std::max(glm::length(cameraPosition - center) - boundRadius, radius * 1e-6f);
+	float screenError = GeometricError(key.level) / distance * pixelsPerRadian;
+
+	if (key.level < kMaxLevel && (key.level < kMinLevel || screenError > maxErrorPixels)) {
+		PatchKey children[4];
+		bool allResident = true;
+		for (uint32_t i = 0; i < 4; i++) {
+			children[i] = { key.face, key.level + 1, key.x * 2 + (i & 1), key.y * 2 + (i >> 1) };
+			if (!IsResident(children[i])) {
+				allResident = false;
+				selection.requests.push_back({ children[i], screenError });
+			}
+		}
+
+		if (allResident) {
+			for (uint32_t i = 0; i < 4; i++) {
+				Visit(children[i], cameraPosition, frustum, pixelsPerRadian, maxErrorPixels, selection);
+			}
+			return;
+		}
+	}
+
+	/*
+	* The parent replaces this patch once its own projected error drops below the
+	* threshold, which happens at switchDistance. Morphing completes right there.
+	* Patches of the minimum level have no parent to morph to
+	*/
+	PatchDraw draw = { slot, 1e30f, 2e30f };
+	if (key.level > kMinLevel) {
+		float switchDistance = GeometricError(key.level - 1) * pixelsPerRadian / maxErrorPixels;
+		draw.morphStart = switchDistance * kMorphStart;
+		draw.morphEnd = switchDistance;
+	}
+	selection.drawList.push_back(draw);
+	selection.deepestLevel = std::max(selection.deepestLevel, key.level);
+}
+
+void Engine::CubeSphere::StreamRequests()
+{
+	// Largest screen space error first
+	std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) { return a.priority > b.priority; });
+
+	// Slots are picked one after another, the vertices are written in parallel afterwards
+	size_t firstGenerated = generated.size();
+
+	for (const auto& request : requests) {
+		if (stats.generatedPatches == kPatchesPerFrame) break;
+
+		/*
+		* Least recently used slot that no frame in flight can still be reading.
+		* Slots touched this frame are never evicted
+		*/
+		uint32_t victim = static_cast<uint32_t>(slots.size());
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (!slots[i].used) {
+				victim = i;
+				break;
+			}
+			if (slots[i].lastUsedFrame + framesInFlight <= frame &&
+				(victim == slots.size() || slots[i].lastUsedFrame < slots[victim].lastUsedFrame)) {
+				victim = i;
+			}
+		}
+		if (victim == slots.size()) break;
+
+		if (slots[victim].used) {
+			residentPatches.erase(slots[victim].key);
+		}
+		slots[victim].key = request.key.Hash();
+		slots[victim].used = true;
+		slots[victim].lastUsedFrame = frame;
+		residentPatches[request.key.Hash()] = victim;
+		generated.push_back({ request.key, victim });
+		stats.generatedPatches++;
+	}
+	GeneratePatches(firstGenerated);
+}
+
+void Engine::CubeSphere::GeneratePatches(size_t firstGenerated)
+{
+	PROFILE_SCOPE("GeneratePatches");
+	uint32_t count = static_cast<uint32_t>(generated.size() - firstGenerated);
+	jobSystem->ParallelFor(count, 2, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const GeneratedPatch& patch = generated[firstGenerated + i];
+			GeneratePatch(patch.key, radius, pool + patch.slot * kVerticesPerPatch, slots[patch.slot].bounds);
+		}
+	});
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+// User-defined Headers
+#include "Vertex.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+
+// External Headers
+#include <glm/glm.hpp>
+
+// System Headers
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+namespace Engine {
+
+	/*
+	* Identifies one node of the globe quadtree. Each of the six cube faces is
+	* the root of a quadtree, a node at `level` covers 1 / 2^level of its face
+	* edge and (x, y) is its position in the 2^level x 2^level grid of that level
+	*/
+	struct PatchKey {
+		uint32_t face;
+		uint32_t level;
+		uint32_t x;
+		uint32_t y;
+
+		uint64_t Hash() const {
+			return (uint64_t(face) << 40) | (uint64_t(level) << 32) | (uint64_t(x) << 16) | uint64_t(y);
+		}
+	};
+
+	/*
+	* What the quantized PatchVertex values of a patch are relative to. The
+	* position is origin + pos / 65535 * size within the patch's bounding cube,
+	* the texture coordinates are origin + texCoord / 65535 * size
+	*/
+	struct PatchBounds {
+		// xyz origin, w edge length of the cube
+		glm::vec4 position;
+		// xy origin, zw size of the rectangle
+		glm::vec4 texCoord;
+	};
+
+	/*
+	* Cube-sphere globe split into patches in a quadtree per cube face.
+	*
+	* Every patch is the same kPatchResolution x kPatchResolution grid, so all
+	* patches share one index buffer and only differ in their vertices. The
+	* vertices of resident patches live in slots of a fixed size vertex pool,
+	* and a patch is drawn with vertexOffset = slot * kVerticesPerPatch.
+	*
+	* Each frame Select walks the quadtrees from the camera, culls patches
+	* outside the frustum or behind the horizon and refines a patch while its
+	* geometric error projected to the screen exceeds the error threshold.
+	* The six faces are walked as parallel jobs and their results merged in
+	* face order. A patch is only refined once all four children are resident,
+	* missing children are generated a few per frame, again in parallel, so the
+	* triangle count follows the view without ever stalling a frame. Patches of different levels meet with
+	* T-junctions, skirts hanging down from every patch edge hide the cracks.
+	*
+	* Terrain heights are not part of the vertices. The vertex shader displaces
+	* them and morphs every patch towards the shape of its parent as it nears the
+	* distance at which the parent replaces it (CDLOD), so level changes do not pop
+	*/
+	class CubeSphere {
+	public:
+		// Quads along one patch edge
+		static const uint32_t kPatchResolution = 16;
+		// Grid vertices followed by one row of skirt vertices per patch edge
+		static const uint32_t kVerticesPerPatch = (kPatchResolution + 1) * (kPatchResolution + 1) + 4 * (kPatchResolution + 1);
+		static const uint32_t kMaxLevel = 16;
+
+		// Index list of one patch in grid order, before optimization
+		static std::vector<uint32_t> BuildPatchIndices();
+
+		/*
+		* Index list shared by all patches, optimized for the vertex cache,
+		* overdraw and vertex fetch once on first use. Its remap gives the
+		* position of every grid and skirt vertex among the patch's vertices
+		*/
+		struct PatchMesh {
+			MeshIndices indices;
+			MeshOptimization optimization;
+		};
+		static const PatchMesh& GetPatchMesh();
+
+		// Writes the kVerticesPerPatch vertices of a patch and the bounds they are quantized to
+		static void GeneratePatch(const PatchKey& key, float radius, PatchVertex* vertices, PatchBounds& bounds);
+
+		// Unit sphere direction of the point (s, t) in [0, 1]^2 of a patch
+		static glm::vec3 PatchDirection(const PatchKey& key, float s, float t);
+
+		/*
+		* pool points at the persistently mapped vertex pool of patchCapacity slots.
+		* A slot is only rewritten once the frame that last drew it has completed,
+		* which is guaranteed framesInFlight frames later
+		*/
+		void Init(float radius, PatchVertex* pool, uint32_t patchCapacity, uint32_t framesInFlight, JobSystem* jobSystem);
+
+		// Highest terrain above the sphere, keeps mountains behind the horizon from being culled
+		void SetMaxElevation(float elevation) { maxElevation = elevation; }
+
+		/*
+		* cameraPosition and viewProjection are in the model space of the globe,
+		* pixelsPerRadian converts angles at the screen center to pixels
+		*/
+		void Select(const glm::vec3& cameraPosition, const glm::mat4& viewProjection, float pixelsPerRadian, float maxErrorPixels);
+
+		/*
+		* A patch selected for drawing. Between morphStart and morphEnd distance
+		* from the camera its vertices morph to the shape of the parent patch
+		*/
+		struct PatchDraw {
+			uint32_t slot;
+			float morphStart;
+			float morphEnd;
+		};
+		const std::vector<PatchDraw>& GetDrawList() const { return drawList; }
+
+		// Patches written into pool slots since the last call, in generation order
+		struct GeneratedPatch {
+			PatchKey key;
+			uint32_t slot;
+		};
+		void TakeGeneratedPatches(std::vector<GeneratedPatch>& patches);
+
+		// Slot holding a patch, -1 if the patch is not resident
+		int32_t FindSlot(const PatchKey& key) const;
+		// Bounds of the patch in a slot, pushed with its draw
+		const PatchBounds& GetPatchBounds(uint32_t slot) const { return slots[slot].bounds; }
+
+		struct Stats {
+			uint32_t drawnPatches = 0;
+			uint32_t residentPatches = 0;
+			uint32_t generatedPatches = 0;
+			uint32_t culledPatches = 0;
+			uint32_t deepestLevel = 0;
+		};
+		const Stats& GetStats() const { return stats; }
+
+	private:
+		struct Slot {
+			uint64_t key = 0;
+			bool used = false;
+			uint64_t lastUsedFrame = 0;
+			PatchBounds bounds;
+		};
+
+		struct Request {
+			PatchKey key;
+			float priority;
+		};
+
+		// What walking the quadtree of one face selected
+		struct FaceSelection {
+			std::vector<PatchDraw> drawList;
+			std::vector<Request> requests;
+			uint32_t culledPatches = 0;
+			uint32_t deepestLevel = 0;
+		};
+
+		/*
+		* Visit runs on several threads at once, one face each. It only reads
+		* residentPatches and writes the slots of the patches of its own face
+		*/
+		void Visit(const PatchKey& key, const glm::vec3& cameraPosition, const glm::vec4 frustum[6], float pixelsPerRadian, float maxErrorPixels, FaceSelection& selection);
+		bool IsResident(const PatchKey& key);
+		void StreamRequests();
+		// Writes the vertices of the generated patches from firstGenerated on, in parallel
+		void GeneratePatches(size_t firstGenerated);
+
+		float GeometricError(uint32_t level) const;
+
+		JobSystem* jobSystem = nullptr;
+		float radius = 1.0f;
+		float maxElevation = 0.0f;
+		PatchVertex* pool = nullptr;
+		uint32_t framesInFlight = 1;
+		uint64_t frame = 0;
+
+		std::vector<Slot> slots;
+		// PatchKey::Hash -> slot index
+		std::unordered_map<uint64_t, uint32_t> residentPatches;
+
+		std::vector<PatchDraw> drawList;
+		FaceSelection faceSelections[6];
+		std::vector<GeneratedPatch> generated;
+		std::vector<Request> requests;
+		Stats stats;
+	};
+}
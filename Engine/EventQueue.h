@@ -0,0 +1,79 @@
+#pragma once
+
+// System Headers
+#include <atomic>
+#include <cstddef>
+#include <chrono>
+
+namespace Engine {
+
+	/*
+	* Bounded lock-free queue between exactly one producer thread and one
+	* consumer thread.
+	*
+	* Each side owns one index and only reads the other's, the release store
+	* of an index publishes the slot written or freed before it. Both sides
+	* keep a copy of the other's index and only reload it when the queue looks
+	* full or empty, so a push or pop in the common case touches no cache line
+	* the other thread is writing. Indices grow forever, the slot is the index
+	* modulo Capacity
+	*/
+	template <typename T, size_t Capacity>
+	class SpscQueue {
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+	public:
+		// Producer only. Returns false if the queue is full
+		bool Push(const T& item) {
+			size_t write = writeIndex.load(std::memory_order_relaxed);
+			if (write - cachedReadIndex == Capacity) {
+				cachedReadIndex = readIndex.load(std::memory_order_acquire);
+				if (write - cachedReadIndex == Capacity) return false;
+			}
+			items[write & (Capacity - 1)] = item;
+			writeIndex.store(write + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer only. Returns false if the queue is empty
+		bool Pop(T& item) {
+			size_t read = readIndex.load(std::memory_order_relaxed);
+			if (read == cachedWriteIndex) {
+				cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+				if (read == cachedWriteIndex) return false;
+			}
+			item = items[read & (Capacity - 1)];
+			readIndex.store(read + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		T items[Capacity];
+
+		// Written by the producer
+		alignas(64) std::atomic<size_t> writeIndex{ 0 };
+		size_t cachedReadIndex = 0;
+
+		// Written by the consumer
+		alignas(64) std::atomic<size_t> readIndex{ 0 };
+		size_t cachedWriteIndex = 0;
+	};
+
+	/*
+	* Input and window events, recorded by the GLFW callbacks on the event
+	* thread and applied by the render thread. time is when the callback ran,
+	* the start of the input to photon latency
+	*/
+	struct WindowEvent {
+		enum class Type { Key, Resize, Close };
+
+		Type type = Type::Close;
+		// GLFW key and action of Key events
+		int key = 0;
+		int action = 0;
+		// New window size of Resize events
+		int width = 0;
+		int height = 0;
+		std::chrono::high_resolution_clock::time_point time;
+	};
+}
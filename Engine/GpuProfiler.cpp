@@ -0,0 +1,267 @@
+// User-defined Headers
+#include "GpuProfiler.h"
+
+// System Headers
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+const uint32_t Engine::GpuProfiler::kHistorySize;
+const uint32_t Engine::GpuProfiler::kMaxScopesPerFrame;
+const uint32_t Engine::GpuProfiler::kTraceSamples;
+const VkQueryPipelineStatisticFlags Engine::GpuProfiler::kStatistics;
+
+Engine::GpuProfiler::~GpuProfiler()
+{
+	Destroy();
+}
+
+void Engine::GpuProfiler::Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamily, uint32_t frameCount, bool pipelineStatistics,
+	uint32_t sampleHistory)
+{
+	device = logicalDevice;
+	frames.assign(frameCount, FrameQueries());
+	historySize = std::max(1u, sampleHistory);
+	statisticsHistory.capacity = historySize;
+	traceHistory.capacity = kTraceSamples;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+	if (validBits > 0) {
+		timestampPeriod = deviceProperties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+		VkQueryPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = frameCount * kMaxScopesPerFrame * 2;
+
+		if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timestamp Query Pool!");
+		}
+	}
+
+	if (pipelineStatistics) {
+		VkQueryPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		poolInfo.queryCount = frameCount;
+		poolInfo.pipelineStatistics = kStatistics;
+
+		if (vkCreateQueryPool(device, &poolInfo, nullptr, &statisticsPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline statistics Query Pool!");
+		}
+	}
+}
+
+void Engine::GpuProfiler::Destroy()
+{
+	if (timestampPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, timestampPool, nullptr);
+		timestampPool = VK_NULL_HANDLE;
+	}
+	if (statisticsPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, statisticsPool, nullptr);
+		statisticsPool = VK_NULL_HANDLE;
+	}
+	frames.clear();
+}
+
+uint32_t Engine::GpuProfiler::AddScope(const std::string& name)
+{
+	scopeNames.push_back(name);
+	scopeHistories.push_back(History<float>());
+	scopeHistories.back().capacity = historySize;
+	return static_cast<uint32_t>(scopeNames.size() - 1);
+}
+
+void Engine::GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	Collect(frameSlot);
+	currentSlot = frameSlot;
+
+	if (HasTimestamps()) {
+		vkCmdResetQueryPool(commandBuffer, timestampPool, frameSlot * kMaxScopesPerFrame * 2, kMaxScopesPerFrame * 2);
+	}
+	if (HasPipelineStatistics()) {
+		vkCmdResetQueryPool(commandBuffer, statisticsPool, frameSlot, 1);
+	}
+}
+
+void Engine::GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	std::vector<uint32_t>& scopes = frames[currentSlot].scopes;
+	if (!HasTimestamps() || scopes.size() == kMaxScopesPerFrame) return;
+
+	uint32_t query = currentSlot * kMaxScopesPerFrame * 2 + static_cast<uint32_t>(scopes.size()) * 2;
+	scopes.push_back(scope);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, query);
+}
+
+void Engine::GpuProfiler::EndScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	const std::vector<uint32_t>& scopes = frames[currentSlot].scopes;
+	auto begun = std::find(scopes.begin(), scopes.end(), scope);
+	// Scopes beyond kMaxScopesPerFrame were never begun
+	if (begun == scopes.end()) return;
+
+	uint32_t query = currentSlot * kMaxScopesPerFrame * 2 + static_cast<uint32_t>(begun - scopes.begin()) * 2 + 1;
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, query);
+}
+
+void Engine::GpuProfiler::MarkSubmitted()
+{
+	frames[currentSlot].submitNs = Profiler::Now();
+}
+
+void Engine::GpuProfiler::BeginStatistics(VkCommandBuffer commandBuffer)
+{
+	if (!HasPipelineStatistics()) return;
+
+	vkCmdBeginQuery(commandBuffer, statisticsPool, currentSlot, 0);
+	frames[currentSlot].statistics = true;
+}
+
+void Engine::GpuProfiler::EndStatistics(VkCommandBuffer commandBuffer)
+{
+	if (!HasPipelineStatistics()) return;
+
+	vkCmdEndQuery(commandBuffer, statisticsPool, currentSlot);
+}
+
+/*
+* The slot's fence has signaled, so its queries are available and
+* vkGetQueryPoolResults returns without waiting. VK_NOT_READY would mean the
+* frame never reached the GPU, its results are dropped
+*/
+void Engine::GpuProfiler::Collect(uint32_t frameSlot)
+{
+	FrameQueries& frame = frames[frameSlot];
+
+	if (!frame.scopes.empty()) {
+		std::vector<uint64_t> timestamps(frame.scopes.size() * 2);
+		VkResult result = vkGetQueryPoolResults(device, timestampPool, frameSlot * kMaxScopesPerFrame * 2, static_cast<uint32_t>(timestamps.size()),
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			// The first scope begun is the outermost, the trace places the frame from its start
+			uint64_t frameStart = timestamps[0];
+			uint64_t frameStartNs = std::max(frame.submitNs, traceEndNs);
+			for (size_t i = 0; i < frame.scopes.size(); i++) {
+				uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+				scopeHistories[frame.scopes[i]].Add(static_cast<float>(ticks * timestampPeriod * 1e-6));
+
+				TraceSample sample;
+				sample.scope = frame.scopes[i];
+				sample.startNs = frameStartNs + static_cast<uint64_t>(((timestamps[i * 2] - frameStart) & timestampMask) * timestampPeriod);
+				sample.durationNs = static_cast<uint64_t>(ticks * timestampPeriod);
+				traceHistory.Add(sample);
+				traceEndNs = std::max(traceEndNs, sample.startNs + sample.durationNs);
+			}
+		}
+		frame.scopes.clear();
+	}
+
+	if (frame.statistics) {
+		// Results come in the order of the flag bits
+		uint64_t values[4];
+		VkResult result = vkGetQueryPoolResults(device, statisticsPool, frameSlot, 1, sizeof(values), values, sizeof(values), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			PipelineStatistics statistics;
+			statistics.inputPrimitives = values[0];
+			statistics.vertexInvocations = values[1];
+			statistics.clippingPrimitives = values[2];
+			statistics.fragmentInvocations = values[3];
+			statisticsHistory.Add(statistics);
+		}
+		frame.statistics = false;
+	}
+}
+
+void Engine::GpuProfiler::Flush()
+{
+	for (uint32_t slot = 0; slot < frames.size(); slot++) {
+		Collect(slot);
+	}
+}
+
+void Engine::GpuProfiler::ResetHistory()
+{
+	for (History<float>& history : scopeHistories) {
+		history.Clear();
+	}
+	statisticsHistory.Clear();
+}
+
+std::vector<float> Engine::GpuProfiler::GetSamples(uint32_t scope) const
+{
+	return scopeHistories[scope].Ordered();
+}
+
+std::vector<Engine::GpuProfiler::ScopeSummary> Engine::GpuProfiler::GetSummaries() const
+{
+	std::vector<ScopeSummary> summaries;
+	for (size_t scope = 0; scope < scopeNames.size(); scope++) {
+		std::vector<float> samples = scopeHistories[scope].samples;
+		if (samples.empty()) continue;
+		std::sort(samples.begin(), samples.end());
+
+		ScopeSummary summary;
+		summary.name = scopeNames[scope];
+		summary.samples = static_cast<uint32_t>(samples.size());
+		summary.minMs = samples.front();
+		double total = 0.0;
+		for (float sample : samples) {
+			total += sample;
+		}
+		summary.averageMs = total / samples.size();
+		// Nearest rank
+		size_t rank = static_cast<size_t>(std::ceil(0.99 * samples.size()));
+		summary.p99Ms = samples[std::max<size_t>(rank, 1) - 1];
+		summaries.push_back(summary);
+	}
+	return summaries;
+}
+
+Engine::GpuProfiler::PipelineStatistics Engine::GpuProfiler::GetAverageStatistics() const
+{
+	PipelineStatistics average;
+	const std::vector<PipelineStatistics>& samples = statisticsHistory.samples;
+	if (samples.empty()) return average;
+
+	for (const PipelineStatistics& sample : samples) {
+		average.inputPrimitives += sample.inputPrimitives;
+		average.vertexInvocations += sample.vertexInvocations;
+		average.clippingPrimitives += sample.clippingPrimitives;
+		average.fragmentInvocations += sample.fragmentInvocations;
+	}
+	average.inputPrimitives /= samples.size();
+	average.vertexInvocations /= samples.size();
+	average.clippingPrimitives /= samples.size();
+	average.fragmentInvocations /= samples.size();
+	return average;
+}
+
+std::vector<Engine::Profiler::TraceEvent> Engine::GpuProfiler::GetTraceEvents() const
+{
+	std::vector<TraceSample> samples = traceHistory.Ordered();
+	std::vector<Profiler::TraceEvent> events;
+	events.reserve(samples.size());
+
+	for (const TraceSample& sample : samples) {
+		Profiler::TraceEvent event;
+		event.name = scopeNames[sample.scope].c_str();
+		event.startNs = sample.startNs;
+		event.durationNs = sample.durationNs;
+		events.push_back(event);
+	}
+	return events;
+}
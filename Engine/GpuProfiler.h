@@ -0,0 +1,177 @@
+#pragma once
+
+// User-defined Headers
+#include "Profiler.h"
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Engine {
+
+	/*
+	* GPU timings of named scopes in the frame's command buffer, and
+	* optionally the pipeline statistics of one part of it.
+	*
+	* Every frame slot owns its own range of timestamp queries (two per scope)
+	* and one pipeline statistics query. BeginFrame is called once the slot's
+	* fence has signaled, so the results of the frame that last used the slot
+	* are read without waiting on the GPU, framesInFlight frames after they
+	* were recorded, and the slot's queries are reset for the new frame.
+	*
+	* Results go into a ring of the last historySize frames per scope, which
+	* GetSummaries condenses into min, average and 99th percentile. The last
+	* kTraceSamples scopes are also kept for the CPU profiler's trace, placed
+	* on the CPU clock at the frame's submission, since the GPU cannot start
+	* earlier, or after the previous frame's end if that is later
+	*/
+	class GpuProfiler {
+	public:
+		struct ScopeSummary {
+			std::string name;
+			uint32_t samples = 0;
+			double minMs = 0.0;
+			double averageMs = 0.0;
+			double p99Ms = 0.0;
+		};
+
+		struct PipelineStatistics {
+			uint64_t inputPrimitives = 0;
+			uint64_t vertexInvocations = 0;
+			uint64_t clippingPrimitives = 0;
+			uint64_t fragmentInvocations = 0;
+		};
+
+		static const uint32_t kHistorySize = 256;
+		static const uint32_t kMaxScopesPerFrame = 16;
+		static const uint32_t kTraceSamples = 4096;
+
+		~GpuProfiler();
+
+		/*
+		* Timestamps are disabled if queueFamily has no timestamp support.
+		* pipelineStatistics needs the pipelineStatisticsQuery and, since the
+		* measured draws are in secondary command buffers, inheritedQueries
+		* features enabled on the device
+		*/
+		void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount, bool pipelineStatistics,
+			uint32_t historySize = kHistorySize);
+		void Destroy();
+
+		bool HasTimestamps() const { return timestampPool != VK_NULL_HANDLE; }
+		bool HasPipelineStatistics() const { return statisticsPool != VK_NULL_HANDLE; }
+
+		// Names a scope once, the returned id is passed to BeginScope and EndScope
+		uint32_t AddScope(const std::string& name);
+
+		/*
+		* Collects the results of the slot's previous frame and resets its queries.
+		* Recorded at the start of the frame's command buffer, outside a render pass
+		*/
+		void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+		// Scopes may nest, each scope at most once per frame
+		void BeginScope(VkCommandBuffer commandBuffer, uint32_t scope);
+		void EndScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+		// At most one statistics range per frame, outside or around a whole render pass
+		void BeginStatistics(VkCommandBuffer commandBuffer);
+		void EndStatistics(VkCommandBuffer commandBuffer);
+
+		// Called right after the frame's command buffer was submitted
+		void MarkSubmitted();
+		// Set in the inheritance info of secondaries executed inside the statistics range
+		VkQueryPipelineStatisticFlags GetStatisticsFlags() const { return HasPipelineStatistics() ? kStatistics : 0; }
+
+		// Collects every frame slot, the device must be idle
+		void Flush();
+		// Forgets all samples, e.g. those of warmup frames
+		void ResetHistory();
+
+		// Scopes without samples yet are left out
+		std::vector<ScopeSummary> GetSummaries() const;
+		uint32_t GetScopeCount() const { return static_cast<uint32_t>(scopeNames.size()); }
+		const std::string& GetScopeName(uint32_t scope) const { return scopeNames[scope]; }
+		// The scope's history in milliseconds, oldest first
+		std::vector<float> GetSamples(uint32_t scope) const;
+		// Average per frame over the history
+		PipelineStatistics GetAverageStatistics() const;
+		// The recent scopes in the order they ran, for Profiler::WriteChromeTrace
+		std::vector<Profiler::TraceEvent> GetTraceEvents() const;
+
+	private:
+		static const VkQueryPipelineStatisticFlags kStatistics =
+			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+		// Fixed size ring of the most recent samples
+		template <typename T>
+		struct History {
+			std::vector<T> samples;
+			uint32_t capacity = kHistorySize;
+			uint32_t next = 0;
+
+			void Add(const T& sample) {
+				if (samples.size() < capacity) {
+					samples.push_back(sample);
+				}
+				else {
+					samples[next] = sample;
+				}
+				next = (next + 1) % capacity;
+			}
+
+			// Samples from oldest to newest
+			std::vector<T> Ordered() const {
+				std::vector<T> ordered(samples.begin() + (samples.size() < capacity ? 0 : next), samples.end());
+				ordered.insert(ordered.end(), samples.begin(), samples.begin() + (samples.size() < capacity ? 0 : next));
+				return ordered;
+			}
+
+			void Clear() {
+				samples.clear();
+				next = 0;
+			}
+		};
+
+		// What the frame that last used a slot recorded
+		struct FrameQueries {
+			// Scope of each timestamp pair, in the order they were begun
+			std::vector<uint32_t> scopes;
+			bool statistics = false;
+			uint64_t submitNs = 0;
+		};
+
+		struct TraceSample {
+			uint32_t scope;
+			uint64_t startNs;
+			uint64_t durationNs;
+		};
+
+		void Collect(uint32_t frameSlot);
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		// Nanoseconds per timestamp tick and the bits the queue family fills in
+		double timestampPeriod = 1.0;
+		uint64_t timestampMask = ~0ull;
+
+		std::vector<FrameQueries> frames;
+		uint32_t currentSlot = 0;
+
+		std::vector<std::string> scopeNames;
+		uint32_t historySize = kHistorySize;
+		std::vector<History<float>> scopeHistories;
+		History<PipelineStatistics> statisticsHistory;
+		History<TraceSample> traceHistory;
+		// CPU clock time the last traced frame ended at
+		uint64_t traceEndNs = 0;
+	};
+}
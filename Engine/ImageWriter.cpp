@@ -0,0 +1,185 @@
+// User-defined Headers
+#include "ImageWriter.h"
+
+// System Headers
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+	uint32_t Crc32(const uint8_t* data, size_t length, uint32_t crc = 0)
+	{
+		static uint32_t table[256];
+		static bool tableReady = false;
+		if (!tableReady) {
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++) {
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				table[n] = c;
+			}
+			tableReady = true;
+		}
+
+		crc = ~crc;
+		for (size_t i = 0; i < length; i++) {
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void PutBigEndian(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	// Chunk layout: length, type, data, CRC over type and data
+	void WriteChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data)
+	{
+		std::vector<uint8_t> chunk;
+		chunk.reserve(data.size() + 12);
+		PutBigEndian(chunk, static_cast<uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		PutBigEndian(chunk, Crc32(chunk.data() + 4, chunk.size() - 4));
+		file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	}
+}
+
+void Engine::WritePNG(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + filename + " for writing!");
+	}
+
+	static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(kSignature), sizeof(kSignature));
+
+	// 8 bits per channel, color type 6 (RGBA), default compression, filter and interlace
+	std::vector<uint8_t> header;
+	PutBigEndian(header, width);
+	PutBigEndian(header, height);
+	header.insert(header.end(), { 8, 6, 0, 0, 0 });
+	WriteChunk(file, "IHDR", header);
+
+	// Scanlines are prefixed with filter type 0 (none)
+	const size_t rowBytes = static_cast<size_t>(width) * 4;
+	std::vector<uint8_t> raw;
+	raw.reserve((rowBytes + 1) * height);
+	for (uint32_t y = 0; y < height; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+	}
+
+	// zlib stream made of stored deflate blocks of at most 65535 bytes
+	std::vector<uint8_t> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+
+	size_t position = 0;
+	do {
+		size_t length = std::min<size_t>(raw.size() - position, 65535);
+		bool last = position + length == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(static_cast<uint8_t>(length));
+		zlib.push_back(static_cast<uint8_t>(length >> 8));
+		zlib.push_back(static_cast<uint8_t>(~length));
+		zlib.push_back(static_cast<uint8_t>(~length >> 8));
+		zlib.insert(zlib.end(), raw.begin() + position, raw.begin() + position + length);
+		position += length;
+	} while (position < raw.size());
+
+	// Adler-32 of the uncompressed data
+	uint32_t a = 1, b = 0;
+	for (uint8_t value : raw) {
+		a = (a + value) % 65521;
+		b = (b + a) % 65521;
+	}
+	PutBigEndian(zlib, (b << 16) | a);
+
+	WriteChunk(file, "IDAT", zlib);
+	WriteChunk(file, "IEND", {});
+}
+
+void Engine::WriteRaw(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + filename + " for writing!");
+	}
+	file.write(reinterpret_cast<const char*>(rgba), static_cast<std::streamsize>(width) * height * 4);
+}
+
+Engine::FrameWriter::FrameWriter(const std::string& directory, Format format)
+	: directory(directory), format(format)
+{
+	worker = std::thread(&FrameWriter::WorkerLoop, this);
+}
+
+Engine::FrameWriter::~FrameWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queueChanged.notify_all();
+	worker.join();
+}
+
+void Engine::FrameWriter::Push(uint64_t frameNumber, uint32_t width, uint32_t height, std::vector<uint8_t>&& rgba)
+{
+	if (format == Format::None) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back({ frameNumber, width, height, std::move(rgba) });
+	}
+	queueChanged.notify_all();
+}
+
+void Engine::FrameWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	queueChanged.wait(lock, [this] { return queue.empty() && !writing; });
+}
+
+void Engine::FrameWriter::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+		if (queue.empty()) return;
+
+		Frame frame = std::move(queue.front());
+		queue.pop_front();
+		writing = true;
+		lock.unlock();
+
+		std::ostringstream filename;
+		filename << directory << "/frame_" << std::setw(6) << std::setfill('0') << frame.frameNumber
+			<< (format == Format::PNG ? ".png" : ".raw");
+		try {
+			if (format == Format::PNG) {
+				WritePNG(filename.str(), frame.width, frame.height, frame.rgba.data());
+			}
+			else {
+				WriteRaw(filename.str(), frame.width, frame.height, frame.rgba.data());
+			}
+		}
+		catch (const std::runtime_error& e) {
+			std::cerr << e.what() << std::endl;
+		}
+
+		lock.lock();
+		writing = false;
+		queueChanged.notify_all();
+	}
+}
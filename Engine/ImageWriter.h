@@ -0,0 +1,61 @@
+#pragma once
+
+// System Headers
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Engine {
+
+	/*
+	* Writes an 8-bit RGBA image as PNG. The image data is stored in
+	* uncompressed deflate blocks, which keeps the writer dependency free
+	* and fast enough to keep up with the renderer
+	*/
+	void WritePNG(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+	// Writes the tightly packed RGBA pixels with no header at all
+	void WriteRaw(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+	/*
+	* Streams read-back frames to disk on a background thread, so file
+	* I/O overlaps with rendering of the following frames
+	*/
+	class FrameWriter {
+	public:
+		enum class Format { None, PNG, Raw };
+
+		FrameWriter(const std::string& directory, Format format);
+		~FrameWriter();
+
+		// Takes ownership of the pixel data
+		void Push(uint64_t frameNumber, uint32_t width, uint32_t height, std::vector<uint8_t>&& rgba);
+
+		// Blocks until every pushed frame has been written
+		void Flush();
+
+	private:
+		struct Frame {
+			uint64_t frameNumber;
+			uint32_t width;
+			uint32_t height;
+			std::vector<uint8_t> rgba;
+		};
+
+		void WorkerLoop();
+
+		std::string directory;
+		Format format;
+
+		std::deque<Frame> queue;
+		bool writing = false;
+		bool stopping = false;
+		std::mutex mutex;
+		std::condition_variable queueChanged;
+		std::thread worker;
+	};
+}
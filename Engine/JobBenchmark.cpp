@@ -0,0 +1,144 @@
+// User-defined Headers
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include "CubeSphere.h"
+
+// System Headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace {
+	const uint32_t kRuns = 5;
+
+	const uint32_t kEmptyJobs = 100000;
+	const uint32_t kArraySize = 1 << 23;
+	const uint32_t kWaves = 256;
+	const uint32_t kJobsPerWave = 64;
+	// All patches of level 6 on one cube face
+	const uint32_t kPatchLevel = 6;
+	const uint32_t kPatchCount = (1u << kPatchLevel) * (1u << kPatchLevel);
+
+	// Best of kRuns, in milliseconds
+	double Measure(const std::function<void()>& run)
+	{
+		double best = 1e30;
+		for (uint32_t i = 0; i < kRuns; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			run();
+			auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+
+	double EmptyJobs(Engine::JobSystem& jobs)
+	{
+		return Measure([&] {
+			Engine::JobCounter counter;
+			for (uint32_t i = 0; i < kEmptyJobs; i++) {
+				jobs.Run([] {}, &counter);
+			}
+			jobs.Wait(counter);
+		});
+	}
+
+	double ParallelFor(Engine::JobSystem& jobs, std::vector<float>& data)
+	{
+		return Measure([&] {
+			jobs.ParallelFor(kArraySize, 16 * 1024, [&](uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; i++) {
+					float x = data[i];
+					data[i] = std::sqrt(x * x + 1.0f) * std::sin(x) + 0.5f;
+				}
+			});
+		});
+	}
+
+	double Dependencies(Engine::JobSystem& jobs)
+	{
+		return Measure([&] {
+			std::vector<Engine::JobCounter> waves(kWaves);
+			std::atomic<uint32_t> sum{ 0 };
+			for (uint32_t wave = 0; wave < kWaves; wave++) {
+				for (uint32_t job = 0; job < kJobsPerWave; job++) {
+					auto work = [&sum, job] {
+						// A few microseconds of work, roughly a small culling or animation job
+						float x = float(job);
+						for (int i = 0; i < 500; i++) {
+							x = std::sqrt(x + 1.0f);
+						}
+						sum += x > 0.0f ? 1 : 0;
+					};
+					if (wave == 0) {
+						jobs.Run(work, &waves[0]);
+					}
+					else {
+						jobs.RunAfter(waves[wave - 1], work, &waves[wave]);
+					}
+				}
+			}
+			jobs.Wait(waves.back());
+		});
+	}
+
+	double Patches(Engine::JobSystem& jobs, std::vector<Engine::PatchVertex>& vertices, std::vector<Engine::PatchBounds>& bounds)
+	{
+		return Measure([&] {
+			jobs.ParallelFor(kPatchCount, 8, [&](uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; i++) {
+					Engine::PatchKey key = { 0, kPatchLevel, i % (1u << kPatchLevel), i / (1u << kPatchLevel) };
+					Engine::CubeSphere::GeneratePatch(key, 1.0f, vertices.data() + size_t(i) * Engine::CubeSphere::kVerticesPerPatch, bounds[i]);
+				}
+			});
+		});
+	}
+}
+
+void Engine::RunJobBenchmarks(uint32_t maxThreads, std::ostream& out)
+{
+	maxThreads = std::max(1u, maxThreads);
+	std::vector<uint32_t> threadCounts;
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::vector<float> data(kArraySize);
+	for (uint32_t i = 0; i < kArraySize; i++) {
+		data[i] = float(i % 1000) * 0.001f;
+	}
+	std::vector<PatchVertex> vertices(size_t(kPatchCount) * CubeSphere::kVerticesPerPatch);
+	std::vector<PatchBounds> bounds(kPatchCount);
+
+	const char* names[] = { "empty-jobs", "parallel-for", "dependencies", "patches" };
+	std::vector<std::vector<double>> times(4);
+	for (uint32_t threads : threadCounts) {
+		JobSystem jobs;
+		jobs.Init(threads - 1);
+		times[0].push_back(EmptyJobs(jobs));
+		times[1].push_back(ParallelFor(jobs, data));
+		times[2].push_back(Dependencies(jobs));
+		times[3].push_back(Patches(jobs, vertices, bounds));
+		jobs.Shutdown();
+	}
+
+	out << "Job system microbenchmarks, best of " << kRuns << " runs, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+	out << std::left << std::setw(14) << "benchmark" << std::right << std::setw(8) << "threads" << std::setw(12) << "ms"
+		<< std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::endl;
+	out << std::fixed;
+	for (size_t benchmark = 0; benchmark < times.size(); benchmark++) {
+		for (size_t i = 0; i < threadCounts.size(); i++) {
+			double speedup = times[benchmark][0] / times[benchmark][i];
+			out << std::left << std::setw(14) << names[benchmark] << std::right << std::setw(8) << threadCounts[i]
+				<< std::setw(12) << std::setprecision(3) << times[benchmark][i]
+				<< std::setw(9) << std::setprecision(2) << speedup << "x"
+				<< std::setw(11) << std::setprecision(0) << speedup / threadCounts[i] * 100.0 << "%" << std::endl;
+		}
+	}
+}
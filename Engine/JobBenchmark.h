@@ -0,0 +1,21 @@
+#pragma once
+
+// System Headers
+#include <cstdint>
+#include <ostream>
+
+namespace Engine {
+
+	/*
+	* Microbenchmarks of the job system, run by --bench-jobs. Every benchmark
+	* runs with 1, 2, 4, ... threads up to maxThreads (the thread waiting for
+	* the jobs included) and reports the best of several runs, with speedup and
+	* parallel efficiency relative to the single threaded run:
+	*
+	* empty-jobs    : scheduling overhead, many jobs that do nothing
+	* parallel-for  : arithmetic over a large array split with ParallelFor
+	* dependencies  : waves of small jobs each started by the previous wave via RunAfter
+	* patches       : cube-sphere patch generation, the engine's mesh workload
+	*/
+	void RunJobBenchmarks(uint32_t maxThreads, std::ostream& out);
+}
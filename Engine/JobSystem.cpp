@@ -0,0 +1,295 @@
+// User-defined Headers
+#include "JobSystem.h"
+#include "Profiler.h"
+
+// System Headers
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+	// Set on the worker threads, GetThreadIndex is 0 everywhere else
+	thread_local const Engine::JobSystem* currentJobSystem = nullptr;
+	thread_local uint32_t currentThreadIndex = 0;
+}
+
+Engine::JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+void Engine::JobSystem::Init(uint32_t workerCount)
+{
+	stopping = false;
+	queues.clear();
+	for (uint32_t i = 0; i <= workerCount; i++) {
+		queues.emplace_back(new WorkerQueue());
+	}
+	for (uint32_t i = 1; i <= workerCount; i++) {
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+void Engine::JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	// Without workers nothing has run the background jobs yet
+	Job job;
+	while (TryPop(0, job) || TrySteal(0, job) || TryPopBackground(job)) {
+		Execute(job);
+	}
+}
+
+uint32_t Engine::JobSystem::GetThreadIndex() const
+{
+	return currentJobSystem == this ? currentThreadIndex : 0;
+}
+
+void Engine::JobSystem::Run(std::function<void()> function, JobCounter* counter)
+{
+	if (counter) {
+		counter->pending++;
+	}
+	Push({ std::move(function), counter });
+}
+
+void Engine::JobSystem::RunAfter(JobCounter& dependency, std::function<void()> function, JobCounter* counter)
+{
+	if (counter) {
+		counter->pending++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(dependency.mutex);
+		if (dependency.pending.load() != 0) {
+			dependency.continuations.push_back({ std::move(function), counter });
+			return;
+		}
+	}
+	Push({ std::move(function), counter });
+}
+
+void Engine::JobSystem::RunBackground(std::function<void()> function, JobCounter* counter)
+{
+	if (counter) {
+		counter->pending++;
+	}
+	Job job = { std::move(function), counter };
+
+	// Nothing else would ever run it
+	if (workers.empty()) {
+		Execute(job);
+		return;
+	}
+
+	queuedBackgroundJobs++;
+	{
+		std::lock_guard<std::mutex> lock(backgroundMutex);
+		backgroundJobs.push_back(std::move(job));
+	}
+	WakeWorker();
+}
+
+void Engine::JobSystem::Wait(JobCounter& counter)
+{
+	uint32_t index = GetThreadIndex();
+	while (!counter.IsDone()) {
+		Job job;
+		if (TryPop(index, job) || TrySteal(index, job)) {
+			Execute(job);
+			continue;
+		}
+
+		// The last jobs of the counter are running elsewhere
+		std::unique_lock<std::mutex> lock(doneMutex);
+		counterDone.wait_for(lock, std::chrono::microseconds(100), [&] {
+			return counter.IsDone() || queuedJobs.load() > 0;
+		});
+	}
+
+	// The thread that finished the last job may still hold the counter's mutex
+	std::string error;
+	{
+		std::lock_guard<std::mutex> lock(counter.mutex);
+		error.swap(counter.error);
+	}
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+}
+
+void Engine::JobSystem::ParallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body)
+{
+	if (count == 0) return;
+
+	/*
+	* A few ranges per thread, so threads that finish early can steal from the
+	* others, but none shorter than grain
+	*/
+	grain = std::max(1u, grain);
+	uint32_t ranges = std::min((count + grain - 1) / grain, GetThreadCount() * 4);
+
+	JobCounter counter;
+	for (uint32_t range = ranges - 1; range > 0; range--) {
+		uint32_t begin = static_cast<uint32_t>(uint64_t(count) * range / ranges);
+		uint32_t end = static_cast<uint32_t>(uint64_t(count) * (range + 1) / ranges);
+		Run([&body, begin, end] { body(begin, end); }, &counter);
+	}
+
+	// The other ranges reference body, so they have to finish before an exception leaves
+	std::exception_ptr error;
+	try {
+		body(0, static_cast<uint32_t>(uint64_t(count) / ranges));
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+	try {
+		Wait(counter);
+	}
+	catch (...) {
+		if (!error) error = std::current_exception();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+void Engine::JobSystem::WorkerLoop(uint32_t index)
+{
+	currentJobSystem = this;
+	currentThreadIndex = index;
+	PROFILE_THREAD("Worker " + std::to_string(index));
+
+	for (;;) {
+		Job job;
+		if (TryPop(index, job) || TrySteal(index, job) || TryPopBackground(job)) {
+			Execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers++;
+		workAvailable.wait(lock, [this] {
+			return stopping || queuedJobs.load() > 0 || queuedBackgroundJobs.load() > 0;
+		});
+		sleepingWorkers--;
+		if (stopping && queuedJobs.load() == 0 && queuedBackgroundJobs.load() == 0) return;
+	}
+}
+
+void Engine::JobSystem::Push(Job job)
+{
+	// Counted before it is visible, so a worker going to sleep either sees the count or gets woken
+	queuedJobs++;
+	WorkerQueue& queue = *queues[GetThreadIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+	WakeWorker();
+}
+
+bool Engine::JobSystem::TryPop(uint32_t index, Job& job)
+{
+	WorkerQueue& queue = *queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty()) return false;
+
+	job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	queuedJobs--;
+	return true;
+}
+
+bool Engine::JobSystem::TrySteal(uint32_t index, Job& job)
+{
+	uint32_t queueCount = static_cast<uint32_t>(queues.size());
+	for (uint32_t i = 1; i < queueCount; i++) {
+		WorkerQueue& queue = *queues[(index + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) continue;
+
+		job = std::move(queue.jobs.front());
+		queue.jobs.pop_front();
+		queuedJobs--;
+		return true;
+	}
+	return false;
+}
+
+bool Engine::JobSystem::TryPopBackground(Job& job)
+{
+	if (queuedBackgroundJobs.load() == 0) return false;
+
+	std::lock_guard<std::mutex> lock(backgroundMutex);
+	if (backgroundJobs.empty()) return false;
+
+	job = std::move(backgroundJobs.front());
+	backgroundJobs.pop_front();
+	queuedBackgroundJobs--;
+	return true;
+}
+
+void Engine::JobSystem::Execute(Job& job)
+{
+	PROFILE_SCOPE("Job");
+	try {
+		job.function();
+	}
+	catch (const std::exception& e) {
+		if (job.counter) {
+			std::lock_guard<std::mutex> lock(job.counter->mutex);
+			if (job.counter->error.empty()) {
+				job.counter->error = e.what();
+			}
+		}
+		else {
+			std::cerr << "Job failed: " << e.what() << std::endl;
+		}
+	}
+	Finish(job.counter);
+}
+
+void Engine::JobSystem::Finish(JobCounter* counter)
+{
+	if (!counter) return;
+
+	// Once the count is zero the counter may be destroyed by its waiter, it is not touched after the unlock
+	std::vector<Job> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		if (--counter->pending != 0) return;
+		ready.swap(counter->continuations);
+	}
+
+	for (Job& job : ready) {
+		Push(std::move(job));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(doneMutex);
+	}
+	counterDone.notify_all();
+}
+
+void Engine::JobSystem::WakeWorker()
+{
+	if (sleepingWorkers.load() == 0) return;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	workAvailable.notify_one();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+// System Headers
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Engine {
+
+	class JobCounter;
+
+	// A function queued on the job system and the counter it decrements when done
+	struct Job {
+		std::function<void()> function;
+		JobCounter* counter = nullptr;
+	};
+
+	/*
+	* Counts the unfinished jobs started with it. Jobs can be made to wait for a
+	* counter with JobSystem::RunAfter, and threads with JobSystem::Wait.
+	* A counter must outlive its jobs, and is only reused once it has been waited on
+	*/
+	class JobCounter {
+	public:
+		bool IsDone() const { return pending.load() == 0; }
+		uint32_t GetPending() const { return pending.load(); }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> pending{ 0 };
+		// Jobs started by RunAfter before the counter reached zero, and the first error of its jobs
+		std::mutex mutex;
+		std::vector<Job> continuations;
+		std::string error;
+	};
+
+	/*
+	* Work-stealing scheduler for the engine's CPU work.
+	*
+	* Every worker thread owns a deque of jobs. A worker pushes the jobs it
+	* starts to the back of its own deque and takes work from the back as well,
+	* so nested jobs run while their data is still in the cache. A worker whose
+	* deque is empty steals from the front of the other deques, where the
+	* oldest and usually biggest jobs are. Threads that are not workers, like
+	* the render loop's, share one more deque that only the workers steal from.
+	*
+	* Wait does not block while there is work: the waiting thread runs queued
+	* jobs itself until its counter reaches zero, so the render loop's thread
+	* is one more worker whenever it waits on a ParallelFor.
+	*
+	* Background jobs (file I/O, image decoding) go into a separate FIFO queue.
+	* Workers only take them when no other job is queued and waiting threads
+	* never run them, so a frame never waits behind a disk read
+	*/
+	class JobSystem {
+	public:
+		~JobSystem();
+
+		// 0 workers runs every job on the thread that waits for it
+		void Init(uint32_t workerCount);
+		// Runs what is still queued, then joins the workers
+		void Shutdown();
+
+		// Workers plus the thread calling Wait
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(queues.size()); }
+		// 1 to workerCount on the workers of this job system, 0 on any other thread
+		uint32_t GetThreadIndex() const;
+
+		void Run(std::function<void()> function, JobCounter* counter = nullptr);
+		// Starts function once dependency reaches zero
+		void RunAfter(JobCounter& dependency, std::function<void()> function, JobCounter* counter = nullptr);
+		// For jobs that block on I/O, see above
+		void RunBackground(std::function<void()> function, JobCounter* counter = nullptr);
+
+		/*
+		* Runs jobs until counter reaches zero. An exception thrown by one of the
+		* counter's jobs is rethrown here as std::runtime_error
+		*/
+		void Wait(JobCounter& counter);
+
+		/*
+		* Calls body on ranges of at least grain of [0, count) in parallel and
+		* waits for all of them. The calling thread runs the first range
+		*/
+		void ParallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body);
+
+	private:
+		struct WorkerQueue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void WorkerLoop(uint32_t index);
+		void Push(Job job);
+		bool TryPop(uint32_t index, Job& job);
+		bool TrySteal(uint32_t index, Job& job);
+		bool TryPopBackground(Job& job);
+		void Execute(Job& job);
+		void Finish(JobCounter* counter);
+		void WakeWorker();
+
+		// queues[0] is shared by all threads that are not workers
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<uint32_t> queuedJobs{ 0 };
+
+		std::mutex backgroundMutex;
+		std::deque<Job> backgroundJobs;
+		std::atomic<uint32_t> queuedBackgroundJobs{ 0 };
+
+		// Idle workers sleep on workAvailable, waiting threads without work on counterDone
+		std::mutex sleepMutex;
+		std::condition_variable workAvailable;
+		std::atomic<uint32_t> sleepingWorkers{ 0 };
+		bool stopping = false;
+		std::mutex doneMutex;
+		std::condition_variable counterDone;
+	};
+}
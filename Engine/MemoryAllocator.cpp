@@ -0,0 +1,302 @@
+// User-defined Headers
+#include "MemoryAllocator.h"
+
+// System Headers
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Block sizes used for large heaps; small heaps get an eighth of their size per block
+	const VkDeviceSize kDeviceLocalBlockSize = 64ull * 1024 * 1024;
+	const VkDeviceSize kHostVisibleBlockSize = 16ull * 1024 * 1024;
+}
+
+void Engine::MemoryAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice)
+{
+	device = logicalDevice;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	bufferImageGranularity = std::max<VkDeviceSize>(deviceProperties.limits.bufferImageGranularity, 1);
+	maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+	pools.clear();
+	pools.resize(memoryProperties.memoryTypeCount);
+	deviceAllocationCount = 0;
+}
+
+void Engine::MemoryAllocator::Destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& pool : pools) {
+		for (auto& block : pool.blocks) {
+			if (block.memory != VK_NULL_HANDLE) {
+				if (block.allocationCount > 0) {
+					std::cerr << "MemoryAllocator: " << block.allocationCount << " allocation(s) still alive at shutdown" << std::endl;
+				}
+				vkFreeMemory(device, block.memory, nullptr);
+			}
+		}
+	}
+	pools.clear();
+	deviceAllocationCount = 0;
+}
+
+uint32_t Engine::MemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable Memory type!");
+}
+
+VkDeviceSize Engine::MemoryAllocator::PreferredBlockSize(uint32_t memoryType) const
+{
+	const VkMemoryType& type = memoryProperties.memoryTypes[memoryType];
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[type.heapIndex].size;
+
+	VkDeviceSize blockSize = (type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? kHostVisibleBlockSize : kDeviceLocalBlockSize;
+	return std::min(blockSize, heapSize / 8);
+}
+
+VkDeviceMemory Engine::MemoryAllocator::AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped)
+{
+	if (maxAllocationCount != 0 && deviceAllocationCount >= maxAllocationCount) {
+		throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+	}
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate device memory!");
+	}
+	deviceAllocationCount++;
+
+	// Host visible memory is mapped once and stays mapped until it is freed
+	*mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+			vkFreeMemory(device, memory, nullptr);
+			deviceAllocationCount--;
+			throw std::runtime_error("Failed to map device memory!");
+		}
+	}
+
+	return memory;
+}
+
+bool Engine::MemoryAllocator::AllocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	// First fit over the offset-sorted free list
+	for (size_t i = 0; i < block.freeList.size(); i++) {
+		FreeRange range = block.freeList[i];
+		VkDeviceSize alignedOffset = AlignUp(range.offset, alignment);
+		VkDeviceSize padding = alignedOffset - range.offset;
+		if (padding + size > range.size) continue;
+
+		// Split the range into the alignment padding in front and the remainder behind
+		VkDeviceSize tailOffset = alignedOffset + size;
+		VkDeviceSize tailSize = range.offset + range.size - tailOffset;
+
+		block.freeList.erase(block.freeList.begin() + i);
+		if (tailSize > 0) {
+			block.freeList.insert(block.freeList.begin() + i, { tailOffset, tailSize });
+		}
+		if (padding > 0) {
+			block.freeList.insert(block.freeList.begin() + i, { range.offset, padding });
+		}
+
+		offset = alignedOffset;
+		return true;
+	}
+	return false;
+}
+
+Engine::Allocation Engine::MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+	bool optimalImage, bool dedicated)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Allocation allocation;
+	allocation.memoryType = FindMemoryType(requirements.memoryTypeBits, properties);
+	Pool& pool = pools[allocation.memoryType];
+
+	VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+	VkDeviceSize size = requirements.size;
+	if (optimalImage) {
+		// Optimal images own whole bufferImageGranularity pages so no buffer can share them
+		alignment = std::max(alignment, bufferImageGranularity);
+		size = AlignUp(size, bufferImageGranularity);
+	}
+
+	VkDeviceSize blockSize = PreferredBlockSize(allocation.memoryType);
+	if (dedicated || size > blockSize / 2) {
+		allocation.memory = AllocateDeviceMemory(requirements.size, allocation.memoryType, &allocation.mapped);
+		allocation.offset = 0;
+		allocation.size = requirements.size;
+		allocation.blockIndex = -1;
+		pool.dedicatedBytes += allocation.size;
+		pool.dedicatedCount++;
+		return allocation;
+	}
+
+	// Try the existing blocks of this memory type first
+	int32_t blockIndex = -1;
+	VkDeviceSize offset = 0;
+	for (size_t i = 0; i < pool.blocks.size(); i++) {
+		if (pool.blocks[i].memory != VK_NULL_HANDLE && AllocateFromBlock(pool.blocks[i], size, alignment, offset)) {
+			blockIndex = static_cast<int32_t>(i);
+			break;
+		}
+	}
+
+	// Otherwise reserve a new block, reusing a released slot so block indices stay stable
+	if (blockIndex < 0) {
+		Block block;
+		void* mapped;
+		block.memory = AllocateDeviceMemory(blockSize, allocation.memoryType, &mapped);
+		block.mapped = static_cast<char*>(mapped);
+		block.size = blockSize;
+		block.freeList.push_back({ 0, blockSize });
+
+		auto freeSlot = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](const Block& b) { return b.memory == VK_NULL_HANDLE; });
+		if (freeSlot != pool.blocks.end()) {
+			*freeSlot = block;
+			blockIndex = static_cast<int32_t>(freeSlot - pool.blocks.begin());
+		}
+		else {
+			pool.blocks.push_back(block);
+			blockIndex = static_cast<int32_t>(pool.blocks.size() - 1);
+		}
+
+		AllocateFromBlock(pool.blocks[blockIndex], size, alignment, offset);
+	}
+
+	Block& block = pool.blocks[blockIndex];
+	block.usedBytes += size;
+	block.allocationCount++;
+
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.blockIndex = blockIndex;
+	allocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+	return allocation;
+}
+
+void Engine::MemoryAllocator::Free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Pool& pool = pools[allocation.memoryType];
+
+	if (allocation.blockIndex < 0) {
+		vkFreeMemory(device, allocation.memory, nullptr);
+		deviceAllocationCount--;
+		pool.dedicatedBytes -= allocation.size;
+		pool.dedicatedCount--;
+		allocation = Allocation();
+		return;
+	}
+
+	Block& block = pool.blocks[allocation.blockIndex];
+	block.usedBytes -= allocation.size;
+	block.allocationCount--;
+
+	// Insert the range back in offset order and merge it with its neighbours
+	FreeRange range = { allocation.offset, allocation.size };
+	auto it = std::lower_bound(block.freeList.begin(), block.freeList.end(), range,
+		[](const FreeRange& a, const FreeRange& b) { return a.offset < b.offset; });
+	it = block.freeList.insert(it, range);
+
+	if (it + 1 != block.freeList.end() && it->offset + it->size == (it + 1)->offset) {
+		it->size += (it + 1)->size;
+		block.freeList.erase(it + 1);
+	}
+	if (it != block.freeList.begin() && (it - 1)->offset + (it - 1)->size == it->offset) {
+		(it - 1)->size += it->size;
+		block.freeList.erase(it);
+	}
+
+	/*
+	* Give empty blocks back to the driver, but keep the first block
+	* of every pool around to avoid thrashing on allocate/free cycles
+	*/
+	if (block.allocationCount == 0 && allocation.blockIndex > 0) {
+		vkFreeMemory(device, block.memory, nullptr);
+		deviceAllocationCount--;
+		block = Block();
+	}
+
+	allocation = Allocation();
+}
+
+std::vector<Engine::HeapStats> Engine::MemoryAllocator::GetHeapStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<HeapStats> stats(memoryProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+		stats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+	}
+
+	for (uint32_t type = 0; type < pools.size(); type++) {
+		const Pool& pool = pools[type];
+		HeapStats& heap = stats[memoryProperties.memoryTypes[type].heapIndex];
+
+		heap.reservedBytes += pool.dedicatedBytes;
+		heap.usedBytes += pool.dedicatedBytes;
+		heap.dedicatedCount += pool.dedicatedCount;
+		heap.allocationCount += pool.dedicatedCount;
+
+		for (const auto& block : pool.blocks) {
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			VkDeviceSize largestFree = 0;
+			for (const auto& range : block.freeList) {
+				largestFree = std::max(largestFree, range.size);
+			}
+
+			heap.reservedBytes += block.size;
+			heap.usedBytes += block.usedBytes;
+			heap.freeBytes += block.size - block.usedBytes;
+			heap.fragmentedBytes += block.size - block.usedBytes - largestFree;
+			heap.blockCount++;
+			heap.allocationCount += block.allocationCount;
+		}
+	}
+	return stats;
+}
+
+void Engine::MemoryAllocator::PrintStats(std::ostream& out) const
+{
+	const double kMiB = 1024.0 * 1024.0;
+	std::vector<HeapStats> stats = GetHeapStats();
+
+	for (size_t i = 0; i < stats.size(); i++) {
+		const HeapStats& heap = stats[i];
+		if (heap.reservedBytes == 0) continue;
+
+		out << "Memory heap " << i << " (" << heap.heapSize / kMiB << " MiB)"
+			<< " | reserved " << heap.reservedBytes / kMiB << " MiB"
+			<< " | used " << heap.usedBytes / kMiB << " MiB"
+			<< " | free " << heap.freeBytes / kMiB << " MiB"
+			<< " | fragmented " << heap.fragmentedBytes / kMiB << " MiB"
+			<< " | " << heap.allocationCount << " allocation(s) in " << heap.blockCount << " block(s), "
+			<< heap.dedicatedCount << " dedicated" << std::endl;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <iostream>
+#include <vector>
+#include <mutex>
+
+namespace Engine {
+
+	/*
+	* A sub-range of device memory handed out by the MemoryAllocator.
+	* Resources are bound at (memory, offset). For host visible memory
+	* `mapped` points at the first byte of the range, the owning block
+	* stays mapped for its whole lifetime
+	*/
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryType = 0;
+		void* mapped = nullptr;
+
+		// Index of the owning block in its memory type pool, -1 for dedicated allocations
+		int32_t blockIndex = -1;
+	};
+
+	// Per memory heap usage reported by MemoryAllocator::GetHeapStats
+	struct HeapStats {
+		VkDeviceSize heapSize = 0;
+		// Bytes of device memory allocated from the driver for this heap
+		VkDeviceSize reservedBytes = 0;
+		// Bytes handed out to resources (including dedicated allocations)
+		VkDeviceSize usedBytes = 0;
+		// Bytes reserved in blocks but not handed out
+		VkDeviceSize freeBytes = 0;
+		// Free bytes outside of the largest free range of each block
+		VkDeviceSize fragmentedBytes = 0;
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+	};
+
+	/*
+	* Every vkAllocateMemory call is expensive, and drivers cap the number of
+	* live allocations at maxMemoryAllocationCount (often as low as 4096).
+	* The allocator therefore reserves large blocks per memory type and
+	* sub-allocates resources from a free list inside each block.
+	*
+	* Linear resources (buffers) and optimal tiling images may not share a
+	* bufferImageGranularity sized page. Optimal images are aligned and padded
+	* to the granularity, so they always own their pages outright.
+	*
+	* Requests larger than half a block get a dedicated vkAllocateMemory
+	*/
+	class MemoryAllocator {
+	public:
+		void Init(VkPhysicalDevice physicalDevice, VkDevice device);
+		void Destroy();
+
+		/*
+		* The memory type is picked with FindMemoryType, and the pool of that memory
+		* type serves the request. optimalImage marks VK_IMAGE_TILING_OPTIMAL images
+		*/
+		Allocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+			bool optimalImage, bool dedicated = false);
+		void Free(Allocation& allocation);
+
+		/*
+		* Graphics cards can offer different types of memory to allocate from.
+		* Each type of memory varies in terms of allowed operations and performance
+		* characteristics. We need to combine the requirements of the resource and
+		* our own application requirements to find the right type of memory to use
+		*/
+		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+		// Introspection: used, free and fragmented bytes per memory heap
+		std::vector<HeapStats> GetHeapStats() const;
+		void PrintStats(std::ostream& out) const;
+
+	private:
+		struct FreeRange {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+
+		struct Block {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			VkDeviceSize usedBytes = 0;
+			uint32_t allocationCount = 0;
+			char* mapped = nullptr;
+			// Sorted by offset, adjacent ranges are always merged
+			std::vector<FreeRange> freeList;
+		};
+
+		struct Pool {
+			std::vector<Block> blocks;
+			VkDeviceSize dedicatedBytes = 0;
+			uint32_t dedicatedCount = 0;
+		};
+
+		VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+		bool AllocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		VkDeviceSize PreferredBlockSize(uint32_t memoryType) const;
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties memoryProperties = {};
+		VkDeviceSize bufferImageGranularity = 1;
+		uint32_t maxAllocationCount = 0;
+		uint32_t deviceAllocationCount = 0;
+
+		std::vector<Pool> pools;
+		mutable std::mutex mutex;
+	};
+}
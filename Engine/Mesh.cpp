@@ -0,0 +1,23 @@
+// User-defined Headers
+#include "Mesh.h"
+
+// System Headers
+#include <stdexcept>
+#include <string>
+
+Engine::MeshIndices::MeshIndices(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+	: wide(vertexCount > 65536), count(static_cast<uint32_t>(indices.size()))
+{
+	for (uint32_t index : indices) {
+		if (index >= vertexCount) {
+			throw std::runtime_error("Mesh index " + std::to_string(index) + " out of range of " + std::to_string(vertexCount) + " vertices!");
+		}
+	}
+
+	if (wide) {
+		indices32 = indices;
+	}
+	else {
+		indices16.assign(indices.begin(), indices.end());
+	}
+}
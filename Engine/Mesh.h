@@ -0,0 +1,92 @@
+#pragma once
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Engine {
+
+	/*
+	* Index list of one mesh. Meshes are built with 32 bit indices and stored
+	* with 16 bit ones when they have at most 65536 vertices, so small meshes
+	* take half the memory and index fetch bandwidth while large ones, like a
+	* UV sphere above 255 x 255 slices and stacks, still draw correctly
+	*/
+	class MeshIndices {
+	public:
+		MeshIndices() = default;
+		// Throws if an index is not below vertexCount
+		MeshIndices(const std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+		VkIndexType GetIndexType() const { return wide ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16; }
+		uint32_t GetIndexSize() const { return wide ? 4 : 2; }
+		uint32_t GetCount() const { return count; }
+		VkDeviceSize GetByteSize() const { return VkDeviceSize(count) * GetIndexSize(); }
+		const void* GetData() const { return wide ? static_cast<const void*>(indices32.data()) : static_cast<const void*>(indices16.data()); }
+
+		uint32_t operator[](size_t i) const { return wide ? indices32[i] : indices16[i]; }
+
+	private:
+		bool wide = false;
+		uint32_t count = 0;
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+	};
+
+	/*
+	* Where a mesh lives in a MeshBuffer. The index buffer is bound at offset 0
+	* with the mesh's index type, firstIndex counts indices of that type from
+	* there and vertexOffset is added to every index before the vertex is
+	* fetched (base vertex)
+	*/
+	struct MeshRange {
+		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		int32_t vertexOffset = 0;
+	};
+
+	/*
+	* Many meshes packed into one vertex and one index buffer. Each mesh keeps
+	* indices relative to its own first vertex, so a small mesh stays 16 bit
+	* however many vertices the buffer holds in total. Meshes of both index
+	* types share the index data, each starting at a multiple of its index size
+	*/
+	template <typename V>
+	class MeshBuffer {
+	public:
+		MeshRange Add(const std::vector<V>& meshVertices, const MeshIndices& meshIndices) {
+			MeshRange range = AddIndices(meshIndices);
+			range.vertexOffset = static_cast<int32_t>(vertices.size());
+			vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+			return range;
+		}
+
+		// For meshes whose vertices live in a buffer of their own, like the globe's patch pool
+		MeshRange AddIndices(const MeshIndices& meshIndices) {
+			uint32_t indexSize = meshIndices.GetIndexSize();
+			size_t offset = (indexData.size() + indexSize - 1) / indexSize * indexSize;
+			indexData.resize(offset + static_cast<size_t>(meshIndices.GetByteSize()));
+			if (meshIndices.GetCount() > 0) {
+				std::memcpy(indexData.data() + offset, meshIndices.GetData(), static_cast<size_t>(meshIndices.GetByteSize()));
+			}
+
+			MeshRange range;
+			range.indexType = meshIndices.GetIndexType();
+			range.firstIndex = static_cast<uint32_t>(offset / indexSize);
+			range.indexCount = meshIndices.GetCount();
+			return range;
+		}
+
+		const std::vector<V>& GetVertices() const { return vertices; }
+		const std::vector<uint8_t>& GetIndexData() const { return indexData; }
+
+	private:
+		std::vector<V> vertices;
+		std::vector<uint8_t> indexData;
+	};
+}
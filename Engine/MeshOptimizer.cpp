@@ -0,0 +1,277 @@
+// User-defined Headers
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+
+// System Headers
+#include <algorithm>
+#include <numeric>
+
+namespace {
+	/*
+	* A cluster is split further where the part before the split reaches, from
+	* a cold cache, an ACMR within this factor of the whole cluster's. Such a
+	* part can be moved by OptimizeOverdraw for little extra vertex work
+	*/
+	const float kClusterThreshold = 1.05f;
+
+	// FIFO cache stored as the miss count at which each vertex entered it
+	class CacheSimulator {
+	public:
+		CacheSimulator(uint32_t vertexCount, uint32_t cacheSize)
+			: entered(vertexCount, 0), size(cacheSize), misses(cacheSize + 1) {}
+
+		// Returns whether the vertex had to be transformed
+		bool Access(uint32_t vertex) {
+			if (misses - entered[vertex] <= size) return false;
+			entered[vertex] = misses++;
+			return true;
+		}
+
+		void Clear() { misses += size + 1; }
+
+	private:
+		std::vector<uint64_t> entered;
+		uint64_t size;
+		// Starts past the cache size, so no vertex is in the cache yet
+		uint64_t misses;
+	};
+}
+
+Engine::VertexCacheStats Engine::AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	if (indices.empty()) return stats;
+
+	CacheSimulator cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	uint32_t misses = 0;
+	uint32_t referencedCount = 0;
+	for (uint32_t index : indices) {
+		if (cache.Access(index)) misses++;
+		if (!referenced[index]) {
+			referenced[index] = true;
+			referencedCount++;
+		}
+	}
+
+	stats.acmr = float(misses) / float(indices.size() / 3);
+	stats.atvr = float(misses) / float(referencedCount);
+	return stats;
+}
+
+std::vector<uint32_t> Engine::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+	// Triangles around every vertex, one range of adjacency per vertex
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (uint32_t index : indices) {
+		liveTriangles[index]++;
+	}
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+	std::partial_sum(liveTriangles.begin(), liveTriangles.end(), adjacencyStart.begin() + 1);
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (uint32_t i = 0; i < indices.size(); i++) {
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	/*
+	* Vertices enter the simulated cache at increasing time stamps and are
+	* still in it while time - cacheTime <= cacheSize. Time starts past the
+	* cache size, so none is in it at first
+	*/
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	std::vector<bool> emitted(triangleCount, false);
+	// Vertices of recently emitted triangles, where fanning continues once it runs out of candidates
+	std::vector<uint32_t> deadEnd;
+	deadEnd.reserve(indices.size());
+	uint32_t cursor = 0;
+
+	auto skipDeadEnd = [&]() -> int64_t {
+		while (!deadEnd.empty()) {
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[vertex] > 0) return vertex;
+		}
+		for (; cursor < vertexCount; cursor++) {
+			if (liveTriangles[cursor] > 0) return cursor;
+		}
+		return -1;
+	};
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::vector<uint32_t> hardClusters;
+	std::vector<uint32_t> candidates;
+
+	int64_t fanning = skipDeadEnd();
+	if (fanning >= 0) hardClusters.push_back(0);
+	while (fanning >= 0) {
+		// Emits every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) continue;
+			emitted[triangle] = true;
+
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t vertex = indices[triangle * 3 + k];
+				output.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - cacheTime[vertex] > cacheSize) {
+					cacheTime[vertex] = time++;
+				}
+			}
+		}
+
+		/*
+		* The next fanning vertex is the candidate that entered the cache
+		* earliest among those whose remaining triangles can be emitted before
+		* it drops out. Candidates that would drop out rank last
+		*/
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates) {
+			if (liveTriangles[vertex] == 0) continue;
+			int64_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+				priority = time - cacheTime[vertex];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+		if (next < 0) {
+			next = skipDeadEnd();
+			if (next >= 0) hardClusters.push_back(static_cast<uint32_t>(output.size() / 3));
+		}
+		fanning = next;
+	}
+	indices.swap(output);
+
+	// Splits the clusters Tipsify had to jump between where the part before the split is cache efficient on its own
+	std::vector<uint32_t> clusters;
+	CacheSimulator cache(vertexCount, cacheSize);
+	for (size_t c = 0; c < hardClusters.size(); c++) {
+		uint32_t start = hardClusters[c];
+		uint32_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+
+		cache.Clear();
+		uint32_t clusterMisses = 0;
+		for (uint32_t i = start * 3; i < end * 3; i++) {
+			if (cache.Access(indices[i])) clusterMisses++;
+		}
+		float threshold = float(clusterMisses) / float(end - start) * kClusterThreshold;
+
+		clusters.push_back(start);
+		cache.Clear();
+		uint32_t misses = 0;
+		uint32_t partStart = start;
+		for (uint32_t triangle = start; triangle < end; triangle++) {
+			for (uint32_t k = 0; k < 3; k++) {
+				if (cache.Access(indices[triangle * 3 + k])) misses++;
+			}
+			if (triangle + 1 < end && float(misses) <= float(triangle + 1 - partStart) * threshold) {
+				clusters.push_back(triangle + 1);
+				partStart = triangle + 1;
+				misses = 0;
+				cache.Clear();
+			}
+		}
+	}
+	return clusters;
+}
+
+void Engine::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, const std::vector<glm::vec3>& positions)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (clusters.size() < 2) return;
+
+	// Centroid and normal of every cluster, weighted by triangle area
+	struct Cluster {
+		uint32_t start;
+		uint32_t end;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float sortKey;
+	};
+	std::vector<Cluster> order(clusters.size());
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusters.size(); c++) {
+		Cluster& cluster = order[c];
+		cluster.start = clusters[c];
+		cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		cluster.centroid = glm::vec3(0.0f);
+		cluster.normal = glm::vec3(0.0f);
+		float clusterArea = 0.0f;
+
+		for (uint32_t triangle = cluster.start; triangle < cluster.end; triangle++) {
+			const glm::vec3& a = positions[indices[triangle * 3]];
+			const glm::vec3& b = positions[indices[triangle * 3 + 1]];
+			const glm::vec3& c = positions[indices[triangle * 3 + 2]];
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float area = glm::length(normal);
+
+			cluster.centroid += (a + b + c) * (area / 3.0f);
+			cluster.normal += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += cluster.centroid;
+		meshArea += clusterArea;
+		if (clusterArea > 0.0f) cluster.centroid /= clusterArea;
+	}
+	if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+	for (Cluster& cluster : order) {
+		float length = glm::length(cluster.normal);
+		cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+	}
+	std::stable_sort(order.begin(), order.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for (const Cluster& cluster : order) {
+		sorted.insert(sorted.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+	}
+	indices.swap(sorted);
+}
+
+std::vector<uint32_t> Engine::OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	const uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(vertexCount, unused);
+	uint32_t next = 0;
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == unused) {
+			remap[index] = next++;
+		}
+		index = remap[index];
+	}
+	for (uint32_t& slot : remap) {
+		if (slot == unused) slot = next++;
+	}
+	return remap;
+}
+
+Engine::MeshOptimization Engine::OptimizeMesh(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions)
+{
+	PROFILE_SCOPE("OptimizeMesh");
+	const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+	MeshOptimization optimization;
+	optimization.before = AnalyzeVertexCache(indices, vertexCount);
+	std::vector<uint32_t> clusters = OptimizeVertexCache(indices, vertexCount);
+	OptimizeOverdraw(indices, clusters, positions);
+	optimization.remap = OptimizeVertexFetch(indices, vertexCount);
+	optimization.after = AnalyzeVertexCache(indices, vertexCount);
+	return optimization;
+}
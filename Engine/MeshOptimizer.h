@@ -0,0 +1,73 @@
+#pragma once
+
+// External Headers
+#include <glm/glm.hpp>
+
+// System Headers
+#include <cstdint>
+#include <vector>
+
+namespace Engine {
+
+	// Entries of the simulated post-transform vertex cache, about what current GPUs reuse within a batch
+	const uint32_t kVertexCacheSize = 16;
+
+	struct VertexCacheStats {
+		// Average cache miss ratio, vertex shader runs per triangle. 3 is the worst, about 0.5 the best a large grid can reach
+		float acmr = 0.0f;
+		// Average transformed vertex ratio, vertex shader runs per vertex referenced. 1 is the best
+		float atvr = 0.0f;
+	};
+
+	/*
+	* Runs a triangle list through a FIFO cache of cacheSize vertices, the way
+	* the GPU's post-transform cache reuses shaded vertices, and counts misses
+	*/
+	VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = kVertexCacheSize);
+
+	/*
+	* Reorders the triangles of a list for the post-transform vertex cache with
+	* Tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and
+	* Reduced Overdraw", 2007). Returns the first triangle of every cluster, a
+	* run of triangles that can move as a whole without hurting the cache much,
+	* for OptimizeOverdraw
+	*/
+	std::vector<uint32_t> OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = kVertexCacheSize);
+
+	/*
+	* Sorts the clusters OptimizeVertexCache found so that those facing away
+	* from the mesh's center come first. Seen from outside, they are the ones
+	* most likely to hide the others, which then fail the depth test before
+	* their fragments are shaded
+	*/
+	void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, const std::vector<glm::vec3>& positions);
+
+	/*
+	* Renumbers the vertices in the order the indices first use them, so vertex
+	* fetch reads the vertex buffer front to back. Unused vertices go last.
+	* Returns the new index of every old vertex, for RemapVertices
+	*/
+	std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+	template <typename T>
+	void RemapVertices(std::vector<T>& vertices, const std::vector<uint32_t>& remap)
+	{
+		std::vector<T> remapped(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			remapped[remap[i]] = vertices[i];
+		}
+		vertices.swap(remapped);
+	}
+
+	/*
+	* All three stages in order, applied to every mesh before its index buffer
+	* is created. Returns the vertex remap, positions are used for overdraw
+	* only and are not reordered
+	*/
+	struct MeshOptimization {
+		std::vector<uint32_t> remap;
+		VertexCacheStats before;
+		VertexCacheStats after;
+	};
+	MeshOptimization OptimizeMesh(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions);
+}
@@ -0,0 +1,109 @@
+// User-defined Headers
+#include "Mipmaps.h"
+
+// System Headers
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENGINE_MIPMAPS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Levels with fewer rows than this are not worth starting threads for
+	const uint32_t kRowsPerThread = 64;
+
+	// Rounded average of the 2x2 (or clamped) source block of every destination pixel in rows [firstRow, lastRow)
+	void DownsampleRows(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight,
+		uint8_t* destination, uint32_t destinationWidth, uint32_t firstRow, uint32_t lastRow)
+	{
+		for (uint32_t y = firstRow; y < lastRow; y++) {
+			const uint8_t* row0 = source + size_t(2 * y) * sourceWidth * 4;
+			const uint8_t* row1 = source + size_t(std::min(2 * y + 1, sourceHeight - 1)) * sourceWidth * 4;
+			uint8_t* out = destination + size_t(y) * destinationWidth * 4;
+
+			uint32_t x = 0;
+#ifdef ENGINE_MIPMAPS_SSE2
+			// Two destination pixels from four source pixels of each row per iteration
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i rounding = _mm_set1_epi16(2);
+			for (; 2 * x + 3 < sourceWidth && x + 1 < destinationWidth; x += 2) {
+				__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+				__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+
+				// Vertical sums of source pixels 0, 1 and 2, 3 as 16-bit channels
+				__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+				__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+
+				// Horizontal sums, pixel 0 + 1 and pixel 2 + 3
+				low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+				high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+				__m128i sum = _mm_unpacklo_epi64(low, high);
+
+				__m128i average = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 4 * x), _mm_packus_epi16(average, zero));
+			}
+#endif
+			for (; x < destinationWidth; x++) {
+				uint32_t x0 = 2 * x;
+				uint32_t x1 = std::min(2 * x + 1, sourceWidth - 1);
+				for (uint32_t c = 0; c < 4; c++) {
+					uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+					out[x * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+uint32_t Engine::MipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+		levels++;
+	}
+	return levels;
+}
+
+std::vector<Engine::MipLevel> Engine::GenerateMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& chain)
+{
+	std::vector<MipLevel> levels;
+	size_t totalBytes = 0;
+	for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u)) {
+		levels.push_back({ w, h, totalBytes });
+		totalBytes += size_t(w) * h * 4;
+		if (w == 1 && h == 1) break;
+	}
+
+	chain.resize(totalBytes);
+	memcpy(chain.data(), rgba, size_t(width) * height * 4);
+
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < levels.size(); i++) {
+		const MipLevel& source = levels[i - 1];
+		const MipLevel& destination = levels[i];
+		const uint8_t* sourcePixels = chain.data() + source.offset;
+		uint8_t* destinationPixels = chain.data() + destination.offset;
+
+		uint32_t chunks = std::min(threadCount, std::max(1u, destination.height / kRowsPerThread));
+		uint32_t rowsPerChunk = (destination.height + chunks - 1) / chunks;
+		for (uint32_t chunk = 1; chunk < chunks; chunk++) {
+			uint32_t firstRow = chunk * rowsPerChunk;
+			uint32_t lastRow = std::min(firstRow + rowsPerChunk, destination.height);
+			threads.emplace_back(DownsampleRows, sourcePixels, source.width, source.height,
+				destinationPixels, destination.width, firstRow, lastRow);
+		}
+		DownsampleRows(sourcePixels, source.width, source.height, destinationPixels, destination.width,
+			0, std::min(rowsPerChunk, destination.height));
+
+		// The next level reads this one
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+	}
+	return levels;
+}
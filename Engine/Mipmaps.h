@@ -0,0 +1,29 @@
+#pragma once
+
+// System Headers
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace Engine {
+
+	// Number of levels of a full mip chain down to 1x1
+	uint32_t MipLevelCount(uint32_t width, uint32_t height);
+
+	struct MipLevel {
+		uint32_t width;
+		uint32_t height;
+		// Byte offset of the level in the chain buffer
+		size_t offset;
+	};
+
+	/*
+	* CPU fallback for devices that cannot blit the texture format with linear
+	* filtering. Writes level 0 (a copy of rgba) and every smaller level into
+	* chain, tightly packed one after the other. Each level is a 2x2 box filter
+	* of the previous one with its size halved and rounded down, like the GPU
+	* blit chain. Rows are split across all hardware threads and filtered with
+	* SSE2 where the compiler targets it
+	*/
+	std::vector<MipLevel> GenerateMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& chain);
+}
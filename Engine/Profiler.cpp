@@ -0,0 +1,188 @@
+// User-defined Headers
+#include "Profiler.h"
+
+// System Headers
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+std::atomic<bool> Engine::Profiler::enabled{ false };
+
+namespace {
+	/*
+	* Fields are atomics so WriteChromeTrace can copy a ring while its thread
+	* writes it. Relaxed loads and stores of them compile to plain moves
+	*/
+	struct Event {
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> start;
+		std::atomic<uint64_t> end;
+	};
+
+	struct ThreadRing {
+		// Allocated by the owning thread with its first event
+		std::atomic<Event*> events{ nullptr };
+		// Events ever written, the ring holds the last kEventsPerThread of them
+		std::atomic<uint64_t> written{ 0 };
+		uint32_t id = 0;
+		// Guarded by registryMutex
+		std::string name;
+
+		~ThreadRing() {
+			delete[] events.load();
+		}
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadRing>> rings;
+	thread_local ThreadRing* threadRing = nullptr;
+
+	ThreadRing* GetThreadRing()
+	{
+		if (threadRing == nullptr) {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			rings.emplace_back(new ThreadRing());
+			threadRing = rings.back().get();
+			threadRing->id = static_cast<uint32_t>(rings.size());
+			threadRing->name = "Thread " + std::to_string(threadRing->id);
+		}
+		return threadRing;
+	}
+
+	void WriteEscaped(std::ostream& out, const std::string& text)
+	{
+		for (char c : text) {
+			if (c == '"' || c == '\\') out << '\\';
+			out << c;
+		}
+	}
+
+	// Chrome traces count in microseconds
+	void WriteMicroseconds(std::ostream& out, uint64_t nanoseconds)
+	{
+		out << nanoseconds / 1000 << "." << std::setw(3) << std::setfill('0') << nanoseconds % 1000 << std::setfill(' ');
+	}
+
+	void WriteEvent(std::ostream& out, bool& first, const char* name, uint64_t startNs, uint64_t durationNs, uint32_t pid, uint32_t tid)
+	{
+		out << (first ? "\n" : ",\n") << "{\"name\":\"";
+		WriteEscaped(out, name);
+		out << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"ts\":";
+		WriteMicroseconds(out, startNs);
+		out << ",\"dur\":";
+		WriteMicroseconds(out, durationNs);
+		out << "}";
+		first = false;
+	}
+
+	void WriteMetadata(std::ostream& out, bool& first, const char* kind, const std::string& name, uint32_t pid, uint32_t tid)
+	{
+		out << (first ? "\n" : ",\n") << "{\"name\":\"" << kind << "\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":\"";
+		WriteEscaped(out, name);
+		out << "\"}}";
+		first = false;
+	}
+}
+
+void Engine::Profiler::SetThreadName(const std::string& name)
+{
+	ThreadRing* ring = GetThreadRing();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	ring->name = name;
+}
+
+void Engine::Profiler::Record(const char* name, uint64_t startNs, uint64_t endNs)
+{
+	ThreadRing* ring = GetThreadRing();
+	Event* events = ring->events.load(std::memory_order_relaxed);
+	if (events == nullptr) {
+		events = new Event[kEventsPerThread];
+		ring->events.store(events, std::memory_order_release);
+	}
+
+	uint64_t index = ring->written.load(std::memory_order_relaxed);
+	/*
+	* Orders the previous update of written before the stores below. A reader
+	* that sees one of them also sees written move past the slot's old event
+	*/
+	std::atomic_thread_fence(std::memory_order_release);
+	Event& event = events[index % kEventsPerThread];
+	event.name.store(name, std::memory_order_relaxed);
+	event.start.store(startNs, std::memory_order_relaxed);
+	event.end.store(endNs, std::memory_order_relaxed);
+	ring->written.store(index + 1, std::memory_order_release);
+}
+
+void Engine::Profiler::WriteChromeTrace(std::ostream& out, const std::vector<TraceEvent>& gpuEvents)
+{
+	struct CopiedEvent {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+	struct CopiedRing {
+		uint32_t id;
+		std::string name;
+		std::vector<CopiedEvent> events;
+	};
+
+	std::vector<CopiedRing> copies;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const std::unique_ptr<ThreadRing>& ring : rings) {
+			CopiedRing copy;
+			copy.id = ring->id;
+			copy.name = ring->name;
+
+			Event* events = ring->events.load(std::memory_order_acquire);
+			uint64_t written = ring->written.load(std::memory_order_acquire);
+			uint64_t first = written > kEventsPerThread ? written - kEventsPerThread : 0;
+			for (uint64_t i = first; events != nullptr && i < written; i++) {
+				const Event& event = events[i % kEventsPerThread];
+				copy.events.push_back({ event.name.load(std::memory_order_relaxed),
+					event.start.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed) });
+			}
+
+			// Slots the writer reached during the copy may hold newer events, they are dropped
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t writtenAfter = ring->written.load(std::memory_order_relaxed);
+			if (writtenAfter >= kEventsPerThread && writtenAfter - kEventsPerThread + 1 > first) {
+				size_t overwritten = static_cast<size_t>(std::min<uint64_t>(writtenAfter - kEventsPerThread + 1 - first, copy.events.size()));
+				copy.events.erase(copy.events.begin(), copy.events.begin() + overwritten);
+			}
+			copies.push_back(std::move(copy));
+		}
+	}
+
+	// Timestamps relative to the earliest event keep the numbers short
+	uint64_t base = ~0ull;
+	for (const CopiedRing& copy : copies) {
+		for (const CopiedEvent& event : copy.events) {
+			base = std::min(base, event.start);
+		}
+	}
+	for (const TraceEvent& event : gpuEvents) {
+		base = std::min(base, event.startNs);
+	}
+
+	const uint32_t cpuProcess = 1;
+	const uint32_t gpuProcess = 2;
+	bool first = true;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	WriteMetadata(out, first, "process_name", "CPU", cpuProcess, 0);
+	for (const CopiedRing& copy : copies) {
+		WriteMetadata(out, first, "thread_name", copy.name, cpuProcess, copy.id);
+		for (const CopiedEvent& event : copy.events) {
+			WriteEvent(out, first, event.name, event.start - base, event.end - event.start, cpuProcess, copy.id);
+		}
+	}
+	if (!gpuEvents.empty()) {
+		WriteMetadata(out, first, "process_name", "GPU", gpuProcess, 0);
+		WriteMetadata(out, first, "thread_name", "Graphics queue", gpuProcess, 0);
+		for (const TraceEvent& event : gpuEvents) {
+			WriteEvent(out, first, event.name, event.startNs - base, event.durationNs, gpuProcess, 0);
+		}
+	}
+	out << "\n]}\n";
+}
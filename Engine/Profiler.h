@@ -0,0 +1,97 @@
+#pragma once
+
+// System Headers
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+* PROFILE_SCOPE instrumentation is compiled in unless ENGINE_PROFILE is
+* defined as 0, in which case the macros expand to nothing
+*/
+#ifndef ENGINE_PROFILE
+#define ENGINE_PROFILE 1
+#endif
+
+namespace Engine {
+
+	/*
+	* CPU profiler recording scopes into per-thread rings.
+	*
+	* Each thread writes its scopes into a ring of its own, kEventsPerThread
+	* long, so recording takes no lock and shares no cache line with other
+	* threads: per scope two steady_clock reads, a release fence, relaxed
+	* stores of the event's name, start and end, and a release store of the
+	* ring's event count. Only the first scope of a thread takes a lock, to
+	* register its ring. When the profiler is disabled a scope costs one
+	* relaxed load.
+	*
+	* WriteChromeTrace copies the rings while they are being written, and drops
+	* the events a writer may have overwritten during the copy. The output
+	* opens in chrome://tracing and ui.perfetto.dev
+	*/
+	class Profiler {
+	public:
+		// An event of another timeline, already on the steady_clock time base
+		struct TraceEvent {
+			const char* name = nullptr;
+			uint64_t startNs = 0;
+			uint64_t durationNs = 0;
+		};
+
+		static const uint32_t kEventsPerThread = 1 << 16;
+
+		static uint64_t Now() {
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		static void SetEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+		static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+		// Names the calling thread in the trace
+		static void SetThreadName(const std::string& name);
+
+		// Adds a finished scope of the calling thread, name must outlive the profiler
+		static void Record(const char* name, uint64_t startNs, uint64_t endNs);
+
+		/*
+		* Writes the recorded scopes of every thread, and gpuEvents on a separate
+		* GPU track, as Chrome trace event JSON
+		*/
+		static void WriteChromeTrace(std::ostream& out, const std::vector<TraceEvent>& gpuEvents);
+
+		// Records its lifetime as a scope of the calling thread
+		class Scope {
+		public:
+			explicit Scope(const char* scopeName) : name(IsEnabled() ? scopeName : nullptr), start(name != nullptr ? Now() : 0) {}
+			~Scope() {
+				if (name != nullptr) Record(name, start, Now());
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			const char* name;
+			uint64_t start;
+		};
+
+	private:
+		static std::atomic<bool> enabled;
+	};
+}
+
+#if ENGINE_PROFILE
+#define ENGINE_PROFILE_CONCAT_INNER(a, b) a##b
+#define ENGINE_PROFILE_CONCAT(a, b) ENGINE_PROFILE_CONCAT_INNER(a, b)
+// Profiles the rest of the enclosing block, name must be a string literal
+#define PROFILE_SCOPE(name) ::Engine::Profiler::Scope ENGINE_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) ::Engine::Profiler::SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
@@ -1,13 +1,26 @@
 // User-defined Headers
 #include "Renderer.h"
 #include "Sphere.h"
+#include "Mipmaps.h"
+#include "TextureCompression.h"
 
 // External Headers
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-std::vector<Engine::Vertex> vertices;
-std::vector<uint16_t> indices;
+// System Headers
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+// Vertices of the UV sphere and the index lists of both globes, and where the globe's mesh lies in them
+Engine::MeshBuffer<Engine::Vertex> meshBuffer;
+Engine::MeshRange globeMesh;
 
 
 // Initialize GLFW Window object
@@ -16,33 +29,110 @@ void Engine::Renderer::InitWindow()
 	// Initializes the GLFW library
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	pWindow = glfwCreateWindow(kWindowWidth, kWindowHeight, "Engine", nullptr, nullptr);
+	pWindow = glfwCreateWindow(settings.width, settings.height, "Engine", nullptr, nullptr);
+	windowExtent = { settings.width, settings.height };
 	glfwSetWindowUserPointer(pWindow, this);
 	glfwSetWindowSizeCallback(pWindow, Renderer::OnWindowResized);
 	glfwSetKeyCallback(pWindow, Renderer::KeyPressCallback);
 }
 
-// Key Press Callback - Save/Handle keyboard input here
+// Key Press Callback - runs on the event thread, the key is handled by the render thread
 void Engine::Renderer::KeyPressCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-	if (key == GLFW_KEY_W && (action == GLFW_PRESS || action == GLFW_REPEAT))
-		std::cout << "You pressed W" << std::endl;
-	else if (key == GLFW_KEY_A && (action == GLFW_PRESS || action == GLFW_REPEAT))
+	Renderer* app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+
+	WindowEvent event;
+	event.type = WindowEvent::Type::Key;
+	event.key = key;
+	event.action = action;
+	event.time = std::chrono::high_resolution_clock::now();
+	app->PushWindowEvent(event);
+}
+
+bool Engine::Renderer::HandleKey(int key, int action)
+{
+	if (action != GLFW_PRESS && action != GLFW_REPEAT) return false;
+
+	// W and S halve and double the altitude of the camera above the globe
+	if (key == GLFW_KEY_W) {
+		cameraDistance = 1.0f + std::max((cameraDistance - 1.0f) * 0.5f, 1e-5f);
+		return true;
+	}
+	else if (key == GLFW_KEY_A)
 		std::cout << "You pressed A" << std::endl;
-	else if (key == GLFW_KEY_S && (action == GLFW_PRESS || action == GLFW_REPEAT))
-		std::cout << "You pressed S" << std::endl;
-	else if (key == GLFW_KEY_D && (action == GLFW_PRESS || action == GLFW_REPEAT))
+	else if (key == GLFW_KEY_S) {
+		cameraDistance = 1.0f + std::min((cameraDistance - 1.0f) * 2.0f, 16.0f);
+		return true;
+	}
+	else if (key == GLFW_KEY_D)
 		std::cout << "You pressed D" << std::endl;
+	// + and - double and halve the slices and stacks of the procedural sphere
+	else if (key == GLFW_KEY_EQUAL && settings.globe == "procedural") {
+		sphereResolution = std::min(sphereResolution * 2, 2048u);
+		return true;
+	}
+	else if (key == GLFW_KEY_MINUS && settings.globe == "procedural") {
+		sphereResolution = std::max(sphereResolution / 2, 3u);
+		return true;
+	}
+	else if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		WriteTrace();
+	return false;
+}
+
+void Engine::Renderer::WriteTrace()
+{
+	if (settings.tracePath.empty()) return;
+
+	std::ofstream file(settings.tracePath, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to write trace " << settings.tracePath << std::endl;
+		return;
+	}
+	Profiler::WriteChromeTrace(file, gpuProfiler.GetTraceEvents());
+	std::cout << "Wrote trace " << settings.tracePath << std::endl;
+}
+
+void Engine::Renderer::PushWindowEvent(const WindowEvent& event)
+{
+	// Losing an event beats blocking the event thread on a render thread that is this far behind
+	if (!windowEvents.Push(event)) {
+		droppedWindowEvents++;
+	}
 }
 
 void Engine::Renderer::InitVulkan()
 {
+	// Scopes are only recorded when a trace will be written
+	Profiler::SetEnabled(!settings.tracePath.empty());
+	PROFILE_THREAD("Main");
+
+	// The render loop's thread is one more worker whenever it waits for jobs
+	uint32_t workerThreads = settings.workerThreads;
+	if (workerThreads == 0) {
+		workerThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+	jobSystem.Init(workerThreads);
+	assetLoader.Init(&jobSystem);
+
+	if (IsBenchmark()) {
+		cameraPath.Load(settings.benchmarkCameraPath);
+	}
+
 	CreateVulkanInstance();
 	SetupDebugCallback();
-	CreateWindowSurface();
+	if (!settings.headless) {
+		CreateWindowSurface();
+	}
 	PickPhysicalDevice();
 	CreateLogicalDevice();
-	CreateSwapChain();
+	CreatePipelineCache();
+	if (settings.headless) {
+		CreateOffscreenTargets();
+	}
+	else {
+		CreateSwapChain();
+	}
 	CreateImageViews();
 	CreateRenderPass();
 
@@ -50,18 +140,54 @@ void Engine::Renderer::InitVulkan()
 	CreateGraphicsPipeline();
 
 	CreateCommandPool();
-
-	// Create Sphere and save vertices and indices
-	CreateSphere(1, 32, 32, &vertices, &indices);
+	uploadContext.Init(logicalDevice, &memoryAllocator, graphicsQueue, queueFamilies.graphicsFamily, kUploadRingSize);
+
+	// Create Sphere and save vertices and indices, optimized for the vertex cache, overdraw and vertex fetch
+	MeshOptimization meshOptimization;
+	if (settings.globe == "uv") {
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		float resolution = static_cast<float>(settings.sphereResolution);
+		CreateSphere(1, resolution, resolution, &vertices, &indices, jobSystem);
+
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			positions[i] = vertices[i].pos;
+		}
+		meshOptimization = OptimizeMesh(indices, positions);
+		RemapVertices(vertices, meshOptimization.remap);
+		globeMesh = meshBuffer.Add(vertices, MeshIndices(indices, static_cast<uint32_t>(vertices.size())));
+	}
+	else if (settings.globe == "cube") {
+		// Patch vertices are generated on demand into the vertex buffer, in the order of the optimized patch mesh
+		globeMesh = meshBuffer.AddIndices(CubeSphere::GetPatchMesh().indices);
+		meshOptimization = CubeSphere::GetPatchMesh().optimization;
+		terrain.Init(settings.terrainDirectory, size_t(settings.terrainCacheMegabytes) * 1024 * 1024, kPatchCapacity, &jobSystem);
+	}
+	// The procedural sphere has no mesh, its vertex shader computes every vertex
+	sphereResolution = settings.sphereResolution;
+	if (settings.globe != "procedural") {
+		std::cout << "Mesh optimization (" << kVertexCacheSize << " entry FIFO cache): ACMR " << meshOptimization.before.acmr << " -> " << meshOptimization.after.acmr
+			<< ", ATVR " << meshOptimization.before.atvr << " -> " << meshOptimization.after.atvr
+			<< " | " << (globeMesh.indexType == VK_INDEX_TYPE_UINT32 ? 32 : 16) << " bit indices" << std::endl;
+	}
 
 	// Depth Buffer
 	CreateDepthResources();
 	// Create framebuffer AFTER Depth Buffer Resource creation
 	CreateFramebuffers();
 
-	CreateTextureImage();
-	CreateTextureImageView();
+	if (UsesVirtualTexture()) {
+		CreateVirtualTexture();
+	}
+	else {
+		CreateTextureImage();
+		CreateTextureImageView();
+	}
 	CreateTextureSampler();
+	if (settings.globe == "cube") {
+		CreateHeightAtlas();
+	}
 
 	CreateVertexBuffer();
 	CreateIndexBuffer();
@@ -70,14 +196,30 @@ void Engine::Renderer::InitVulkan()
 	CreateDescriptorPool();
 	CreateDescriptorSet();
 	
-	CreateCommandBuffers();
-	CreateSemaphores();
+	commandRecorder.Init(logicalDevice, queueFamilies.graphicsFamily, settings.framesInFlight, &jobSystem, settings.recordThreads);
+	// A benchmark keeps the GPU time of every measured frame
+	uint32_t gpuHistory = IsBenchmark() ? std::max(GpuProfiler::kHistorySize, settings.frameCount) : GpuProfiler::kHistorySize;
+	gpuProfiler.Init(physicalDevice, logicalDevice, queueFamilies.graphicsFamily, settings.framesInFlight, pipelineStatisticsQueries, gpuHistory);
+	gpuFrameScope = gpuProfiler.AddScope("frame");
+	gpuUploadScope = gpuProfiler.AddScope("uploads");
+	gpuRenderPassScope = gpuProfiler.AddScope("render pass");
+	CreateSyncObjects();
+	if (settings.headless) {
+		CreateReadbackResources();
+	}
+
+	// Everything recorded above goes to the GPU in a single submission
+	UploadContext::BatchStats uploadStats = uploadContext.Submit();
+	std::cout << "Setup uploads: " << uploadStats.bytes / 1024.0 << " KB in " << uploadStats.copies << " copies and "
+		<< uploadStats.barriers << " barriers, one submission" << std::endl;
+
+	memoryAllocator.PrintStats(std::cout);
 }
 
 void Engine::Renderer::CreateVulkanInstance()
 {
 	// Check if Vulkan Validation Layers are Available (if requested)
-	if (kEnableValidationLayers && !CheckValidationLayerSupport()) {
+	if (settings.enableValidationLayers && !CheckValidationLayerSupport()) {
 		throw std::runtime_error("Validation Layers not available!");
 	}
 
@@ -112,7 +254,7 @@ void Engine::Renderer::CreateVulkanInstance()
 	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	// Add validation layers to createInfo struct (if requested)
-	if (kEnableValidationLayers) {
+	if (settings.enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(kValidationLayers.size());
 		createInfo.ppEnabledLayerNames = kValidationLayers.data();
 	}
@@ -134,54 +276,276 @@ void Engine::Renderer::CreateVulkanInstance()
 
 void Engine::Renderer::MainLoop()
 {
-	// GLFW Event Loop
-	while (!glfwWindowShouldClose(pWindow)) {
-		glfwPollEvents();
+	PROFILE_SCOPE("MainLoop");
+	if (IsBenchmark()) {
+		RunBenchmark();
+		return;
+	}
 
-		UpdateUniformBuffer();
-		DrawFrame();
+	if (settings.headless) {
+		// Written frames must not depend on how quickly the texture loads
+		FinishAssetLoads();
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < settings.frameCount; i++) {
+			DrawFrame();
+		}
+		vkDeviceWaitIdle(logicalDevice);
+
+		// Frames still sitting in readback buffers
+		for (size_t i = 0; i < settings.framesInFlight; i++) {
+			CollectReadback(i);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+		std::cout << "Rendered " << settings.frameCount << " headless frames in " << seconds << " s ("
+			<< settings.frameCount / seconds << " fps)" << std::endl;
+
+		if (frameWriter) {
+			frameWriter->Flush();
+		}
+		return;
+	}
+
+	// From here on the render thread owns Vulkan, this thread only pumps GLFW events
+	std::thread renderThread(&Renderer::RenderLoop, this);
+
+	// GLFW Event Loop, sleeps until there is an event or the render thread wakes it up
+	while (!glfwWindowShouldClose(pWindow) && !renderLoopDone) {
+		glfwWaitEvents();
+	}
+
+	WindowEvent close;
+	close.type = WindowEvent::Type::Close;
+	close.time = std::chrono::high_resolution_clock::now();
+	while (!renderLoopDone && !windowEvents.Push(close)) {
+		std::this_thread::yield();
+	}
+	renderThread.join();
+
+	if (renderLoopError) {
+		std::rethrow_exception(renderLoopError);
+	}
+}
+
+void Engine::Renderer::RenderLoop()
+{
+	PROFILE_THREAD("Render");
+	try {
+		while (ProcessWindowEvents()) {
+			for (size_t i = 0; i < settings.framesInFlight; i++) {
+				CollectInputLatency(i);
+			}
+			DrawFrame();
+		}
+		vkDeviceWaitIdle(logicalDevice);
+	}
+	catch (...) {
+		renderLoopError = std::current_exception();
+	}
+
+	renderLoopDone = true;
+	glfwPostEmptyEvent();
+}
+
+bool Engine::Renderer::ProcessWindowEvents()
+{
+	PROFILE_SCOPE("ProcessWindowEvents");
+	bool resized = false;
+	WindowEvent event;
+	while (windowEvents.Pop(event)) {
+		switch (event.type) {
+		case WindowEvent::Type::Key:
+			if (HandleKey(event.key, event.action) && pendingInputTime == TimePoint()) {
+				pendingInputTime = event.time;
+			}
+			break;
+		case WindowEvent::Type::Resize:
+			// A burst of resizes while the window is dragged recreates the swap chain once, at the last size
+			windowExtent = { static_cast<uint32_t>(event.width), static_cast<uint32_t>(event.height) };
+			resized = true;
+			break;
+		case WindowEvent::Type::Close:
+			return false;
+		}
 	}
 
+	if (resized) {
+		RecreateSwapChain();
+	}
+	return true;
+}
+
+/*
+* The warmup frames settle the globe LOD and the caches at the start of the
+* camera path. The GPU samples are taken from the profiler's history, which
+* InitVulkan sized to hold every measured frame
+*/
+void Engine::Renderer::RunBenchmark()
+{
+	PROFILE_SCOPE("RunBenchmark");
+	FinishAssetLoads();
+
+	for (uint32_t i = 0; i < settings.warmupFrames; i++) {
+		DrawFrame();
+	}
+	vkDeviceWaitIdle(logicalDevice);
+	gpuProfiler.Flush();
+	gpuProfiler.ResetHistory();
+
+	BenchmarkReport report;
+	report.frameMs.reserve(settings.frameCount);
+	report.cpuMs.reserve(settings.frameCount);
+	for (uint32_t i = 0; i < settings.frameCount; i++) {
+		auto frameStart = std::chrono::high_resolution_clock::now();
+		DrawFrame();
+		double frameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+		report.frameMs.push_back(frameMs);
+		report.cpuMs.push_back(frameMs - 1000.0 * frameStats.lastFenceWaitSeconds);
+	}
 	vkDeviceWaitIdle(logicalDevice);
+	gpuProfiler.Flush();
+	for (size_t i = 0; i < settings.framesInFlight; i++) {
+		CollectReadback(i);
+	}
+	if (frameWriter) {
+		frameWriter->Flush();
+	}
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	report.deviceName = deviceProperties.deviceName;
+	report.cameraPath = settings.benchmarkCameraPath;
+	report.width = swapChainExtent.width;
+	report.height = swapChainExtent.height;
+	report.framesInFlight = settings.framesInFlight;
+	report.warmupFrames = settings.warmupFrames;
+	report.timestep = settings.benchmarkTimestep;
+	report.configuration.emplace_back("globe", settings.globe);
+	report.configuration.emplace_back("transform", settings.transform);
+	report.configuration.emplace_back("vertexBytes", std::to_string(settings.globe == "cube" ? sizeof(PatchVertex) : settings.globe == "uv" ? sizeof(Vertex) : 0));
+	if (settings.globe != "cube") {
+		report.configuration.emplace_back("sphereResolution", std::to_string(settings.sphereResolution));
+	}
+
+	for (uint32_t scope = 0; scope < gpuProfiler.GetScopeCount(); scope++) {
+		std::vector<float> samples = gpuProfiler.GetSamples(scope);
+		report.gpuScopesMs.emplace_back(gpuProfiler.GetScopeName(scope), std::vector<double>(samples.begin(), samples.end()));
+	}
+	for (const HeapStats& heap : memoryAllocator.GetHeapStats()) {
+		report.gpuUsedBytes += heap.usedBytes;
+		report.gpuReservedBytes += heap.reservedBytes;
+	}
+	report.peakResidentBytes = GetPeakResidentBytes();
+
+	std::ofstream file(settings.benchmarkOutput);
+	if (!file) {
+		throw std::runtime_error("Failed to write benchmark results to " + settings.benchmarkOutput + "!");
+	}
+	WriteBenchmarkJson(file, report);
+	std::cout << "Benchmark: " << settings.frameCount << " frames along " << settings.benchmarkCameraPath
+		<< ", results written to " << settings.benchmarkOutput << std::endl;
 }
 
 // Cleanup Vulkan variables on exit
 void Engine::Renderer::Cleanup()
 {
+	// A texture still loading is finished rather than abandoned halfway through its upload
+	FinishAssetLoads();
+	assetLoader.Shutdown();
+	terrain.Shutdown();
+	virtualTexture.Shutdown();
+	jobSystem.Shutdown();
+
 	CleanupSwapChain();
+	CleanupPipeline();
+	if (swapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
+	}
 
 	vkDestroySampler(logicalDevice, textureSampler, nullptr);
 
-	vkDestroyImageView(logicalDevice, textureImageView, nullptr);
+	if (settings.globe == "cube") {
+		vkDestroySampler(logicalDevice, heightSampler, nullptr);
+		vkDestroyImageView(logicalDevice, heightAtlasView, nullptr);
+		vkDestroyImage(logicalDevice, heightAtlasImage, nullptr);
+		memoryAllocator.Free(heightAtlasMemory);
+		vkDestroyBuffer(logicalDevice, heightStagingBuffer, nullptr);
+		memoryAllocator.Free(heightStagingMemory);
+	}
+
+	if (UsesVirtualTexture()) {
+		vkDestroyImageView(logicalDevice, tileCacheView, nullptr);
+		vkDestroyImage(logicalDevice, tileCacheImage, nullptr);
+		memoryAllocator.Free(tileCacheMemory);
+		vkDestroyBuffer(logicalDevice, pageTableBuffer, nullptr);
+		memoryAllocator.Free(pageTableMemory);
+		vkDestroyBuffer(logicalDevice, feedbackBuffer, nullptr);
+		memoryAllocator.Free(feedbackMemory);
+		vkDestroyBuffer(logicalDevice, virtualTextureStagingBuffer, nullptr);
+		memoryAllocator.Free(virtualTextureStagingMemory);
+	}
+	else {
+		vkDestroyImageView(logicalDevice, textureImageView, nullptr);
 
-	vkDestroyImage(logicalDevice, textureImage, nullptr);
-	vkFreeMemory(logicalDevice, textureImageMemory, nullptr);
+		vkDestroyImage(logicalDevice, textureImage, nullptr);
+		memoryAllocator.Free(textureImageMemory);
+
+		if (placeholderImage != VK_NULL_HANDLE) {
+			vkDestroyImageView(logicalDevice, placeholderImageView, nullptr);
+			vkDestroyImage(logicalDevice, placeholderImage, nullptr);
+			memoryAllocator.Free(placeholderImageMemory);
+		}
+	}
 
 	vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
 
 	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
 	vkDestroyBuffer(logicalDevice, uniformBuffer, nullptr);
-	vkFreeMemory(logicalDevice, uniformBufferMemory, nullptr);
+	memoryAllocator.Free(uniformBufferMemory);
 
 	vkDestroyBuffer(logicalDevice, indexBuffer, nullptr);
-	vkFreeMemory(logicalDevice, indexBufferMemory, nullptr);
+	memoryAllocator.Free(indexBufferMemory);
 
 	vkDestroyBuffer(logicalDevice, vertexBuffer, nullptr);
-	vkFreeMemory(logicalDevice, vertexBufferMemory, nullptr);
+	memoryAllocator.Free(vertexBufferMemory);
 
-	vkDestroySemaphore(logicalDevice, renderFinishedSemaphore, nullptr);
-	vkDestroySemaphore(logicalDevice, imageAvailableSemaphore, nullptr);
+	for (size_t i = 0; i < settings.framesInFlight; i++) {
+		vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
+		vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], nullptr);
+		vkDestroyFence(logicalDevice, inFlightFences[i], nullptr);
+	}
 
+	uploadContext.Destroy();
+	commandRecorder.Destroy();
+	gpuProfiler.Destroy();
 	vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+	vkDestroyCommandPool(logicalDevice, transferCommandPool, nullptr);
+
+	SavePipelineCache();
+	vkDestroyPipelineCache(logicalDevice, pipelineCache, nullptr);
+
+	if (settings.headless) {
+		for (size_t i = 0; i < readbackBuffers.size(); i++) {
+			vkDestroyBuffer(logicalDevice, readbackBuffers[i], nullptr);
+			memoryAllocator.Free(readbackBufferMemory[i]);
+		}
+		frameWriter.reset();
+	}
 
+	memoryAllocator.Destroy();
 	vkDestroyDevice(logicalDevice, nullptr);
-	DestroyDebugReportCallbackEXT(vkInstance, vkDebugCallback, nullptr);
-	vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+	if (settings.enableValidationLayers) {
+		DestroyDebugReportCallbackEXT(vkInstance, vkDebugCallback, nullptr);
+	}
+	if (surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+	}
 	vkDestroyInstance(vkInstance, nullptr);
 
-	glfwDestroyWindow(pWindow);
-
-	glfwTerminate();
+	if (pWindow != nullptr) {
+		glfwDestroyWindow(pWindow);
+		glfwTerminate();
+	}
 }
 
 bool Engine::Renderer::CheckValidationLayerSupport()
@@ -215,19 +579,22 @@ std::vector<const char*> Engine::Renderer::GetRequiredExtensions()
 {
 	std::vector<const char*> extensions;
 
-	unsigned int glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	// Headless rendering needs no WSI extensions at all
+	if (!settings.headless) {
+		unsigned int glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	for (unsigned int i = 0; i < glfwExtensionCount; i++) {
-		extensions.push_back(glfwExtensions[i]);
+		for (unsigned int i = 0; i < glfwExtensionCount; i++) {
+			extensions.push_back(glfwExtensions[i]);
+		}
 	}
 
 	/*
-	* The extensions specified by GLFW are always required,
+	* The extensions specified by GLFW are always required in windowed mode,
 	* but the debug report extension is conditionally added.
 	*/
-	if (kEnableValidationLayers) {
+	if (settings.enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 	}
 
@@ -244,7 +611,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Engine::Renderer::DebugCallback(VkDebugReportFlag
 void Engine::Renderer::SetupDebugCallback()
 {
 	// Need not bother if validation layers is disabled
-	if (!kEnableValidationLayers) return;
+	if (!settings.enableValidationLayers) return;
 
 	/*
 	* DebugCallback Creation Struct
@@ -334,8 +701,9 @@ bool Engine::Renderer::IsDeviceSuitable(VkPhysicalDevice device)
 	*/
 	QueueFamilyIndices indices = FindQueueFamilies(device);
 	bool extensionsSupported = CheckDeviceExtensionSupport(device);
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	// Without a surface there is no swap chain to check
+	bool swapChainAdequate = settings.headless;
+	if (extensionsSupported && !settings.headless) {
 		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device); 
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -355,23 +723,39 @@ Engine::Renderer::QueueFamilyIndices Engine::Renderer::FindQueueFamilies(VkPhysi
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies) {
 		if (queueFamily.queueCount > 0 &&
-			queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+			queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && indices.graphicsFamily < 0) {
 			indices.graphicsFamily = i;
 		}
 
+		/*
+		* Headless rendering never presents, the graphics family stands in for
+		* the present family so the rest of the setup stays the same
+		*/
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (settings.headless) {
+			presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		}
 
-		if (queueFamily.queueCount > 0 && presentSupport) {
+		if (queueFamily.queueCount > 0 && presentSupport && indices.presentFamily < 0) {
 			indices.presentFamily = i;
 		}
 
-		if (indices.isComplete()) {
-			break;
+		// A family with transfer but no graphics or compute is usually a dedicated DMA engine
+		if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+			!(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			indices.transferFamily = i;
 		}
 
 		i++;
 	}
+
+	// Graphics queues always support transfers as well
+	if (indices.transferFamily < 0) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
 	return indices;
 }
 
@@ -380,7 +764,7 @@ void Engine::Renderer::CreateLogicalDevice()
 	QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.transferFamily };
 
 	float queuePriority = 1.0f;
 	for (int queueFamily : uniqueQueueFamilies) {
@@ -401,6 +785,31 @@ void Engine::Renderer::CreateLogicalDevice()
 	// Enable Anisotropic Filtering on the Texture Sampler
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+	// BC formats for the compressed Earth texture, it falls back to RGBA8 without them
+	textureCompressionBC = supportedFeatures.textureCompressionBC && settings.compressTexture;
+	deviceFeatures.textureCompressionBC = textureCompressionBC ? VK_TRUE : VK_FALSE;
+
+	// The virtual texture feedback is written with atomics from the fragment shader
+	if (UsesVirtualTexture()) {
+		if (!supportedFeatures.fragmentStoresAndAtomics) {
+			throw std::runtime_error("The virtual texture needs fragmentStoresAndAtomics!");
+		}
+		deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+	}
+
+	// The render pass's draws are in secondary command buffers, which have to inherit the statistics query
+	if (settings.pipelineStatistics) {
+		pipelineStatisticsQueries = supportedFeatures.pipelineStatisticsQuery && supportedFeatures.inheritedQueries;
+		if (!pipelineStatisticsQueries) {
+			std::cerr << "Pipeline statistics need pipelineStatisticsQuery and inheritedQueries, they are disabled" << std::endl;
+		}
+		deviceFeatures.pipelineStatisticsQuery = pipelineStatisticsQueries ? VK_TRUE : VK_FALSE;
+		deviceFeatures.inheritedQueries = pipelineStatisticsQueries ? VK_TRUE : VK_FALSE;
+	}
+
 	// Logical Device CreateInfo Struct
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -409,11 +818,12 @@ void Engine::Renderer::CreateLogicalDevice()
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
 	// Device extensions
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(kDeviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = kDeviceExtensions.data();
+	std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	// Point to validation layer names
-	if (kEnableValidationLayers) {
+	if (settings.enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(kValidationLayers.size());
 		createInfo.ppEnabledLayerNames = kValidationLayers.data();
 	}
@@ -432,6 +842,12 @@ void Engine::Renderer::CreateLogicalDevice()
 
 	// Retrieve & Save Presentation Queue Handle
 	vkGetDeviceQueue(logicalDevice, indices.presentFamily, 0, &presentQueue);
+
+	// Retrieve & Save Transfer Queue Handle
+	vkGetDeviceQueue(logicalDevice, indices.transferFamily, 0, &transferQueue);
+	queueFamilies = indices;
+
+	memoryAllocator.Init(physicalDevice, logicalDevice);
 }
 
 void Engine::Renderer::CreateWindowSurface()
@@ -441,6 +857,14 @@ void Engine::Renderer::CreateWindowSurface()
 	}
 }
 
+std::vector<const char*> Engine::Renderer::GetRequiredDeviceExtensions()
+{
+	if (settings.headless) {
+		return {};
+	}
+	return kDeviceExtensions;
+}
+
 bool Engine::Renderer::CheckDeviceExtensionSupport(VkPhysicalDevice device)
 {
 	// Enumerate the extensions and check if all 
@@ -451,7 +875,8 @@ bool Engine::Renderer::CheckDeviceExtensionSupport(VkPhysicalDevice device)
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(kDeviceExtensions.begin(), kDeviceExtensions.end());
+	std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
+	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
 	for (const auto& extension : availableExtensions) {
 		requiredExtensions.erase(extension.extensionName);
@@ -536,10 +961,8 @@ VkExtent2D Engine::Renderer::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR & c
 		return capabilities.currentExtent;
 	}
 	else {
-		int width, height;
-		glfwGetWindowSize(pWindow, &width, &height);
-
-		VkExtent2D actualExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+		// The window belongs to the event thread, so its size comes from the last resize event
+		VkExtent2D actualExtent = windowExtent;
 
 		actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
 		actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
@@ -589,12 +1012,21 @@ void Engine::Renderer::CreateSwapChain()
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	/*
+	* Handing over the previous swap chain lets the driver reuse its resources
+	* and keep presenting already queued images while the new one is created
+	*/
+	VkSwapchainKHR oldSwapChain = swapChain;
+	createInfo.oldSwapchain = oldSwapChain;
 
 	if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create Swap Chain!");
 	}
 
+	if (oldSwapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(logicalDevice, oldSwapChain, nullptr);
+	}
+
 	// Retrieve swap chain images
 	vkGetSwapchainImagesKHR(logicalDevice, swapChain, &imageCount, nullptr);
 	swapChainImages.resize(imageCount);
@@ -605,7 +1037,7 @@ void Engine::Renderer::CreateSwapChain()
 	swapChainExtent = extent;
 }
 
-VkImageView Engine::Renderer::CreateImageViewHelper(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView Engine::Renderer::CreateImageViewHelper(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -614,7 +1046,7 @@ VkImageView Engine::Renderer::CreateImageViewHelper(VkImage image, VkFormat form
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -631,16 +1063,19 @@ void Engine::Renderer::CreateImageViews()
 	swapChainImageViews.resize(swapChainImages.size());
 
 	for (uint32_t i = 0; i < swapChainImages.size(); i++) {
-		swapChainImageViews[i] = CreateImageViewHelper(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		swapChainImageViews[i] = CreateImageViewHelper(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	}
 }
 
 void Engine::Renderer::CreateGraphicsPipeline()
 {
-	auto vertShaderCode = ReadFile("Shaders/vert.spv");
+	// The cube-sphere globe displaces its patches with the terrain heights in globe.vert, the procedural sphere has its own
+	bool cubeGlobe = settings.globe == "cube";
+	bool proceduralGlobe = settings.globe == "procedural";
+	auto vertShaderCode = ReadFile(cubeGlobe ? "Shaders/globe.spv" : proceduralGlobe ? "Shaders/sphere.spv" : "Shaders/vert.spv");
 	VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
 
-	auto fragShaderCode = ReadFile("Shaders/frag.spv");
+	auto fragShaderCode = ReadFile(UsesVirtualTexture() ? "Shaders/virtual.spv" : "Shaders/frag.spv");
 	VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
 
 	// Actually Linking Shaders
@@ -650,6 +1085,16 @@ void Engine::Renderer::CreateGraphicsPipeline()
 	vertShaderStageInfo.module = vertShaderModule;
 	vertShaderStageInfo.pName = "main";
 
+	// Constant 0 of the vertex shaders picks where the MVP comes from, the driver compiles the other path out
+	VkBool32 pushMvp = PushesMvp() ? VK_TRUE : VK_FALSE;
+	VkSpecializationMapEntry pushMvpEntry = { 0, 0, sizeof(VkBool32) };
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = 1;
+	specializationInfo.pMapEntries = &pushMvpEntry;
+	specializationInfo.dataSize = sizeof(pushMvp);
+	specializationInfo.pData = &pushMvp;
+	vertShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
 	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -662,13 +1107,15 @@ void Engine::Renderer::CreateGraphicsPipeline()
 		fragShaderStageInfo 
 	};
 
-	// Vertex Input State - Binding Description coming from Vertex struct
+	// Vertex Input State - Binding and Attribute Descriptions generated from the vertex struct's format
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	auto bindingDescription = Vertex::GetBindingDescription();
-	auto attributeDescriptions = Vertex::GetAttributeDescriptions();
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	const VertexFormat& vertexFormat = cubeGlobe ? PatchVertex::GetFormat() : Vertex::GetFormat();
+	auto bindingDescription = vertexFormat.GetBindingDescription();
+	auto attributeDescriptions = vertexFormat.GetAttributeDescriptions();
+	// The procedural sphere's vertex shader reads no vertex attributes
+	vertexInputInfo.vertexBindingDescriptionCount = proceduralGlobe ? 0 : 1;
+	vertexInputInfo.vertexAttributeDescriptionCount = proceduralGlobe ? 0 : static_cast<uint32_t>(attributeDescriptions.size());
 	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
@@ -683,38 +1130,21 @@ void Engine::Renderer::CreateGraphicsPipeline()
 	* VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST: triangle from every 3 vertices without reuse
 	* VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP: every third vertex is used as first vertex for the next triangle
 	*/
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.topology = proceduralGlobe ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
 	/*
-	* A viewport basically describes the region of the framebuffer that 
-	* the output will be rendered to. This will almost always be 
-	* (0, 0) to (width, height)
-	*/
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	/*
-	* While viewports define the transformation from the image to the framebuffer, 
-	* scissor rectangles define in which regions pixels will actually be stored
-	* Any pixels outside the scissor rectangles will be discarded by the rasterizer
+	* A viewport basically describes the region of the framebuffer that
+	* the output will be rendered to, while scissor rectangles define in which
+	* regions pixels will actually be stored. Both are dynamic state set in
+	* RecordCommandBuffer, so only their count is part of the pipeline
 	*/
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
-
-	// View Port Configuration using the above structs
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 	// Rasterizer
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
@@ -778,7 +1208,7 @@ void Engine::Renderer::CreateGraphicsPipeline()
 
 	VkDynamicState dynamicStates[] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	/*
@@ -798,6 +1228,14 @@ void Engine::Renderer::CreateGraphicsPipeline()
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
 
+	// MVP, height tile and morph range of every draw
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DrawConstants);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
 
 	if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create Pipeline Layout!");
@@ -814,6 +1252,7 @@ void Engine::Renderer::CreateGraphicsPipeline()
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = 0;
@@ -833,15 +1272,113 @@ void Engine::Renderer::CreateGraphicsPipeline()
 	depthStencil.back = {}; // Optional
 	pipelineInfo.pDepthStencilState = &depthStencil;
 
-	if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+	auto createStart = std::chrono::high_resolution_clock::now();
+	if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create Graphics Pipeline!");
 	}
+	auto createEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "Graphics Pipeline created in "
+		<< std::chrono::duration<double, std::milli>(createEnd - createStart).count() << " ms" << std::endl;
 
 	// Cleanup before exiting method
 	vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
 	vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
 }
 
+void Engine::Renderer::CreatePipelineCache()
+{
+	std::vector<char> initialData;
+	std::ifstream file(settings.pipelineCachePath, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		initialData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(initialData.data(), initialData.size());
+
+		if (!IsPipelineCacheCompatible(initialData)) {
+			std::cout << "Ignoring pipeline cache " << settings.pipelineCachePath << " created by a different device or driver" << std::endl;
+			initialData.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = initialData.size();
+	cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+	if (vkCreatePipelineCache(logicalDevice, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create Pipeline Cache!");
+	}
+
+	std::cout << "Pipeline cache: " << initialData.size() << " bytes loaded from " << settings.pipelineCachePath << std::endl;
+}
+
+/*
+* Every pipeline cache starts with the same header:
+* (1) uint32_t header length in bytes
+* (2) uint32_t VkPipelineCacheHeaderVersion
+* (3) uint32_t vendor ID
+* (4) uint32_t device ID
+* (5) uint8_t[VK_UUID_SIZE] pipeline cache UUID
+* Drivers should reject foreign data themselves, but some crash on it instead
+*/
+bool Engine::Renderer::IsPipelineCacheCompatible(const std::vector<char>& data)
+{
+	const size_t kHeaderSize = 16 + VK_UUID_SIZE;
+	if (data.size() < kHeaderSize) return false;
+
+	uint32_t header[4];
+	std::memcpy(header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	return header[0] >= kHeaderSize &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == deviceProperties.vendorID &&
+		header[3] == deviceProperties.deviceID &&
+		std::memcmp(data.data() + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/*
+* The cache is written to a temporary file first and then renamed over the
+* old one, so a crash while saving never leaves a truncated cache behind
+*/
+void Engine::Renderer::SavePipelineCache()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+		return;
+	}
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+		std::cerr << "Failed to read back pipeline cache data" << std::endl;
+		return;
+	}
+
+	std::string tempPath = settings.pipelineCachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open() || !file.write(data.data(), dataSize)) {
+			std::cerr << "Failed to write pipeline cache " << tempPath << std::endl;
+			return;
+		}
+	}
+
+#ifdef _WIN32
+	// std::rename does not replace an existing file on Windows
+	bool renamed = MoveFileExA(tempPath.c_str(), settings.pipelineCachePath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool renamed = std::rename(tempPath.c_str(), settings.pipelineCachePath.c_str()) == 0;
+#endif
+	if (!renamed) {
+		std::cerr << "Failed to replace pipeline cache " << settings.pipelineCachePath << std::endl;
+		std::remove(tempPath.c_str());
+		return;
+	}
+
+	std::cout << "Pipeline cache: " << dataSize << " bytes saved to " << settings.pipelineCachePath << std::endl;
+}
+
 void Engine::Renderer::CreateFramebuffers()
 {
 	swapChainFramebuffers.resize(swapChainImageViews.size());
@@ -873,131 +1410,389 @@ void Engine::Renderer::CreateCommandPool()
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-	poolInfo.flags = 0; // Optional
+	// Frames record into the CommandRecorder's pools, this one only serves one-off submissions
 
 	if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create Command Pool!");
 	}
+
+	// Headless readback and asset uploads record into the transfer family's pool
+	VkCommandPoolCreateInfo transferPoolInfo = {};
+	transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	transferPoolInfo.queueFamilyIndex = queueFamilies.transferFamily;
+
+	if (vkCreateCommandPool(logicalDevice, &transferPoolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create transfer Command Pool!");
+	}
 }
 
-void Engine::Renderer::CreateCommandBuffers()
+// The command buffer comes from CommandRecorder::BeginFrame and is already recording
+void Engine::Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t uniformOffset)
 {
-	commandBuffers.resize(swapChainFramebuffers.size());
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+	PROFILE_SCOPE("RecordCommandBuffer");
+	// The fence of this frame slot has signaled, so its queries of the last frame can be read
+	gpuProfiler.BeginFrame(commandBuffer, static_cast<uint32_t>(currentFrame));
+	gpuProfiler.BeginScope(commandBuffer, gpuFrameScope);
+	gpuProfiler.BeginScope(commandBuffer, gpuUploadScope);
+
+	/*
+	* Copy this frame's changed height tiles into the atlas. The barriers keep the
+	* copies from overwriting tiles earlier frames still read, and the draws of
+	* this frame from reading tiles before the copies are done
+	*/
+	if (settings.globe == "cube" && !heightCopies.empty()) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = heightAtlasImage;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(commandBuffer, heightStagingBuffer, heightAtlasImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(heightCopies.size()), heightCopies.data());
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// Same for the virtual texture tiles and page table entries, which are read by the fragment shader
+	if (UsesVirtualTexture() && !tileCopies.empty()) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = tileCacheImage;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(commandBuffer, virtualTextureStagingBuffer, tileCacheImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(tileCopies.size()), tileCopies.data());
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	if (UsesVirtualTexture() && !pageTableCopies.empty()) {
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = pageTableBuffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		vkCmdCopyBuffer(commandBuffer, virtualTextureStagingBuffer, pageTableBuffer,
+			static_cast<uint32_t>(pageTableCopies.size()), pageTableCopies.data());
 
-	if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate Command Buffers!");
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	gpuProfiler.EndScope(commandBuffer, gpuUploadScope);
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	// Timestamps cannot be written inside a render pass whose contents are secondary command buffers
+	gpuProfiler.BeginScope(commandBuffer, gpuRenderPassScope);
+	gpuProfiler.BeginStatistics(commandBuffer);
+
+	// Begin Render Pass, its only contents are the secondary command buffers
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	VkCommandBufferInheritanceInfo inheritance = {};
+	inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance.renderPass = renderPass;
+	inheritance.subpass = 0;
+	inheritance.framebuffer = swapChainFramebuffers[imageIndex];
+	inheritance.pipelineStatistics = gpuProfiler.GetStatisticsFlags();
+
+	uint32_t patchCount = settings.globe == "cube" ? static_cast<uint32_t>(cubeSphere.GetDrawList().size()) : 1;
+	std::vector<VkCommandBuffer> secondaries = commandRecorder.RecordSecondaries(inheritance, patchCount, kMinPatchesPerCommandBuffer,
+		[this, uniformOffset](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+			RecordDraws(secondary, uniformOffset, first, count);
+		});
+	vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+	// End Render Pass
+	vkCmdEndRenderPass(commandBuffer);
+
+	gpuProfiler.EndStatistics(commandBuffer);
+	gpuProfiler.EndScope(commandBuffer, gpuRenderPassScope);
+
+	// Make the tile requests visible to the host once the frame's fence has signaled
+	if (UsesVirtualTexture()) {
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = feedbackBuffer;
+		barrier.offset = currentFrame * feedbackRegionSize;
+		barrier.size = feedbackRegionSize;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &barrier, 0, nullptr);
 	}
 
-	for (size_t i = 0; i < commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr; // Optional
+	/*
+	* Headless frames are copied out by the transfer queue. If that queue belongs
+	* to another family, this barrier is the release half of the ownership transfer,
+	* and the matching acquire is recorded in the readback command buffer
+	*/
+	if (settings.headless) {
+		const QueueFamilyIndices& queueIndices = queueFamilies;
+		bool transferOwnership = queueIndices.transferFamily != queueIndices.graphicsFamily;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcQueueFamilyIndex = transferOwnership ? queueIndices.graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = transferOwnership ? queueIndices.transferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = swapChainImages[imageIndex];
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = transferOwnership ? 0 : VK_ACCESS_TRANSFER_READ_BIT;
 
-		vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			transferOwnership ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
+	gpuProfiler.EndScope(commandBuffer, gpuFrameScope);
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+	// End Recording in Command Buffer
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record Command Buffer!");
+	}
+}
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+/*
+* Records the draws of patches [firstPatch, firstPatch + patchCount) of the
+* cube-sphere draw list into a secondary command buffer, or the UV sphere.
+* Runs on the recording threads, so it only reads renderer state that stays
+* unchanged while a frame is recorded. Secondary command buffers inherit
+* nothing but the render pass, so each one binds all of its state
+*/
+void Engine::Renderer::RecordDraws(VkCommandBuffer commandBuffer, uint32_t uniformOffset, uint32_t firstPatch, uint32_t patchCount)
+{
+	PROFILE_SCOPE("RecordDraws");
+	// Bind the Graphics Pipeline
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-		// Begin Render Pass
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Viewport and scissor always cover the whole current swap chain extent
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-		// Bind the Graphics Pipeline
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
+	if (settings.globe != "procedural") {
 		// Bind Vertex Buffer
 		VkBuffer vertexBuffers[] = { vertexBuffer };
 		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
 		// Bind Index Buffer
-		vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-
-		// Bind the descriptor set to the descriptors in the shader
-		vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, globeMesh.indexType);
+	}
 
-		/*
-		* The actual vkCmdDraw function is a bit anticlimactic, but it's so simple because of all the 
-		* information we specified in advance. It has the following parameters, aside from the command buffer:
-		* (1) vertexCount: Even though we don't have a vertex buffer, we technically still have 3 vertices to draw.
-		* (2) instanceCount: Used for instanced rendering, use 1 if you're not doing that.
-		* (3) firstVertex: Used as an offset into the vertex buffer, defines the lowest value of gl_VertexIndex.
-		* (4) firstInstance: Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex.
-		*/
-		//vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+	/*
+	* Bind the descriptor set to the descriptors in the shader. The uniform buffer
+	* binding is dynamic, so the offset of this frame's UBO in the ring is passed here,
+	* followed by the offset of this frame's virtual texture feedback region
+	*/
+	uint32_t dynamicOffsets[] = { uniformOffset, static_cast<uint32_t>(currentFrame * feedbackRegionSize) };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet,
+		UsesVirtualTexture() ? 2 : 1, dynamicOffsets);
 
-		// Draw Indexed
-		vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+	/*
+	* The actual vkCmdDraw function is a bit anticlimactic, but it's so simple because of all the 
+	* information we specified in advance. It has the following parameters, aside from the command buffer:
+	* (1) vertexCount: Even though we don't have a vertex buffer, we technically still have 3 vertices to draw.
+	* (2) instanceCount: Used for instanced rendering, use 1 if you're not doing that.
+	* (3) firstVertex: Used as an offset into the vertex buffer, defines the lowest value of gl_VertexIndex.
+	* (4) firstInstance: Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex.
+	*/
+	//vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
 
-		// End Render Pass
-		vkCmdEndRenderPass(commandBuffers[i]);
+	// The MVP is the same for every draw, so it is pushed once and only the patch part changes per draw
+	DrawConstants constants = {};
+	constants.mvp = frameMvp;
+	if (PushesMvp()) {
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants.mvp), &constants.mvp);
+	}
 
-		// End Recording in Command Buffer
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to record Command Buffer!");
+	// Draw Indexed
+	if (settings.globe == "cube") {
+		/*
+		* Every patch uses the same indices, vertexOffset selects its slot in the pool
+		* and the push constants its height tile and morph range
+		*/
+		const std::vector<CubeSphere::PatchDraw>& drawList = cubeSphere.GetDrawList();
+		for (uint32_t i = firstPatch; i < firstPatch + patchCount; i++) {
+			const CubeSphere::PatchDraw& patch = drawList[i];
+			constants.heightTile = glm::ivec2((patch.slot % kHeightAtlasColumns) * Terrain::kTileSize,
+				(patch.slot / kHeightAtlasColumns) * Terrain::kTileSize);
+			constants.morphRange = glm::vec2(patch.morphStart, patch.morphEnd);
+			const PatchBounds& bounds = cubeSphere.GetPatchBounds(patch.slot);
+			constants.positionBounds = bounds.position;
+			constants.texCoordBounds = bounds.texCoord;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, kPatchConstantsOffset,
+				sizeof(DrawConstants) - kPatchConstantsOffset, &constants.heightTile);
+
+			vkCmdDrawIndexed(commandBuffer, globeMesh.indexCount, 1, globeMesh.firstIndex,
+				globeMesh.vertexOffset + static_cast<int32_t>(patch.slot * CubeSphere::kVerticesPerPatch), 0);
 		}
-
 	}
-
+	else if (settings.globe == "procedural") {
+		/*
+		* One instance per stack, each a triangle strip of the stack's two rings
+		* of slices + 1 vertices. The grid is only pushed, so it can change every frame
+		*/
+		SphereConstants sphere = { glm::uvec2(sphereResolution, sphereResolution), 1.0f };
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, kPatchConstantsOffset, sizeof(sphere), &sphere);
+		vkCmdDraw(commandBuffer, 2 * (sphere.grid.x + 1), sphere.grid.y, 0, 0);
+	}
+	else {
+		vkCmdDrawIndexed(commandBuffer, globeMesh.indexCount, 1, globeMesh.firstIndex, globeMesh.vertexOffset, 0);
+	}
 }
+
 /*
 * The DrawFrame function will perform the following operations:
-* (1) Acquire an image from the swap chain
-* (2) Execute the command buffer with that image as attachment in the framebuffer
-* (3) Return the image to the swap chain for presentation
+* (1) Wait until the GPU has finished the frame that last used this frame slot
+* (2) Acquire an image from the swap chain
+* (3) Execute the command buffer with that image as attachment in the framebuffer
+* (4) Return the image to the swap chain for presentation
 */
 void Engine::Renderer::DrawFrame()
 {
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(logicalDevice, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		RecreateSwapChain();
+	PROFILE_SCOPE("DrawFrame");
+	if (settings.headless) {
+		DrawOffscreenFrame();
 		return;
 	}
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		throw std::runtime_error("failed to acquire swap chain image!");
+
+	/*
+	* Wait for the frame that last used this slot. This is the only point where
+	* the CPU blocks on the GPU, and it only blocks when the CPU is more than
+	* settings.framesInFlight frames ahead
+	*/
+	auto waitStart = std::chrono::high_resolution_clock::now();
+	{
+		PROFILE_SCOPE("WaitForFrameFence");
+		vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	CollectInputLatency(currentFrame);
+
+	uint32_t imageIndex;
+	VkResult result = vkAcquireNextImageKHR(logicalDevice, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		RecreateSwapChain();
+		return;
 	}
+	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		throw std::runtime_error("failed to acquire swap chain image!");
+	}
+
+	// A previous frame slot may still be rendering into this swap chain image
+	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		vkWaitForFences(logicalDevice, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+	auto waitEnd = std::chrono::high_resolution_clock::now();
+	ReportFrameStats(std::chrono::duration<double>(waitEnd - waitStart).count());
+
+	// The GPU is done with this frame slot, so its uniform data can be overwritten
+	uniformRing.BeginFrame(static_cast<uint32_t>(currentFrame));
+	uint32_t uniformOffset = UpdateUniformBuffer();
+	frameInputTimes[currentFrame] = pendingInputTime;
+	pendingInputTime = TimePoint();
+	UpdateAssetLoads();
+	UpdateGlobe();
+	UpdateVirtualTexture();
+	VkCommandBuffer commandBuffer = commandRecorder.BeginFrame(static_cast<uint32_t>(currentFrame));
+	RecordCommandBuffer(commandBuffer, imageIndex, uniformOffset);
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffer;
 
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+	// Only reset the fence once we know work will be submitted with it
+	vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
+
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
+	gpuProfiler.MarkSubmitted();
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-
 	presentInfo.waitSemaphoreCount = 1;
 	presentInfo.pWaitSemaphores = signalSemaphores;
 
@@ -1007,7 +1802,10 @@ void Engine::Renderer::DrawFrame()
 
 	presentInfo.pImageIndices = &imageIndex;
 
-	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	{
+		PROFILE_SCOPE("QueuePresent");
+		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		RecreateSwapChain();
@@ -1016,103 +1814,421 @@ void Engine::Renderer::DrawFrame()
 		throw std::runtime_error("failed to present swap chain image!");
 	}
 
-	vkQueueWaitIdle(presentQueue);
+	currentFrame = (currentFrame + 1) % settings.framesInFlight;
 }
 
-void Engine::Renderer::CreateSemaphores()
+void Engine::Renderer::CreateSyncObjects()
 {
+	imageAvailableSemaphores.resize(settings.framesInFlight);
+	renderFinishedSemaphores.resize(settings.framesInFlight);
+	inFlightFences.resize(settings.framesInFlight);
+	frameInputTimes.assign(settings.framesInFlight, TimePoint());
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS) {
 
-		throw std::runtime_error("Failed to create Semaphores!");
+	// Fences start signaled so that the first wait on each frame slot returns immediately
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (size_t i = 0; i < settings.framesInFlight; i++) {
+		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+			vkCreateFence(logicalDevice, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+
+			throw std::runtime_error("Failed to create synchronization objects for a frame!");
+		}
+	}
+
+	frameStats.lastReport = frameStats.lastFrame = std::chrono::high_resolution_clock::now();
+}
+
+/*
+* The CPU time spent blocked on fences is time where CPU and GPU did not overlap.
+* Everything else in the frame is CPU work that ran concurrently with the GPU
+* executing earlier frames
+*/
+void Engine::Renderer::ReportFrameStats(double fenceWaitSeconds)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	frameStats.frameSeconds += std::chrono::duration<double>(now - frameStats.lastFrame).count();
+	frameStats.fenceWaitSeconds += fenceWaitSeconds;
+	frameStats.lastFenceWaitSeconds = fenceWaitSeconds;
+	frameStats.frameCount++;
+	frameStats.lastFrame = now;
+
+	if (std::chrono::duration<double>(now - frameStats.lastReport).count() < 2.0) return;
+
+	double frameMs = 1000.0 * frameStats.frameSeconds / frameStats.frameCount;
+	double waitMs = 1000.0 * frameStats.fenceWaitSeconds / frameStats.frameCount;
+	double overlap = frameStats.frameSeconds > 0.0 ? 100.0 * (1.0 - frameStats.fenceWaitSeconds / frameStats.frameSeconds) : 0.0;
+
+	std::cout << "Frames in flight: " << settings.framesInFlight
+		<< " | frame " << frameMs << " ms"
+		<< " | CPU blocked on GPU " << waitMs << " ms"
+		<< " | CPU/GPU overlap " << overlap << "%" << std::endl;
+
+	if (settings.globe == "cube") {
+		const CubeSphere::Stats& globe = cubeSphere.GetStats();
+		std::cout << "Globe: " << globe.drawnPatches << " patches ("
+			<< globe.drawnPatches * (globeMesh.indexCount / 3) << " triangles)"
+			<< " | deepest level " << globe.deepestLevel
+			<< " | " << globe.culledPatches << " culled"
+			<< " | " << globe.residentPatches << "/" << kPatchCapacity << " resident" << std::endl;
+
+		if (!settings.terrainDirectory.empty()) {
+			Terrain::Stats terrainStats = terrain.GetStats();
+			std::cout << "Terrain: " << terrainStats.cachedTiles << " tiles cached ("
+				<< terrainStats.cachedBytes / (1024 * 1024) << " MB)"
+				<< " | " << terrainStats.pendingPatches << " patches pending"
+				<< " | " << pendingHeightSlots.size() << " uploads queued" << std::endl;
+		}
+	}
+	else if (settings.globe == "procedural") {
+		std::cout << "Globe: procedural " << sphereResolution << " x " << sphereResolution << " sphere ("
+			<< 2 * sphereResolution * sphereResolution << " triangles, "
+			<< 2 * (sphereResolution + 1) * sphereResolution << " vertex shader invocations)" << std::endl;
 	}
+
+	if (UsesVirtualTexture()) {
+		VirtualTexture::Stats textureStats = virtualTexture.GetStats();
+		uint32_t cacheTiles = virtualTexture.GetCacheTilesPerSide() * virtualTexture.GetCacheTilesPerSide();
+		std::cout << "Virtual texture: " << textureStats.residentTiles << "/" << cacheTiles << " tiles resident"
+			<< " | " << textureStats.requestedTiles << " missing"
+			<< " | " << textureStats.pendingLoads << " loading" << std::endl;
+	}
+
+	std::vector<GpuProfiler::ScopeSummary> gpuScopes = gpuProfiler.GetSummaries();
+	if (!gpuScopes.empty()) {
+		std::cout << "GPU (min/avg/p99 ms over " << gpuScopes[0].samples << " frames):";
+		for (const GpuProfiler::ScopeSummary& scope : gpuScopes) {
+			std::cout << " | " << scope.name << " " << scope.minMs << "/" << scope.averageMs << "/" << scope.p99Ms;
+		}
+		std::cout << std::endl;
+	}
+	if (gpuProfiler.HasPipelineStatistics()) {
+		GpuProfiler::PipelineStatistics statistics = gpuProfiler.GetAverageStatistics();
+		std::cout << "Render pass per frame: " << statistics.inputPrimitives << " primitives"
+			<< " | " << statistics.clippingPrimitives << " after clipping"
+			<< " | " << statistics.vertexInvocations << " vertex invocations"
+			<< " | " << statistics.fragmentInvocations << " fragment invocations" << std::endl;
+	}
+
+	if (frameStats.inputCount > 0 || droppedWindowEvents > 0) {
+		double averageMs = frameStats.inputCount > 0 ? 1000.0 * frameStats.inputLatencySeconds / frameStats.inputCount : 0.0;
+		std::cout << "Input to GPU done: " << averageMs << " ms average"
+			<< " | " << 1000.0 * frameStats.maxInputLatencySeconds << " ms max"
+			<< " | " << frameStats.inputCount << " inputs"
+			<< " | " << droppedWindowEvents.exchange(0) << " events dropped" << std::endl;
+	}
+
+	frameStats.frameSeconds = 0.0;
+	frameStats.fenceWaitSeconds = 0.0;
+	frameStats.frameCount = 0;
+	frameStats.inputLatencySeconds = 0.0;
+	frameStats.maxInputLatencySeconds = 0.0;
+	frameStats.inputCount = 0;
+	frameStats.lastReport = now;
+}
+
+void Engine::Renderer::CollectInputLatency(size_t frameSlot)
+{
+	TimePoint inputTime = frameInputTimes[frameSlot];
+	if (inputTime == TimePoint() || vkGetFenceStatus(logicalDevice, inFlightFences[frameSlot]) != VK_SUCCESS) return;
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - inputTime).count();
+	frameStats.inputLatencySeconds += seconds;
+	frameStats.maxInputLatencySeconds = std::max(frameStats.maxInputLatencySeconds, seconds);
+	frameStats.inputCount++;
+	frameInputTimes[frameSlot] = TimePoint();
 }
 
 void Engine::Renderer::RecreateSwapChain()
 {
+	PROFILE_SCOPE("RecreateSwapChain");
+	auto recreateStart = std::chrono::high_resolution_clock::now();
+
 	vkDeviceWaitIdle(logicalDevice);
 	CleanupSwapChain();
 
 	CreateSwapChain();
 	CreateImageViews();
-	CreateRenderPass();
-	CreateGraphicsPipeline();
+
+	// Window size changes keep the formats, so the pipeline normally survives
+	if (swapChainImageFormat != renderPassColorFormat || FindDepthFormat() != renderPassDepthFormat) {
+		CleanupPipeline();
+		CreateRenderPass();
+		CreateGraphicsPipeline();
+	}
+
 	CreateDepthResources();
 	CreateFramebuffers();
-	CreateCommandBuffers();
+
+	// The new swap chain may have a different number of images
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+
+	// Depth image layout transition
+	uploadContext.Submit();
+
+	auto recreateEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "Swap Chain recreated (" << swapChainExtent.width << "x" << swapChainExtent.height << ") in "
+		<< std::chrono::duration<double, std::milli>(recreateEnd - recreateStart).count() << " ms" << std::endl;
 }
 
+/*
+* Destroys everything sized like the swap chain images. The swap chain itself
+* is kept alive so it can be passed as oldSwapchain to its successor
+*/
 void Engine::Renderer::CleanupSwapChain()
 {
 	vkDestroyImageView(logicalDevice, depthImageView, nullptr);
 	vkDestroyImage(logicalDevice, depthImage, nullptr);
-	vkFreeMemory(logicalDevice, depthImageMemory, nullptr);
+	memoryAllocator.Free(depthImageMemory);
 
 	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 		vkDestroyFramebuffer(logicalDevice, swapChainFramebuffers[i], nullptr);
 	}
 
-	vkFreeCommandBuffers(logicalDevice, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+		vkDestroyImageView(logicalDevice, swapChainImageViews[i], nullptr);
+	}
+
+	if (settings.headless) {
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			vkDestroyImage(logicalDevice, swapChainImages[i], nullptr);
+			memoryAllocator.Free(offscreenImageMemory[i]);
+		}
+	}
+}
 
+void Engine::Renderer::CleanupPipeline()
+{
 	vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
 	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
 	vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+}
 
-	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-		vkDestroyImageView(logicalDevice, swapChainImageViews[i], nullptr);
-	}
+void Engine::Renderer::CreateOffscreenTargets()
+{
+	swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	swapChainExtent = { settings.width, settings.height };
 
-	vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
+	// One target per frame slot, so the frame index doubles as the image index
+	swapChainImages.resize(settings.framesInFlight);
+	offscreenImageMemory.resize(settings.framesInFlight);
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		CreateImage(settings.width, settings.height, 1, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImageMemory[i]);
+	}
 }
 
-void Engine::Renderer::OnWindowResized(GLFWwindow* window, int width, int height)
+void Engine::Renderer::CreateReadbackResources()
 {
-	if (width == 0 || height == 0) return;
+	const QueueFamilyIndices& queueIndices = queueFamilies;
+	bool transferOwnership = queueIndices.transferFamily != queueIndices.graphicsFamily;
 
-	Renderer* app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
-	app->RecreateSwapChain();
+	readbackCommandBuffers.resize(settings.framesInFlight);
+	readbackBuffers.resize(settings.framesInFlight);
+	readbackBufferMemory.resize(settings.framesInFlight);
+	readbackFrameNumbers.assign(settings.framesInFlight, 0);
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = transferCommandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = (uint32_t)readbackCommandBuffers.size();
+
+	if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, readbackCommandBuffers.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate readback Command Buffers!");
+	}
+
+	VkDeviceSize frameBytes = static_cast<VkDeviceSize>(settings.width) * settings.height * 4;
+
+	/*
+	* The copy of each frame slot never changes, so the readback command
+	* buffers are recorded once and resubmitted every frame
+	*/
+	for (size_t i = 0; i < readbackCommandBuffers.size(); i++) {
+		CreateBuffer(frameBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			readbackBuffers[i], readbackBufferMemory[i]);
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		vkBeginCommandBuffer(readbackCommandBuffers[i], &beginInfo);
+
+		// Acquire half of the ownership transfer released at the end of the render pass
+		if (transferOwnership) {
+			VkImageMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcQueueFamilyIndex = queueIndices.graphicsFamily;
+			barrier.dstQueueFamilyIndex = queueIndices.transferFamily;
+			barrier.image = swapChainImages[i];
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.layerCount = 1;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+			vkCmdPipelineBarrier(readbackCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { settings.width, settings.height, 1 };
+
+		vkCmdCopyImageToBuffer(readbackCommandBuffers[i], swapChainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			readbackBuffers[i], 1, &region);
+
+		// Make the copy visible to the host once the fence signals
+		VkBufferMemoryBarrier hostBarrier = {};
+		hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		hostBarrier.buffer = readbackBuffers[i];
+		hostBarrier.offset = 0;
+		hostBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(readbackCommandBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+		if (vkEndCommandBuffer(readbackCommandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record readback Command Buffer!");
+		}
+	}
+
+	FrameWriter::Format format = FrameWriter::Format::None;
+	if (!settings.outputDirectory.empty()) {
+		format = settings.outputFormat == "raw" ? FrameWriter::Format::Raw : FrameWriter::Format::PNG;
+	}
+	frameWriter.reset(new FrameWriter(settings.outputDirectory, format));
 }
 
-void Engine::Renderer::CreateVertexBuffer()
+/*
+* Headless counterpart of DrawFrame. The graphics submission renders into the
+* offscreen target of the frame slot and signals a semaphore, the transfer
+* submission waits on it, copies the image into the readback buffer and
+* signals the frame slot's fence
+*/
+void Engine::Renderer::DrawOffscreenFrame()
 {
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	PROFILE_SCOPE("DrawOffscreenFrame");
+	auto waitStart = std::chrono::high_resolution_clock::now();
+	{
+		PROFILE_SCOPE("WaitForFrameFence");
+		vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	auto waitEnd = std::chrono::high_resolution_clock::now();
+	ReportFrameStats(std::chrono::duration<double>(waitEnd - waitStart).count());
+
+	// The readback buffer of this slot now holds the frame rendered framesInFlight frames ago
+	CollectReadback(currentFrame);
+
+	uniformRing.BeginFrame(static_cast<uint32_t>(currentFrame));
+	uint32_t uniformOffset = UpdateUniformBuffer();
+	UpdateAssetLoads();
+	UpdateGlobe();
+	UpdateVirtualTexture();
+	VkCommandBuffer commandBuffer = commandRecorder.BeginFrame(static_cast<uint32_t>(currentFrame));
+	RecordCommandBuffer(commandBuffer, static_cast<uint32_t>(currentFrame), uniformOffset);
 
-	// Create a host-visible staging buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
 
-	// Create the device-local vertex buffer and copy over from staging buffer
-	void* data;
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
+	gpuProfiler.MarkSubmitted();
 
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkSubmitInfo readbackInfo = {};
+	readbackInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	readbackInfo.waitSemaphoreCount = 1;
+	readbackInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+	readbackInfo.pWaitDstStageMask = &waitStage;
+	readbackInfo.commandBufferCount = 1;
+	readbackInfo.pCommandBuffers = &readbackCommandBuffers[currentFrame];
+
+	vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
 
-	CopyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+	if (vkQueueSubmit(transferQueue, 1, &readbackInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit readback command buffer!");
+	}
+	readbackFrameNumbers[currentFrame] = ++frameNumber;
 
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+	currentFrame = (currentFrame + 1) % settings.framesInFlight;
 }
 
-uint32_t Engine::Renderer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+// Must only be called once the fence of the frame slot has signaled
+void Engine::Renderer::CollectReadback(size_t frameSlot)
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+	uint64_t readbackFrame = readbackFrameNumbers[frameSlot];
+	if (readbackFrame == 0) return;
+	readbackFrameNumbers[frameSlot] = 0;
+	if (settings.outputDirectory.empty()) return;
+
+	const uint8_t* pixels = static_cast<const uint8_t*>(readbackBufferMemory[frameSlot].mapped);
+	size_t frameBytes = static_cast<size_t>(settings.width) * settings.height * 4;
+	frameWriter->Push(readbackFrame, settings.width, settings.height,
+		std::vector<uint8_t>(pixels, pixels + frameBytes));
+}
 
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
+void Engine::Renderer::OnWindowResized(GLFWwindow* window, int width, int height)
+{
+	// A minimized window keeps its swap chain until it is restored
+	if (width == 0 || height == 0) return;
+
+	Renderer* app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+
+	WindowEvent event;
+	event.type = WindowEvent::Type::Resize;
+	event.width = width;
+	event.height = height;
+	event.time = std::chrono::high_resolution_clock::now();
+	app->PushWindowEvent(event);
+}
+
+void Engine::Renderer::CreateVertexBuffer()
+{
+	if (settings.globe == "cube") {
+		VkDeviceSize poolSize = sizeof(PatchVertex) * CubeSphere::kVerticesPerPatch * kPatchCapacity;
+		CreateBuffer(poolSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			vertexBuffer, vertexBufferMemory);
+		cubeSphere.Init(1.0f, static_cast<PatchVertex*>(vertexBufferMemory.mapped), kPatchCapacity, settings.framesInFlight, &jobSystem);
+		return;
 	}
+	// The procedural sphere's vertex shader computes its vertices, there is nothing to upload
+	if (settings.globe == "procedural") return;
 
-	throw std::runtime_error("Failed to find suitable Memory type!");
+	const std::vector<Vertex>& vertices = meshBuffer.GetVertices();
+	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+
+	// Create the device-local vertex buffer, the vertices reach it through the upload batch's staging ring
+	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+
+	uploadContext.CopyToBuffer(vertexBuffer, 0, vertices.data(), bufferSize);
 }
 
-void Engine::Renderer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory)
+void Engine::Renderer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, Allocation & bufferMemory)
 {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1127,48 +2243,21 @@ void Engine::Renderer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(logicalDevice, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory!");
-	}
-
-	vkBindBufferMemory(logicalDevice, buffer, bufferMemory, 0);
-}
-
-void Engine::Renderer::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
-{
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-	VkBufferCopy copyRegion = {};
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-	EndSingleTimeCommands(commandBuffer);
+	bufferMemory = memoryAllocator.Allocate(memRequirements, properties, false);
+	vkBindBufferMemory(logicalDevice, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
 void Engine::Renderer::CreateIndexBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	if (settings.globe == "procedural") return;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+	// 16 and 32 bit index lists of all meshes, each mesh binds the buffer with its own index type
+	const std::vector<uint8_t>& indexData = meshBuffer.GetIndexData();
+	VkDeviceSize bufferSize = indexData.size();
 
 	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
 
-	CopyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+	uploadContext.CopyToBuffer(indexBuffer, 0, indexData.data(), bufferSize);
 }
 
 void Engine::Renderer::CreateDescriptorSetLayout()
@@ -1176,7 +2265,7 @@ void Engine::Renderer::CreateDescriptorSetLayout()
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
 	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -1187,7 +2276,37 @@ void Engine::Renderer::CreateDescriptorSetLayout()
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+	// Terrain heights displacing the cube-sphere globe
+	VkDescriptorSetLayoutBinding heightLayoutBinding = {};
+	heightLayoutBinding.binding = 2;
+	heightLayoutBinding.descriptorCount = 1;
+	heightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	heightLayoutBinding.pImmutableSamplers = nullptr;
+	heightLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// Page table and feedback of the virtual texture, the feedback region changes every frame
+	VkDescriptorSetLayoutBinding pageTableLayoutBinding = {};
+	pageTableLayoutBinding.binding = 3;
+	pageTableLayoutBinding.descriptorCount = 1;
+	pageTableLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pageTableLayoutBinding.pImmutableSamplers = nullptr;
+	pageTableLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutBinding feedbackLayoutBinding = {};
+	feedbackLayoutBinding.binding = 4;
+	feedbackLayoutBinding.descriptorCount = 1;
+	feedbackLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	feedbackLayoutBinding.pImmutableSamplers = nullptr;
+	feedbackLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding, samplerLayoutBinding };
+	if (settings.globe == "cube") {
+		bindings.push_back(heightLayoutBinding);
+	}
+	if (UsesVirtualTexture()) {
+		bindings.push_back(pageTableLayoutBinding);
+		bindings.push_back(feedbackLayoutBinding);
+	}
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -1200,44 +2319,204 @@ void Engine::Renderer::CreateDescriptorSetLayout()
 
 void Engine::Renderer::CreateUniformBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	VkDeviceSize alignment = std::max<VkDeviceSize>(deviceProperties.limits.minUniformBufferOffsetAlignment, 1);
+
+	// Room for kUniformRingBytesPerFrame of uniform data in every frame in flight
+	VkDeviceSize perFrame = (kUniformRingBytesPerFrame + alignment - 1) / alignment * alignment;
+	VkDeviceSize bufferSize = perFrame * settings.framesInFlight;
 	CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
+
+	// Host visible allocations stay mapped, the memory is host coherent so no flushes are needed
+	uniformRing.Init(uniformBufferMemory.mapped, bufferSize, alignment, settings.framesInFlight);
 }
 
-void Engine::Renderer::UpdateUniformBuffer()
+uint32_t Engine::Renderer::UpdateUniformBuffer()
 {
+	PROFILE_SCOPE("UpdateUniformBuffer");
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count() / 1000.0f;
+	float time;
+	CameraKey camera;
+	if (IsBenchmark()) {
+		// Warmup frames hold the start of the path
+		uint64_t measuredFrame = benchmarkFrame > settings.warmupFrames ? benchmarkFrame - settings.warmupFrames : 0;
+		time = static_cast<float>(measuredFrame * static_cast<double>(settings.benchmarkTimestep));
+		camera = cameraPath.Sample(time);
+		benchmarkFrame++;
+	}
+	else {
+		auto currentTime = std::chrono::high_resolution_clock::now();
+		time = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count() / 1000.0f;
+		camera.distance = cameraDistance;
+	}
+	float distance = camera.distance;
+
+	UniformBufferObject ubo = {};
+	// Update MVP to rotate that rendered model, benchmark cameras are placed over the globe so it holds still for them
+	ubo.model = IsBenchmark() ? glm::mat4(1.0f) : glm::rotate(time * glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 eye = camera.Position();
+	// Straight above a pole the view direction is parallel to the up vector
+	glm::vec3 up = std::abs(camera.latitude) > 89.0f ? glm::vec3(0.0f, 0.0f, -1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	ubo.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), up);
 
-	static UniformBufferObject ubo = {};
-	// Update MVP to rotate that rendered model
-	ubo.model = glm::rotate(time * glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	ubo.view = glm::lookAt(glm::vec3(2.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+	// The near plane follows the altitude so the surface is never clipped up close
+	float altitude = distance - 1.0f;
+	float nearPlane = glm::clamp(altitude * 0.5f, 1e-6f, 0.1f);
+	ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, nearPlane, distance + 1.0f);
 
 	ubo.proj[1][1] *= -1;
 
+	// The globe has radius 1, so one model unit is one earth radius
+	ubo.cameraPosition = glm::inverse(ubo.view * ubo.model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	ubo.terrainParams = glm::vec4(settings.terrainScale / kEarthRadiusMeters, 0.0f, 0.0f, 0.0f);
+	frameTransforms = ubo;
+	frameMvp = ubo.proj * ubo.view * ubo.model;
+
 	void* data;
-	vkMapMemory(logicalDevice, uniformBufferMemory, 0, sizeof(ubo), 0, &data);
+	VkDeviceSize offset = uniformRing.Allocate(sizeof(ubo), &data);
 	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(logicalDevice, uniformBufferMemory);
+	return static_cast<uint32_t>(offset);
+}
+
+void Engine::Renderer::UpdateGlobe()
+{
+	PROFILE_SCOPE("UpdateGlobe");
+	if (settings.globe != "cube") return;
+
+	// LOD selection runs in the model space of the globe
+	glm::mat4 modelView = frameTransforms.view * frameTransforms.model;
+	glm::vec3 cameraPosition = glm::vec3(frameTransforms.cameraPosition);
+	float pixelsPerRadian = swapChainExtent.height / (2.0f * std::tan(glm::radians(45.0f) * 0.5f));
+
+	cubeSphere.SetMaxElevation(Terrain::kMaxElevation * frameTransforms.terrainParams.x);
+	cubeSphere.Select(cameraPosition, frameTransforms.proj * modelView, pixelsPerRadian, settings.lodErrorPixels);
+	UpdateHeights();
+}
+
+void Engine::Renderer::CreateHeightAtlas()
+{
+	uint32_t atlasRows = (kPatchCapacity + kHeightAtlasColumns - 1) / kHeightAtlasColumns;
+	uint32_t atlasWidth = kHeightAtlasColumns * Terrain::kTileSize;
+	uint32_t atlasHeight = atlasRows * Terrain::kTileSize;
+	VkDeviceSize tileBytes = Terrain::kTileSize * Terrain::kTileSize * sizeof(float);
+
+	CreateImage(atlasWidth, atlasHeight, 1, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, heightAtlasImage, heightAtlasMemory);
+	heightAtlasView = CreateImageViewHelper(heightAtlasImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	// Every frame in flight stages its uploads in its own region of the buffer
+	CreateBuffer(tileBytes * kHeightUploadsPerFrame * settings.framesInFlight, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, heightStagingBuffer, heightStagingMemory);
+
+	// Start out at sea level, cleared on the GPU rather than uploaded
+	TransitionImageLayout(heightAtlasImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+	VkClearColorValue seaLevel = {};
+	VkImageSubresourceRange atlasRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdClearColorImage(uploadContext.Record(), heightAtlasImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &seaLevel, 1, &atlasRange);
+	TransitionImageLayout(heightAtlasImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+
+	// The shader fetches exact texels, 32-bit float formats are not guaranteed to be filterable
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+
+	if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &heightSampler) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create Height Sampler!");
+	}
+
+	heightSlotQueued.assign(kPatchCapacity, false);
+}
+
+/*
+* Patches generated this frame start out with the heights of their parent and
+* are uploaded right away, since they may be drawn this very frame. Exact tiles
+* finished by the terrain workers queue up behind them, whatever does not fit
+* in the per frame budget waits for the next frame
+*/
+void Engine::Renderer::UpdateHeights()
+{
+	heightCopies.clear();
+	std::vector<uint32_t> uploadSlots;
+
+	cubeSphere.TakeGeneratedPatches(generatedPatches);
+	for (const CubeSphere::GeneratedPatch& patch : generatedPatches) {
+		int32_t parentSlot = -1;
+		if (patch.key.level > 0) {
+			PatchKey parent = { patch.key.face, patch.key.level - 1, patch.key.x / 2, patch.key.y / 2 };
+			parentSlot = cubeSphere.FindSlot(parent);
+		}
+		terrain.OnPatchGenerated(patch.key, patch.slot, parentSlot);
+		uploadSlots.push_back(patch.slot);
+	}
+
+	finishedHeightSlots.clear();
+	terrain.CollectFinished([this](const PatchKey& key, uint32_t slot) {
+		return cubeSphere.FindSlot(key) == static_cast<int32_t>(slot);
+	}, finishedHeightSlots);
+	for (uint32_t slot : finishedHeightSlots) {
+		if (heightSlotQueued[slot]) continue;
+		heightSlotQueued[slot] = true;
+		pendingHeightSlots.push_back(slot);
+	}
+	while (uploadSlots.size() < kHeightUploadsPerFrame && !pendingHeightSlots.empty()) {
+		uint32_t slot = pendingHeightSlots.front();
+		pendingHeightSlots.pop_front();
+		heightSlotQueued[slot] = false;
+		uploadSlots.push_back(slot);
+	}
+	uploadSlots.resize(std::min<size_t>(uploadSlots.size(), kHeightUploadsPerFrame));
+
+	const size_t tileBytes = Terrain::kTileSize * Terrain::kTileSize * sizeof(float);
+	VkDeviceSize frameOffset = VkDeviceSize(currentFrame) * kHeightUploadsPerFrame * tileBytes;
+	uint8_t* staging = static_cast<uint8_t*>(heightStagingMemory.mapped) + frameOffset;
+
+	for (size_t i = 0; i < uploadSlots.size(); i++) {
+		uint32_t slot = uploadSlots[i];
+		memcpy(staging + i * tileBytes, terrain.GetHeights(slot), tileBytes);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = frameOffset + i * tileBytes;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { static_cast<int32_t>((slot % kHeightAtlasColumns) * Terrain::kTileSize),
+			static_cast<int32_t>((slot / kHeightAtlasColumns) * Terrain::kTileSize), 0 };
+		region.imageExtent = { Terrain::kTileSize, Terrain::kTileSize, 1 };
+		heightCopies.push_back(region);
+	}
 }
 
 void Engine::Renderer::CreateDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = 1;
+	// Room for a second set, allocated when the streamed texture replaces its placeholder
+	const uint32_t setCount = 2;
+
+	std::vector<VkDescriptorPoolSize> poolSizes(2);
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = setCount;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = 1;
+	poolSizes[1].descriptorCount = (settings.globe == "cube" ? 2 : 1) * setCount;
+	if (UsesVirtualTexture()) {
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setCount });
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, setCount });
+	}
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = 1;
+	poolInfo.maxSets = setCount;
 
 	if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create Descriptor Pool!");
@@ -1267,7 +2546,7 @@ void Engine::Renderer::CreateDescriptorSet()
 	descriptorWrite.dstSet = descriptorSet;
 	descriptorWrite.dstBinding = 0;
 	descriptorWrite.dstArrayElement = 0;
-	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrite.descriptorCount = 1;
 	descriptorWrite.pBufferInfo = &bufferInfo;
 	descriptorWrite.pImageInfo = nullptr; // Optional
@@ -1275,16 +2554,31 @@ void Engine::Renderer::CreateDescriptorSet()
 
 	VkDescriptorImageInfo imageInfo = {};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo.imageView = textureImageView;
+	imageInfo.imageView = UsesVirtualTexture() ? tileCacheView : textureImageView;
 	imageInfo.sampler = textureSampler;
 
-	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+	VkDescriptorImageInfo heightInfo = {};
+	heightInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	heightInfo.imageView = heightAtlasView;
+	heightInfo.sampler = heightSampler;
+
+	VkDescriptorBufferInfo pageTableInfo = {};
+	pageTableInfo.buffer = pageTableBuffer;
+	pageTableInfo.offset = 0;
+	pageTableInfo.range = VK_WHOLE_SIZE;
+
+	VkDescriptorBufferInfo feedbackInfo = {};
+	feedbackInfo.buffer = feedbackBuffer;
+	feedbackInfo.offset = 0;
+	feedbackInfo.range = feedbackRegionSize;
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites(2, VkWriteDescriptorSet{});
 
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[0].dstSet = descriptorSet;
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -1296,10 +2590,36 @@ void Engine::Renderer::CreateDescriptorSet()
 	descriptorWrites[1].descriptorCount = 1;
 	descriptorWrites[1].pImageInfo = &imageInfo;
 
+	VkWriteDescriptorSet optionalWrite = {};
+	optionalWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	optionalWrite.dstSet = descriptorSet;
+	optionalWrite.dstArrayElement = 0;
+	optionalWrite.descriptorCount = 1;
+
+	if (settings.globe == "cube") {
+		optionalWrite.dstBinding = 2;
+		optionalWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		optionalWrite.pImageInfo = &heightInfo;
+		descriptorWrites.push_back(optionalWrite);
+	}
+
+	if (UsesVirtualTexture()) {
+		optionalWrite.pImageInfo = nullptr;
+		optionalWrite.dstBinding = 3;
+		optionalWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		optionalWrite.pBufferInfo = &pageTableInfo;
+		descriptorWrites.push_back(optionalWrite);
+
+		optionalWrite.dstBinding = 4;
+		optionalWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		optionalWrite.pBufferInfo = &feedbackInfo;
+		descriptorWrites.push_back(optionalWrite);
+	}
+
 	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void Engine::Renderer::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory)
+void Engine::Renderer::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, Allocation & imageMemory)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1307,7 +2627,7 @@ void Engine::Renderer::CreateImage(uint32_t width, uint32_t height, VkFormat for
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -1323,89 +2643,424 @@ void Engine::Renderer::CreateImage(uint32_t width, uint32_t height, VkFormat for
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(logicalDevice, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate Image Memory!");
-	}
-
-	vkBindImageMemory(logicalDevice, image, imageMemory, 0);
+	// Images larger than half an allocator block get their own dedicated allocation
+	imageMemory = memoryAllocator.Allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_OPTIMAL);
+	vkBindImageMemory(logicalDevice, image, imageMemory.memory, imageMemory.offset);
 }
 
+/*
+* The Earth texture is decoded on a loader thread and uploaded through the
+* transfer queue while the first frames are already on screen. Until then the
+* globe samples a single texel placeholder, created here synchronously
+*/
 void Engine::Renderer::CreateTextureImage()
 {
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load("Textures/Earth.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-
-	if (!pixels) {
-		throw std::runtime_error("failed to load texture image!");
-	}
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	// Deep ocean blue, the color most of the globe ends up with anyway
+	const uint8_t placeholder[4] = { 16, 40, 80, 255 };
+
+	CreateImage(1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+	TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+	uploadContext.CopyToImage(textureImage, 1, 1, placeholder, sizeof(placeholder));
+	TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+
+	// Format decisions need the physical device, so they are made here rather than on the loader thread
+	auto decoded = std::make_shared<DecodedTexture>();
+	if (textureCompressionBC) {
+		VkFormat format = FindSupportedFormat({ VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_R8G8B8A8_UNORM }, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+		decoded->compressed = format == VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+	if (!decoded->compressed) {
+		// Blitting needs linear filtering support for the format, otherwise the chain is built on the CPU
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+		VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		decoded->blitMipmaps = !settings.cpuMipmaps && (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+	}
+
+	textureLoadStart = std::chrono::high_resolution_clock::now();
+	assetLoader.Load("Textures/Earth.png", [decoded] { DecodeTexture(*decoded); }, [this, decoded] { UploadTexture(*decoded); });
+}
 
-	void* data;
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+// Runs on a loader thread, must not touch any Vulkan object
+void Engine::Renderer::DecodeTexture(DecodedTexture& decoded)
+{
+	const std::string sourcePath = "Textures/Earth.png";
+	const std::string cachePath = "Textures/Earth.ktx2";
+
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+	KtxTexture& texture = decoded.texture;
+	if (decoded.compressed) {
+		// A corrupt or truncated cache, or one made from an older source, is compressed again like a missing one, and overwritten
+		bool cached = false;
+		std::string cacheError;
+		try {
+			cached = ReadKTX2(cachePath, texture) && texture.format == VK_FORMAT_BC7_UNORM_BLOCK;
+		}
+		catch (const std::runtime_error& e) {
+			cacheError = std::string(" (") + e.what() + ")";
+		}
+		// Without the source image the cache is all there is
+		std::string sourceStamp = GetSourceStamp(sourcePath);
+		if (cached && !sourceStamp.empty() && texture.source != sourceStamp) {
+			cached = false;
+			cacheError = " (" + sourcePath + " changed since " + cachePath + " was written)";
+		}
 
-	stbi_image_free(pixels);
+		if (cached) {
+			decoded.description = "BC7 read from " + cachePath;
+		}
+		else {
+			texture = CompressImageFile(BlockFormat::BC7, sourcePath);
+			decoded.description = "BC7 compressed from " + sourcePath + cacheError;
 
-	CreateImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+			// A read-only Textures directory only costs the compression on every launch
+			try {
+				WriteKTX2(cachePath, texture);
+			}
+			catch (const std::runtime_error& e) {
+				decoded.description += std::string(" (") + e.what() + ")";
+			}
+		}
+		decoded.mipLevels = static_cast<uint32_t>(texture.levels.size());
+	}
+	else {
+		int texWidth, texHeight, texChannels;
+		stbi_uc* pixels = stbi_load(sourcePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		if (!pixels) {
+			throw std::runtime_error("failed to load texture image!");
+		}
 
-	TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+		texture.format = VK_FORMAT_R8G8B8A8_UNORM;
+		texture.width = static_cast<uint32_t>(texWidth);
+		texture.height = static_cast<uint32_t>(texHeight);
 
-	TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		// A full chain down to 1x1 keeps the texture cache happy and avoids aliasing when zoomed out
+		decoded.mipLevels = MipLevelCount(texture.width, texture.height);
 
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+		// Only level 0 when the GPU builds the rest
+		if (decoded.blitMipmaps) {
+			texture.data.assign(pixels, pixels + size_t(texWidth) * texHeight * 4);
+			texture.levels.push_back({ texture.width, texture.height, 0, texture.data.size() });
+			decoded.description = "RGBA8, mip levels blitted on the GPU";
+		}
+		else {
+			for (const MipLevel& level : GenerateMipChain(pixels, texture.width, texture.height, texture.data)) {
+				texture.levels.push_back({ level.width, level.height, level.offset, size_t(level.width) * level.height * 4 });
+			}
+			decoded.description = "RGBA8, mip levels filtered on the CPU";
+		}
+		stbi_image_free(pixels);
+	}
+	decoded.decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStart).count();
 }
 
-VkCommandBuffer Engine::Renderer::BeginSingleTimeCommands()
+/*
+* Copies every level the decoded texture holds on the transfer queue, then
+* releases the image to the graphics queue. The graphics queue acquires it,
+* blits the missing mip levels if there are any and moves it to the layout
+* the fragment shader reads. Without a dedicated transfer family both command
+* buffers go to the graphics queue in one submission and no ownership changes
+*/
+void Engine::Renderer::UploadTexture(const DecodedTexture& decoded)
 {
+	const KtxTexture& texture = decoded.texture;
+	const QueueFamilyIndices& queueIndices = queueFamilies;
+	bool transferOwnership = queueIndices.transferFamily != queueIndices.graphicsFamily;
+
+	PendingUpload upload = {};
+	CreateBuffer(texture.data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		upload.stagingBuffer, upload.stagingMemory);
+	memcpy(upload.stagingMemory.mapped, texture.data.data(), texture.data.size());
+
+	VkImage image;
+	Allocation imageMemory;
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (decoded.blitMipmaps) {
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	CreateImage(texture.width, texture.height, decoded.mipLevels, texture.format, VK_IMAGE_TILING_OPTIMAL, usage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
 	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer);
+	allocInfo.commandPool = transferCommandPool;
+	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &upload.transferCommands);
+	allocInfo.commandPool = commandPool;
+	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &upload.graphicsCommands);
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = decoded.mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkBeginCommandBuffer(upload.transferCommands, &beginInfo);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(upload.transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	std::vector<VkBufferImageCopy> regions;
+	for (uint32_t level = 0; level < texture.levels.size(); level++) {
+		VkBufferImageCopy region = {};
+		region.bufferOffset = texture.levels[level].offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { texture.levels[level].width, texture.levels[level].height, 1 };
+		regions.push_back(region);
+	}
+	vkCmdCopyBufferToImage(upload.transferCommands, upload.stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()), regions.data());
+
+	// Release half of the ownership transfer, the layout stays the same
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	if (transferOwnership) {
+		barrier.srcQueueFamilyIndex = queueIndices.transferFamily;
+		barrier.dstQueueFamilyIndex = queueIndices.graphicsFamily;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(upload.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	if (vkEndCommandBuffer(upload.transferCommands) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record texture upload Command Buffer!");
+	}
+
+	vkBeginCommandBuffer(upload.graphicsCommands, &beginInfo);
+
+	// Acquire half, matching the release above
+	if (transferOwnership) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(upload.graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	if (decoded.blitMipmaps) {
+		RecordMipmapBlits(upload.graphicsCommands, image, static_cast<int32_t>(texture.width), static_cast<int32_t>(texture.height), decoded.mipLevels);
+	}
+	else {
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(upload.graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	if (vkEndCommandBuffer(upload.graphicsCommands) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record texture upload Command Buffer!");
+	}
 
-	return commandBuffer;
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (vkCreateFence(logicalDevice, &fenceInfo, nullptr, &upload.fence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create upload Fence!");
+	}
+
+	if (transferOwnership) {
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &upload.ownershipSemaphore) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload Semaphore!");
+		}
+
+		VkSubmitInfo transferSubmit = {};
+		transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		transferSubmit.commandBufferCount = 1;
+		transferSubmit.pCommandBuffers = &upload.transferCommands;
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &upload.ownershipSemaphore;
+		if (vkQueueSubmit(transferQueue, 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit texture upload!");
+		}
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		VkSubmitInfo graphicsSubmit = {};
+		graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		graphicsSubmit.waitSemaphoreCount = 1;
+		graphicsSubmit.pWaitSemaphores = &upload.ownershipSemaphore;
+		graphicsSubmit.pWaitDstStageMask = &waitStage;
+		graphicsSubmit.commandBufferCount = 1;
+		graphicsSubmit.pCommandBuffers = &upload.graphicsCommands;
+		if (vkQueueSubmit(graphicsQueue, 1, &graphicsSubmit, upload.fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit texture upload!");
+		}
+	}
+	else {
+		VkCommandBuffer commands[] = { upload.transferCommands, upload.graphicsCommands };
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 2;
+		submitInfo.pCommandBuffers = commands;
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, upload.fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit texture upload!");
+		}
+	}
+
+	uint32_t mipLevels = decoded.mipLevels;
+	VkFormat format = texture.format;
+	std::ostringstream message;
+	message << "Texture: " << texture.width << "x" << texture.height << " " << decoded.description << ", " << mipLevels << " mip levels, "
+		<< texture.data.size() / (1024.0 * 1024.0) << " MB uploaded, decoded in " << decoded.decodeMilliseconds << " ms";
+	std::string summary = message.str();
+
+	upload.onComplete = [this, image, imageMemory, format, mipLevels, summary] {
+		// Frames still in flight sample the placeholder, it lives until Cleanup
+		placeholderImage = textureImage;
+		placeholderImageView = textureImageView;
+		placeholderImageMemory = textureImageMemory;
+
+		textureImage = image;
+		textureImageMemory = imageMemory;
+		textureFormat = format;
+		textureMipLevels = mipLevels;
+		CreateTextureImageView();
+
+		// The command buffers are recorded every frame, so they bind the new set from the next frame on
+		CreateDescriptorSet();
+
+		std::cout << summary << ", ready "
+			<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - textureLoadStart).count()
+			<< " ms after loading started" << std::endl;
+	};
+	pendingUploads.push_back(std::move(upload));
 }
 
-void Engine::Renderer::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+// Finishes decoded assets and retires the uploads whose fence has signaled
+void Engine::Renderer::UpdateAssetLoads()
 {
-	vkEndCommandBuffer(commandBuffer);
+	PROFILE_SCOPE("UpdateAssetLoads");
+	uploadContext.Collect();
+	assetLoader.Poll();
+
+	for (size_t i = 0; i < pendingUploads.size();) {
+		if (vkGetFenceStatus(logicalDevice, pendingUploads[i].fence) != VK_SUCCESS) {
+			i++;
+			continue;
+		}
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+		PendingUpload upload = std::move(pendingUploads[i]);
+		pendingUploads.erase(pendingUploads.begin() + i);
 
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue);
+		vkFreeCommandBuffers(logicalDevice, transferCommandPool, 1, &upload.transferCommands);
+		vkFreeCommandBuffers(logicalDevice, commandPool, 1, &upload.graphicsCommands);
+		if (upload.ownershipSemaphore != VK_NULL_HANDLE) {
+			vkDestroySemaphore(logicalDevice, upload.ownershipSemaphore, nullptr);
+		}
+		vkDestroyFence(logicalDevice, upload.fence, nullptr);
+		vkDestroyBuffer(logicalDevice, upload.stagingBuffer, nullptr);
+		memoryAllocator.Free(upload.stagingMemory);
+
+		upload.onComplete();
+	}
+}
 
-	vkFreeCommandBuffers(logicalDevice, commandPool, 1, &commandBuffer);
+// Blocks until every asset load has been decoded, uploaded and completed
+void Engine::Renderer::FinishAssetLoads()
+{
+	assetLoader.WaitIdle();
+	assetLoader.Poll();
+	for (const auto& upload : pendingUploads) {
+		vkWaitForFences(logicalDevice, 1, &upload.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	UpdateAssetLoads();
 }
 
-void Engine::Renderer::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+/*
+* Records the blits that build every mip level from the previous one at half
+* size with linear filtering. Expects all levels in TRANSFER_DST_OPTIMAL with
+* level 0 filled and leaves them all in SHADER_READ_ONLY_OPTIMAL
+*/
+void Engine::Renderer::RecordMipmapBlits(VkCommandBuffer commandBuffer, VkImage image, int32_t width, int32_t height, uint32_t mipLevels)
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
 
+	int32_t mipWidth = width;
+	int32_t mipHeight = height;
+	for (uint32_t level = 1; level < mipLevels; level++) {
+		// The previous level becomes the blit source
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		int32_t nextWidth = std::max(mipWidth / 2, 1);
+		int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		// Done with the previous level, the fragment shader may sample it from now on
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
+
+	// The last level was only ever written
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void Engine::Renderer::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
+{
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
@@ -1415,7 +3070,7 @@ void Engine::Renderer::TransitionImageLayout(VkImage image, VkFormat format, VkI
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
@@ -1430,74 +3085,48 @@ void Engine::Renderer::TransitionImageLayout(VkImage image, VkFormat format, VkI
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
 
+	/*
+	* Now that transitions share a command buffer with the copies around them,
+	* the stages have to cover those copies rather than just the top of the pipe
+	*/
+	VkPipelineStageFlags sourceStage;
+	VkPipelineStageFlags destinationStage;
+
 	if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+		barrier.srcAccessMask = 0;
 		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+		barrier.srcAccessMask = 0;
 		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		// The height atlas is sampled by the vertex shader, textures by the fragment shader
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
 		barrier.srcAccessMask = 0;
 		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	}
 	else {
 		throw std::invalid_argument("Unsupported Layout Transition!");
 	}
 
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	EndSingleTimeCommands(commandBuffer);
-}
-
-void Engine::Renderer::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-{
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
-
-	vkCmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
-
-	EndSingleTimeCommands(commandBuffer);
+	uploadContext.ImageBarrier(sourceStage, destinationStage, barrier);
 }
 
 void Engine::Renderer::CreateTextureImageView()
 {
-	textureImageView = CreateImageViewHelper(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	textureImageView = CreateImageViewHelper(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, textureMipLevels);
 }
 
 void Engine::Renderer::CreateTextureSampler()
@@ -1518,19 +3147,124 @@ void Engine::Renderer::CreateTextureSampler()
 	samplerInfo.compareEnable = VK_FALSE;
 	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 
+	// Trilinear filtering over the whole mip chain
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	// The streamed texture replaces its single level placeholder later on
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
 	if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create Texture Sampler!");
 	}
 }
 
+void Engine::Renderer::CreateVirtualTexture()
+{
+	virtualTexture.Init(settings.virtualTextureDirectory, settings.virtualTextureCacheTiles, &jobSystem);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	// The tile cache has a fixed size, however large the imagery on disk is
+	uint32_t physicalTileSize = virtualTexture.GetPhysicalTileSize();
+	uint32_t cacheSize = physicalTileSize * virtualTexture.GetCacheTilesPerSide();
+	if (cacheSize > deviceProperties.limits.maxImageDimension2D) {
+		throw std::runtime_error("Virtual texture cache exceeds the maximum image size, lower --vt-cache!");
+	}
+
+	CreateImage(cacheSize, cacheSize, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tileCacheImage, tileCacheMemory);
+	// Slots are only sampled once a tile was copied into them, the initial contents do not matter
+	TransitionImageLayout(tileCacheImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+	TransitionImageLayout(tileCacheImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+	tileCacheView = CreateImageViewHelper(tileCacheImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	// The page table starts out with its header and no resident tiles
+	const std::vector<uint32_t>& pageTable = virtualTexture.GetPageTable();
+	VkDeviceSize pageTableBytes = pageTable.size() * sizeof(uint32_t);
+	CreateBuffer(pageTableBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		pageTableBuffer, pageTableMemory);
+
+	uploadContext.CopyToBuffer(pageTableBuffer, 0, pageTable.data(), pageTableBytes);
+
+	// One region of request bits per frame in flight, read back once the frame's fence has signaled
+	VkDeviceSize alignment = std::max<VkDeviceSize>(deviceProperties.limits.minStorageBufferOffsetAlignment, 1);
+	VkDeviceSize feedbackBytes = (virtualTexture.GetTileCount() + 31) / 32 * sizeof(uint32_t);
+	feedbackRegionSize = (feedbackBytes + alignment - 1) / alignment * alignment;
+	CreateBuffer(feedbackRegionSize * settings.framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, feedbackBuffer, feedbackMemory);
+	memset(feedbackMemory.mapped, 0, static_cast<size_t>(feedbackRegionSize * settings.framesInFlight));
+
+	// Worst case of one frame: kTileUploadsPerFrame tiles and the whole page table
+	VkDeviceSize tileBytes = VkDeviceSize(physicalTileSize) * physicalTileSize * 4;
+	virtualTextureStagingRegionSize = tileBytes * kTileUploadsPerFrame + pageTableBytes;
+	CreateBuffer(virtualTextureStagingRegionSize * settings.framesInFlight, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, virtualTextureStagingBuffer, virtualTextureStagingMemory);
+}
+
+/*
+* Turns the tile requests of the frame that last used this frame slot into
+* loads, and stages the tiles that finished loading plus the page table
+* entries that changed for the copies recorded before this frame's render pass
+*/
+void Engine::Renderer::UpdateVirtualTexture()
+{
+	PROFILE_SCOPE("UpdateVirtualTexture");
+	if (!UsesVirtualTexture()) return;
+
+	uint32_t* feedback = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(feedbackMemory.mapped) + currentFrame * feedbackRegionSize);
+	virtualTexture.ProcessFeedback(feedback);
+	memset(feedback, 0, static_cast<size_t>(feedbackRegionSize));
+
+	tileUploads.clear();
+	pageTableDirtyRanges.clear();
+	tileCopies.clear();
+	pageTableCopies.clear();
+	virtualTexture.Update(kTileUploadsPerFrame, tileUploads, pageTableDirtyRanges);
+
+	VkDeviceSize frameOffset = currentFrame * virtualTextureStagingRegionSize;
+	uint8_t* staging = static_cast<uint8_t*>(virtualTextureStagingMemory.mapped) + frameOffset;
+	uint32_t physicalTileSize = virtualTexture.GetPhysicalTileSize();
+	uint32_t cacheSide = virtualTexture.GetCacheTilesPerSide();
+	size_t tileBytes = size_t(physicalTileSize) * physicalTileSize * 4;
+
+	for (size_t i = 0; i < tileUploads.size(); i++) {
+		memcpy(staging + i * tileBytes, tileUploads[i].rgba.data(), tileBytes);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = frameOffset + i * tileBytes;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { static_cast<int32_t>((tileUploads[i].slot % cacheSide) * physicalTileSize),
+			static_cast<int32_t>((tileUploads[i].slot / cacheSide) * physicalTileSize), 0 };
+		region.imageExtent = { physicalTileSize, physicalTileSize, 1 };
+		tileCopies.push_back(region);
+	}
+
+	const std::vector<uint32_t>& pageTable = virtualTexture.GetPageTable();
+	size_t stagingOffset = kTileUploadsPerFrame * tileBytes;
+	for (const auto& range : pageTableDirtyRanges) {
+		size_t bytes = (range.second - range.first) * sizeof(uint32_t);
+		memcpy(staging + stagingOffset, &pageTable[range.first], bytes);
+
+		VkBufferCopy region = {};
+		region.srcOffset = frameOffset + stagingOffset;
+		region.dstOffset = range.first * sizeof(uint32_t);
+		region.size = bytes;
+		pageTableCopies.push_back(region);
+		stagingOffset += bytes;
+	}
+}
+
 void Engine::Renderer::CreateDepthResources()
 {
 	VkFormat depthFormat = FindDepthFormat();
 
-	CreateImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
-	depthImageView = CreateImageViewHelper(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	CreateImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+	depthImageView = CreateImageViewHelper(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
-	TransitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	TransitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
 }
 
 VkFormat Engine::Renderer::FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
@@ -1603,7 +3337,8 @@ void Engine::Renderer::CreateRenderPass()
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Offscreen targets stay attachments, the copy for readback transitions them afterwards
+	colorAttachment.finalLayout = settings.headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
@@ -1611,6 +3346,8 @@ void Engine::Renderer::CreateRenderPass()
 
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = FindDepthFormat();
+	renderPassColorFormat = colorAttachment.format;
+	renderPassDepthFormat = depthAttachment.format;
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -2,6 +2,22 @@
 
 // User-defined Headers
 #include "Vertex.h"
+#include "Settings.h"
+#include "JobSystem.h"
+#include "UniformRing.h"
+#include "MemoryAllocator.h"
+#include "ImageWriter.h"
+#include "CubeSphere.h"
+#include "Terrain.h"
+#include "VirtualTexture.h"
+#include "TextureCompression.h"
+#include "AssetLoader.h"
+#include "UploadContext.h"
+#include "CommandRecorder.h"
+#include "EventQueue.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "Benchmark.h"
 
 // External Headers
 #define GLFW_INCLUDE_VULKAN
@@ -17,22 +33,35 @@
 #include <glm/gtx/string_cast.hpp>
 
 // System Headers
+#include <array>
+#include <cstddef>
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <set>
 #include <algorithm>
 #include <chrono>
 #include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <exception>
 
 namespace Engine {
 
 	class Renderer {
 	public:
+		explicit Renderer(const Settings& settings) : settings(settings) {}
+
 		void Run() {
-			InitWindow();
+			// Headless runs never touch GLFW
+			if (!settings.headless) {
+				InitWindow();
+			}
 			InitVulkan();
 			MainLoop();
+			WriteTrace();
 			Cleanup();
 		}
 	private:
@@ -48,20 +77,47 @@ namespace Engine {
 		void Cleanup();
 
 	private:
-		/* GLFW Window Object */
-		GLFWwindow* pWindow;
+		/* Runtime configuration passed in from the command line */
+		Settings settings;
+
+		/*
+		* CPU work of the other members is split into jobs on this scheduler, so
+		* it is declared before them and outlives them
+		*/
+		JobSystem jobSystem;
 
-		/* Window Sizing Constants */
-		const int kWindowWidth = 800;
-		const int kWindowHeight = 600;
+		/* GLFW Window Object, sized by settings.width x settings.height */
+		GLFWwindow* pWindow = nullptr;
 
 		static void KeyPressCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
+		/*
+		* Event and render threads. The thread that created the window only
+		* pumps GLFW (MainLoop), so a window manager holding it, e.g. while the
+		* window is dragged or resized, does not stall rendering. The callbacks
+		* push input and resize events into windowEvents and the render thread
+		* (RenderLoop) applies them at the start of its next frame. Everything
+		* except the queue and the flags below belongs to the render thread
+		*/
+		SpscQueue<WindowEvent, 1024> windowEvents;
+		// Events lost to a full queue, reported with the frame statistics
+		std::atomic<uint32_t> droppedWindowEvents{ 0 };
+		// Set when the render thread leaves RenderLoop, renderLoopError holds its exception if any
+		std::atomic<bool> renderLoopDone{ false };
+		std::exception_ptr renderLoopError;
+		void PushWindowEvent(const WindowEvent& event);
+		void RenderLoop();
+		// Applies the queued events, returns false once the window is closing
+		bool ProcessWindowEvents();
+		// Returns true if the key changed what is drawn
+		bool HandleKey(int key, int action);
+		// Last known size of the window, the swap chain extent if the surface leaves it to us
+		VkExtent2D windowExtent = {};
+
 		/* Vulkan Instance */
 		VkInstance vkInstance;
 
-		/* Vulkan Validation Layers */
-		const bool kEnableValidationLayers = true;
+		/* Vulkan Validation Layers, enabled by settings.enableValidationLayers */
 		const std::vector<const char*> kValidationLayers = {
 			"VK_LAYER_LUNARG_standard_validation"
 		};
@@ -82,7 +138,7 @@ namespace Engine {
 		* The VKAPI_ATTR and VKAPI_CALL ensure that the function 
 		* has the right signature for Vulkan to call it.
 		*/
-		VkDebugReportCallbackEXT vkDebugCallback;
+		VkDebugReportCallbackEXT vkDebugCallback = VK_NULL_HANDLE;
 		static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
 			VkDebugReportFlagsEXT flags,
 			VkDebugReportObjectTypeEXT objType,
@@ -128,6 +184,8 @@ namespace Engine {
 		struct QueueFamilyIndices {
 			int graphicsFamily = -1;
 			int presentFamily = -1;
+			// Prefers a transfer-only (DMA) family, falls back to the graphics family
+			int transferFamily = -1;
 
 			bool isComplete() {
 				return graphicsFamily >= 0 && presentFamily >= 0;
@@ -154,6 +212,11 @@ namespace Engine {
 		* Device queues are implicitly cleaned up when the device is destroyed
 		*/
 		VkQueue graphicsQueue;
+
+		// Queue used for copies that can run alongside graphics work
+		VkQueue transferQueue;
+		// Families of the queues above, looked up once in CreateLogicalDevice
+		QueueFamilyIndices queueFamilies;
 		
 		/*
 		* Since Vulkan is a platform agnostic API, it can not interface 
@@ -162,7 +225,7 @@ namespace Engine {
 		* results to the screen, we need to use the WSI 
 		* (Window System Integration) extensions
 		*/
-		VkSurfaceKHR surface;
+		VkSurfaceKHR surface = VK_NULL_HANDLE;
 		void CreateWindowSurface();
 
 		/*
@@ -178,6 +241,9 @@ namespace Engine {
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
 		};
 
+		// kDeviceExtensions, or no extensions at all when rendering headless
+		std::vector<const char*> GetRequiredDeviceExtensions();
+
 		// Called from IsDeviceSuitable as an additional check
 		bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
 
@@ -222,7 +288,7 @@ namespace Engine {
 		* The main create swap chain method that uses the above ChooseSwapXYZ
 		* methods to choose the right parameters for the swap chain
 		*/
-		VkSwapchainKHR swapChain;
+		VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 		void CreateSwapChain();
 
 		// Retrieved swap chain images
@@ -234,7 +300,7 @@ namespace Engine {
 
 		// Swap Chain Image Views
 		std::vector<VkImageView> swapChainImageViews;
-		VkImageView CreateImageViewHelper(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+		VkImageView CreateImageViewHelper(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 		void CreateImageViews();
 
 		// Read File Helper for Loading Shaders
@@ -255,6 +321,10 @@ namespace Engine {
 		VkRenderPass renderPass;
 		void CreateRenderPass();
 
+		// Attachment formats the render pass and pipeline were built for
+		VkFormat renderPassColorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat renderPassDepthFormat = VK_FORMAT_UNDEFINED;
+
 		/* Pipeline Layout - uniform values in shaders specified here */
 		VkPipelineLayout pipelineLayout;
 
@@ -262,6 +332,19 @@ namespace Engine {
 		VkPipeline graphicsPipeline;
 		void CreateGraphicsPipeline();
 
+		/*
+		* Pipeline Cache
+		* Drivers compile shaders to GPU machine code while creating a pipeline.
+		* The cache keeps the compiled results, is seeded from settings.pipelineCachePath
+		* at startup and written back on exit, so later runs and swap chain
+		* recreation skip most of the compilation. A file written by another
+		* driver or GPU is rejected by checking its header
+		*/
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		void CreatePipelineCache();
+		void SavePipelineCache();
+		bool IsPipelineCacheCompatible(const std::vector<char>& data);
+
 		// Framebuffers
 		std::vector<VkFramebuffer> swapChainFramebuffers;
 		void CreateFramebuffers();
@@ -270,58 +353,212 @@ namespace Engine {
 		VkCommandPool commandPool;
 		void CreateCommandPool();
 
-		// Command Buffer Allocation
-		std::vector<VkCommandBuffer> commandBuffers;
-		void CreateCommandBuffers();
+		/*
+		* Command Buffer Recording
+		* Every frame in flight has its own transient command pools, one per
+		* recording thread, reset together once the fence of the frame slot has
+		* signaled. The primary command buffer holds the frame's copies and the
+		* render pass, the draw list is split across the recording threads into
+		* secondary command buffers the primary executes
+		*/
+		CommandRecorder commandRecorder;
+		// Fewer patches than this per secondary command buffer cost more to execute than they save
+		static const uint32_t kMinPatchesPerCommandBuffer = 64;
+		void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t uniformOffset);
+		void RecordDraws(VkCommandBuffer commandBuffer, uint32_t uniformOffset, uint32_t firstPatch, uint32_t patchCount);
 
 		/*
 		* The DrawFrame function will perform the following operations:
-		* (1) Acquire an image from the swap chain
-		* (2) Execute the command buffer with that image as attachment in the framebuffer
-		* (3) Return the image to the swap chain for presentation
+		* (1) Wait until the GPU has finished the frame that last used this frame slot
+		* (2) Acquire an image from the swap chain
+		* (3) Execute the command buffer with that image as attachment in the framebuffer
+		* (4) Return the image to the swap chain for presentation
 		*/
 		void DrawFrame();
 
-		// Semaphores for synchronization in drawing frames
-		VkSemaphore imageAvailableSemaphore;
-		VkSemaphore renderFinishedSemaphore;
-		void CreateSemaphores();
+		/*
+		* Frames in flight: each of the settings.framesInFlight frame slots owns
+		* its own pair of semaphores and a fence, so the CPU can record frame N+1
+		* while the GPU still executes frame N. The fence of a slot is waited on
+		* before that slot is reused
+		*/
+		std::vector<VkSemaphore> imageAvailableSemaphores;
+		std::vector<VkSemaphore> renderFinishedSemaphores;
+		std::vector<VkFence> inFlightFences;
+		size_t currentFrame = 0;
+
+		/*
+		* The swap chain may hand out images in any order, and there may be more
+		* (or fewer) images than frame slots. For every swap chain image we remember
+		* the fence of the frame that is currently rendering into it
+		*/
+		std::vector<VkFence> imagesInFlight;
+		void CreateSyncObjects();
+
+		/*
+		* CPU/GPU overlap statistics. Accumulates how long the CPU was blocked
+		* on in-flight fences compared to the total frame time, and prints
+		* a summary every couple of seconds
+		*/
+		struct FrameStats {
+			std::chrono::high_resolution_clock::time_point lastReport;
+			std::chrono::high_resolution_clock::time_point lastFrame;
+			double frameSeconds = 0.0;
+			double fenceWaitSeconds = 0.0;
+			uint32_t frameCount = 0;
+			double inputLatencySeconds = 0.0;
+			double maxInputLatencySeconds = 0.0;
+			uint32_t inputCount = 0;
+			// Fence wait of the latest frame
+			double lastFenceWaitSeconds = 0.0;
+		};
+		FrameStats frameStats;
+		void ReportFrameStats(double fenceWaitSeconds);
+
+		/*
+		* GPU time of the whole frame, of the copies before the render pass and
+		* of the render pass itself, read back framesInFlight frames later.
+		* With settings.pipelineStatistics the render pass also counts its
+		* primitives and shader invocations
+		*/
+		GpuProfiler gpuProfiler;
+		uint32_t gpuFrameScope = 0;
+		uint32_t gpuUploadScope = 0;
+		uint32_t gpuRenderPassScope = 0;
+		// Whether pipelineStatisticsQuery and inheritedQueries were enabled on the logical device
+		bool pipelineStatisticsQueries = false;
+
+		/*
+		* Writes the CPU profiler's scopes and the GPU scopes to settings.tracePath
+		* as a Chrome trace, at exit and whenever P is pressed
+		*/
+		void WriteTrace();
 
-		/* Handle Window Resizing */
+		/*
+		* Deterministic benchmark: the camera follows cameraPath and the globe
+		* turns with simulated time, benchmarkFrame * settings.benchmarkTimestep,
+		* instead of the wall clock, so every run renders the same frames
+		*/
+		CameraPath cameraPath;
+		uint64_t benchmarkFrame = 0;
+		bool IsBenchmark() const { return !settings.benchmarkCameraPath.empty(); }
+		void RunBenchmark();
+
+		/*
+		* Input to photon latency. The time of the oldest input that changed a
+		* frame is kept with the frame's slot until the slot's fence shows the
+		* GPU finished the frame. Presentation adds at most one refresh interval
+		* on top of the measured time
+		*/
+		typedef std::chrono::high_resolution_clock::time_point TimePoint;
+		std::vector<TimePoint> frameInputTimes;
+		// Oldest input not yet in a submitted frame, TimePoint() if none
+		TimePoint pendingInputTime;
+		void CollectInputLatency(size_t frameSlot);
+
+		/*
+		* Headless Rendering
+		* Instead of a swap chain, settings.framesInFlight device-local color images
+		* stand in for the swap chain images. After the render pass, each frame is
+		* handed over to the transfer queue, copied into a host-visible readback
+		* buffer and, once the fence of its frame slot signals, streamed to disk
+		* by the frame writer
+		*/
+		std::vector<Allocation> offscreenImageMemory;
+		void CreateOffscreenTargets();
+
+		VkCommandPool transferCommandPool;
+		std::vector<VkCommandBuffer> readbackCommandBuffers;
+		std::vector<VkBuffer> readbackBuffers;
+		std::vector<Allocation> readbackBufferMemory;
+		// Number of the frame waiting in each slot's readback buffer, 0 if none
+		std::vector<uint64_t> readbackFrameNumbers;
+		uint64_t frameNumber = 0;
+		std::unique_ptr<FrameWriter> frameWriter;
+		void CreateReadbackResources();
+		void DrawOffscreenFrame();
+		void CollectReadback(size_t frameSlot);
+
+		/*
+		* Handle Window Resizing
+		* Viewport and scissor are dynamic pipeline state, so a resize only
+		* replaces the swap chain and the resources sized like it. The render
+		* pass and the pipeline are rebuilt only if an attachment format changed
+		*/
 		void RecreateSwapChain();
 		void CleanupSwapChain();
+		void CleanupPipeline();
 		static void OnWindowResized(GLFWwindow* window, int width, int height);
 
 		// Create the Vertex Buffer
-		VkBuffer vertexBuffer;
+		// VK_NULL_HANDLE for the procedural sphere, which has no vertex or index buffer
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
 		void CreateVertexBuffer();
 
+		Allocation vertexBufferMemory;
+
 		/*
-		* Graphics cards can offer different types of memory to allocate from. 
-		* Each type of memory varies in terms of allowed operations and performance 
-		* characteristics. We need to combine the requirements of the buffer and 
-		* our own application requirements to find the right type of memory to use
+		* All buffer and image memory is sub-allocated from large blocks
+		* by the memory allocator instead of one vkAllocateMemory per resource
 		*/
-		VkDeviceMemory vertexBufferMemory;
-		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+		MemoryAllocator memoryAllocator;
 
 		// Buffer Creation Helper
-		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory);
 
-		// Buffer Copy Helper - Used when copying from staging buffer to vertex buffer
-		void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+		/*
+		* Setup uploads (buffer contents, image data and layout transitions) are
+		* recorded into one batch and submitted once at the end of InitVulkan,
+		* or of RecreateSwapChain, rather than waiting for the queue after each
+		*/
+		UploadContext uploadContext;
+		static const VkDeviceSize kUploadRingSize = 16 * 1024 * 1024;
 
 		// Similar to vertex buffer, we have an index buffer with its own memory needs
-		VkBuffer indexBuffer;
-		VkDeviceMemory indexBufferMemory;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		Allocation indexBufferMemory;
 		void CreateIndexBuffer();
 
-		// UBO that we pass to the vertex shader
+		/*
+		* Per-view UBO that we pass to the vertex shader. With settings.transform
+		* "ubo" the shader multiplies proj, view and model for every vertex, with
+		* "push" it reads the MVP premultiplied on the CPU from the draw's push
+		* constants. The model matrix stays here in both cases: the globe is the
+		* only object, and a second mat4 next to the MVP and the patch constants
+		* would not fit the 128 bytes of push constants every device supports
+		*/
 		struct UniformBufferObject {
 			glm::mat4 model;
 			glm::mat4 view;
 			glm::mat4 proj;
+			// Camera position in the model space of the globe, drives the CDLOD morph
+			glm::vec4 cameraPosition;
+			// x: model units per meter of terrain height
+			glm::vec4 terrainParams;
+		};
+
+		// Push constants of one draw, see Shaders/globe.vert. The UBO path only pushes the patch part
+		struct DrawConstants {
+			glm::mat4 mvp;
+			glm::ivec2 heightTile;
+			glm::vec2 morphRange;
+			// CubeSphere::PatchBounds of the patch, its vertices are quantized relative to them
+			glm::vec4 positionBounds;
+			glm::vec4 texCoordBounds;
+		};
+		static const uint32_t kPatchConstantsOffset = offsetof(DrawConstants, heightTile);
+		// Pushed at kPatchConstantsOffset in place of the patch part by the procedural sphere, see Shaders/sphere.vert
+		struct SphereConstants {
+			glm::uvec2 grid;
+			float radius;
 		};
+		static_assert(kPatchConstantsOffset + sizeof(SphereConstants) <= sizeof(DrawConstants), "SphereConstants must fit the push constant range");
+		/*
+		* Slices and stacks of the procedural sphere, changed with + and - between
+		* frames. It only reaches the GPU as push constants, so nothing is rebuilt
+		*/
+		uint32_t sphereResolution = 0;
+		bool PushesMvp() const { return settings.transform == "push"; }
 		/*
 		* We need to provide details about every descriptor binding used in the shaders 
 		* for pipeline creation, just like we had to do for every vertex attribute and its location index
@@ -329,11 +566,62 @@ namespace Engine {
 		VkDescriptorSetLayout descriptorSetLayout;
 		void CreateDescriptorSetLayout();
 
-		// Buffer that will contain the UBO data for the shader
+		/*
+		* Buffer that will contain the UBO data for the shader. It is mapped once
+		* at creation and carved up by the uniform ring, which hands out aligned
+		* sub-ranges per frame that are bound with dynamic descriptor offsets
+		*/
 		VkBuffer uniformBuffer;
-		VkDeviceMemory uniformBufferMemory;
+		Allocation uniformBufferMemory;
+		UniformRing uniformRing;
+		const VkDeviceSize kUniformRingBytesPerFrame = 64 * 1024;
 		void CreateUniformBuffer();
-		void UpdateUniformBuffer();
+
+		// Writes this frame's UBO into the ring and returns its dynamic offset
+		uint32_t UpdateUniformBuffer();
+
+		/*
+		* Camera orbiting the globe at cameraDistance from its center (radius 1),
+		* W and S move it closer and further away. The transforms of the current
+		* frame are kept for the globe LOD selection
+		*/
+		float cameraDistance = 2.83f;
+		UniformBufferObject frameTransforms;
+		glm::mat4 frameMvp;
+
+		/*
+		* Cube-sphere globe. vertexBuffer holds kPatchCapacity patch slots in
+		* persistently mapped memory, so patches can be generated straight into
+		* it, and indexBuffer holds the index list shared by all patches
+		*/
+		CubeSphere cubeSphere;
+		const uint32_t kPatchCapacity = 1024;
+		void UpdateGlobe();
+
+		/*
+		* Terrain heights of the globe patches. heightAtlasImage holds one
+		* Terrain::kTileSize x Terrain::kTileSize tile per vertex pool slot, which
+		* the vertex shader displaces the patch with. Changed tiles are staged in
+		* this frame's region of heightStagingBuffer and copied at the start of the
+		* frame's command buffer, at most kHeightUploadsPerFrame per frame
+		*/
+		Terrain terrain;
+		const float kEarthRadiusMeters = 6371000.0f;
+		VkImage heightAtlasImage;
+		Allocation heightAtlasMemory;
+		VkImageView heightAtlasView;
+		VkSampler heightSampler;
+		const uint32_t kHeightAtlasColumns = 32;
+		VkBuffer heightStagingBuffer;
+		Allocation heightStagingMemory;
+		const uint32_t kHeightUploadsPerFrame = 64;
+		std::vector<CubeSphere::GeneratedPatch> generatedPatches;
+		std::vector<uint32_t> finishedHeightSlots;
+		std::deque<uint32_t> pendingHeightSlots;
+		std::vector<bool> heightSlotQueued;
+		std::vector<VkBufferImageCopy> heightCopies;
+		void CreateHeightAtlas();
+		void UpdateHeights();
 
 		// Create Descriptor Pool and Descriptor Set
 		VkDescriptorPool descriptorPool;
@@ -343,18 +631,61 @@ namespace Engine {
 
 		// Texture Support
 		VkImage textureImage;
-		VkDeviceMemory textureImageMemory;
-		void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
-			VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+		Allocation textureImageMemory;
+		void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
+			VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory);
 		void CreateTextureImage();
+		VkFormat textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		uint32_t textureMipLevels = 1;
+		// Whether textureCompressionBC was enabled on the logical device
+		bool textureCompressionBC = false;
+		void RecordMipmapBlits(VkCommandBuffer commandBuffer, VkImage image, int32_t width, int32_t height, uint32_t mipLevels);
 
-		// Layout Transitions
-		VkCommandBuffer BeginSingleTimeCommands();
-		void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
-		void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+		/*
+		* Asynchronous Asset Loading
+		* Files are decoded by background jobs of the asset loader. The render loop then
+		* records their upload on the transfer queue and, once the upload fence
+		* signals, swaps the result in for the placeholder drawn meanwhile
+		*/
+		AssetLoader assetLoader;
+
+		struct DecodedTexture {
+			// Decided before decoding: BC7 from Textures/Earth.ktx2, or RGBA8 with blitted mip levels
+			bool compressed = false;
+			bool blitMipmaps = false;
+
+			// Every level present in texture.data, only level 0 if the rest is blitted
+			KtxTexture texture;
+			uint32_t mipLevels = 0;
+			std::string description;
+			double decodeMilliseconds = 0.0;
+		};
+		static void DecodeTexture(DecodedTexture& decoded);
+		void UploadTexture(const DecodedTexture& decoded);
+		std::chrono::high_resolution_clock::time_point textureLoadStart;
+
+		// Replaced texture, kept until Cleanup because earlier frames may still sample it
+		VkImage placeholderImage = VK_NULL_HANDLE;
+		VkImageView placeholderImageView = VK_NULL_HANDLE;
+		Allocation placeholderImageMemory;
+
+		struct PendingUpload {
+			VkCommandBuffer transferCommands;
+			VkCommandBuffer graphicsCommands;
+			// Signaled by the transfer queue for the graphics queue, only with a dedicated transfer family
+			VkSemaphore ownershipSemaphore = VK_NULL_HANDLE;
+			VkFence fence;
+			VkBuffer stagingBuffer;
+			Allocation stagingMemory;
+			// Runs on the render thread once the fence has signaled
+			std::function<void()> onComplete;
+		};
+		std::vector<PendingUpload> pendingUploads;
+		void UpdateAssetLoads();
+		void FinishAssetLoads();
 
-		// Helper Method to copy buffer to image
-		void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+		// Layout Transitions, recorded into the open upload batch
+		void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
 
 		// Texture Image View to access texels in the shader
 		VkImageView textureImageView;
@@ -364,9 +695,38 @@ namespace Engine {
 		VkSampler textureSampler;
 		void CreateTextureSampler();
 
+		/*
+		* Virtual texture, used instead of textureImage with --virtual-texture.
+		* tileCacheImage is the fixed atlas of resident tiles bound in place of the
+		* Earth texture, pageTableBuffer the device local copy of the page table and
+		* feedbackBuffer holds one region of tile request bits per frame in flight.
+		* New tiles and page table changes are staged in this frame's region of
+		* virtualTextureStagingBuffer and copied before the render pass
+		*/
+		VirtualTexture virtualTexture;
+		VkImage tileCacheImage;
+		Allocation tileCacheMemory;
+		VkImageView tileCacheView;
+		VkBuffer pageTableBuffer;
+		Allocation pageTableMemory;
+		VkBuffer feedbackBuffer;
+		Allocation feedbackMemory;
+		VkDeviceSize feedbackRegionSize = 0;
+		VkBuffer virtualTextureStagingBuffer;
+		Allocation virtualTextureStagingMemory;
+		VkDeviceSize virtualTextureStagingRegionSize = 0;
+		const uint32_t kTileUploadsPerFrame = 16;
+		std::vector<VirtualTexture::TileUpload> tileUploads;
+		std::vector<std::pair<uint32_t, uint32_t>> pageTableDirtyRanges;
+		std::vector<VkBufferImageCopy> tileCopies;
+		std::vector<VkBufferCopy> pageTableCopies;
+		bool UsesVirtualTexture() const { return !settings.virtualTextureDirectory.empty(); }
+		void CreateVirtualTexture();
+		void UpdateVirtualTexture();
+
 		// Depth Buffer
 		VkImage depthImage;
-		VkDeviceMemory depthImageMemory;
+		Allocation depthImageMemory;
 		VkImageView depthImageView;
 		void CreateDepthResources();
 		VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
@@ -0,0 +1,360 @@
+#pragma once
+
+// System Headers
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <stdexcept>
+
+namespace Engine {
+
+	/*
+	* Runtime configuration of the renderer. Every field has a sensible
+	* default so that running the executable with no arguments behaves
+	* exactly like before; ParseSettings overrides them from the command line
+	*/
+	struct Settings {
+		/*
+		* Number of frames the CPU is allowed to record and submit ahead of the GPU.
+		* 1 serializes CPU and GPU, 2 or 3 lets the CPU work on frame N+1
+		* while the GPU is still executing frame N
+		*/
+		uint32_t framesInFlight = 2;
+
+		/*
+		* Enables VK_LAYER_LUNARG_standard_validation. Software drivers on CI
+		* machines usually ship without the layers, so it can be switched off
+		*/
+		bool enableValidationLayers = true;
+
+		/*
+		* Headless mode renders into offscreen images without GLFW, a surface
+		* or a swap chain, reads every frame back and optionally writes it to disk
+		*/
+		bool headless = false;
+		uint32_t width = 800;
+		uint32_t height = 600;
+		// Number of frames rendered before a headless run exits
+		uint32_t frameCount = 100;
+		// Directory receiving frame_NNNNNN.png / .raw files, empty to discard frames
+		std::string outputDirectory;
+		// "png" or "raw"
+		std::string outputFormat = "png";
+
+		// File the VkPipelineCache is loaded from at startup and saved to on exit
+		std::string pipelineCachePath = "pipeline_cache.bin";
+
+		/*
+		* "cube" renders the globe as cube-sphere patches refined by screen space
+		* error, "uv" renders the single UV sphere built by CreateSphere and
+		* "procedural" the same sphere computed in the vertex shader from the
+		* vertex and instance index, with no vertex or index buffer
+		*/
+		std::string globe = "uv";
+		// Slices and stacks of the UV sphere, above 255 its indices are 32 bit. The procedural sphere starts at it
+		uint32_t sphereResolution = 32;
+		// Screen space error in pixels above which a globe patch is refined
+		float lodErrorPixels = 1.0f;
+
+		/*
+		* "push" gives every draw its MVP premultiplied on the CPU in push
+		* constants, "ubo" has the vertex shader multiply the uniform buffer's
+		* projection, view and model matrices for every vertex
+		*/
+		std::string transform = "push";
+
+		// Directory of SRTM .hgt elevation tiles, empty keeps the globe at sea level
+		std::string terrainDirectory;
+		// Memory budget of the decoded elevation tile cache
+		uint32_t terrainCacheMegabytes = 512;
+		// Vertical exaggeration of the terrain
+		float terrainScale = 1.0f;
+
+		/*
+		* Directory of a tile pyramid built by BuildTilePyramid. When set, the
+		* globe is textured from it through the virtual texture instead of Textures/Earth.png
+		*/
+		std::string virtualTextureDirectory;
+		// Tiles per side of the square virtual texture cache atlas
+		uint32_t virtualTextureCacheTiles = 24;
+		// Image to cut into a tile pyramid in virtualTextureDirectory, the program exits afterwards
+		std::string buildTilesSource;
+
+		// Builds the Earth texture mip chain on the CPU even if the GPU could blit it
+		bool cpuMipmaps = false;
+
+		/*
+		* Uploads the Earth texture as BC7 from Textures/Earth.ktx2 when the device
+		* supports it, building the file from Textures/Earth.png on the first run
+		*/
+		bool compressTexture = true;
+		// Image to compress into a .ktx2 file next to it, the program exits afterwards
+		std::string compressTextureSource;
+		// "bc7", "bc4" or "bc5", the block format --compress-texture writes
+		std::string blockFormat = "bc7";
+
+		/*
+		* Worker threads of the job system running the engine's CPU work. The
+		* render loop's thread helps out while it waits for jobs, 0 picks one
+		* worker per hardware thread besides it
+		*/
+		uint32_t workerThreads = 0;
+
+		/*
+		* Upper bound of the secondary command buffers the globe's draw list is
+		* split into, 0 allows one per job system thread
+		*/
+		uint32_t recordThreads = 0;
+
+		// Runs the job system microbenchmarks instead of the renderer
+		bool benchJobs = false;
+		// Prints the vertex format sizes and quantization errors instead of running the renderer
+		bool benchVertices = false;
+		// Times UV sphere generation against the previous version instead of running the renderer
+		bool benchSphere = false;
+
+		// Counts the render pass's primitives and shader invocations with a pipeline statistics query
+		bool pipelineStatistics = false;
+
+		// Chrome trace JSON the CPU and GPU profiler scopes are written to, empty disables CPU profiling
+		std::string tracePath;
+
+		/*
+		* Camera path file of a benchmark run. Benchmarks render headless at a
+		* fixed timestep, warmupFrames frames at the start of the path and then
+		* frameCount measured frames, and write their statistics as JSON to
+		* benchmarkOutput
+		*/
+		std::string benchmarkCameraPath;
+		uint32_t warmupFrames = 30;
+		float benchmarkTimestep = 1.0f / 60.0f;
+		std::string benchmarkOutput = "benchmark.json";
+	};
+
+	// Reads the unsigned integer value following a command line option
+	inline uint32_t ParseUnsignedOption(const std::string& option, int& i, int argc, char** argv) {
+		if (i + 1 >= argc) {
+			throw std::runtime_error("Missing value for option " + option);
+		}
+		char* end = nullptr;
+		unsigned long value = std::strtoul(argv[++i], &end, 10);
+		if (end == argv[i] || *end != '\0') {
+			throw std::runtime_error("Invalid value for option " + option + ": " + argv[i]);
+		}
+		return static_cast<uint32_t>(value);
+	}
+
+	// Reads the string value following a command line option
+	inline std::string ParseStringOption(const std::string& option, int& i, int argc, char** argv) {
+		if (i + 1 >= argc) {
+			throw std::runtime_error("Missing value for option " + option);
+		}
+		return argv[++i];
+	}
+
+	// Reads the floating point value following a command line option
+	inline float ParseFloatOption(const std::string& option, int& i, int argc, char** argv) {
+		if (i + 1 >= argc) {
+			throw std::runtime_error("Missing value for option " + option);
+		}
+		char* end = nullptr;
+		float value = std::strtof(argv[++i], &end);
+		if (end == argv[i] || *end != '\0') {
+			throw std::runtime_error("Invalid value for option " + option + ": " + argv[i]);
+		}
+		return value;
+	}
+
+	/*
+	* Supported options:
+	* --frames-in-flight N : number of frames the CPU may run ahead of the GPU (1-8)
+	* --no-validation      : do not enable the Vulkan validation layers
+	* --headless           : render offscreen without a window
+	* --width N            : window or headless render target width
+	* --height N           : window or headless render target height
+	* --frames N           : number of frames to render in headless mode
+	* --output DIR         : write headless frames into DIR
+	* --output-format FMT  : png or raw
+	* --pipeline-cache FILE: pipeline cache file (default pipeline_cache.bin)
+	* --globe cube|uv|procedural: cube-sphere patches with LOD, the fixed UV sphere or the UV sphere computed in the vertex shader
+	* --sphere-resolution N: slices and stacks of the UV sphere (default 32)
+	* --lod-error PIXELS   : screen space error threshold of the globe LOD
+	* --transform push|ubo : premultiplied MVP in push constants or matrices multiplied per vertex
+	* --terrain DIR        : displace the cube-sphere globe with the .hgt tiles in DIR
+	* --terrain-cache MB   : memory budget of decoded elevation tiles (default 512)
+	* --terrain-scale X    : vertical exaggeration of the terrain (default 1)
+	* --virtual-texture DIR: texture the globe from the tile pyramid in DIR
+	* --vt-cache N         : tiles per side of the virtual texture cache (default 24)
+	* --build-tiles IMAGE  : cut IMAGE into a tile pyramid in the --virtual-texture DIR and exit
+	* --cpu-mips           : generate the texture mip chain on the CPU instead of with blits
+	* --uncompressed-texture: upload the Earth texture as RGBA8 instead of BC7
+	* --compress-texture IMAGE: write IMAGE with its mip chain block compressed to a .ktx2 file and exit
+	* --block-format FMT   : bc7, bc4 or bc5, the format written by --compress-texture (default bc7)
+	* --worker-threads N   : job system worker threads, 0 for one per hardware thread (0-64)
+	* --record-threads N   : secondary command buffers per draw list, 0 for one per job system thread (0-16)
+	* --bench-jobs         : run the job system microbenchmarks and exit
+	* --bench-vertices     : report vertex sizes and quantization errors and exit
+	* --bench-sphere       : time UV sphere generation in vertices per second and exit
+	* --pipeline-stats     : report the render pass's pipeline statistics with the frame statistics
+	* --trace FILE         : record CPU profiler scopes and write them with the GPU scopes to FILE at exit
+	* --benchmark FILE     : headless benchmark along the camera path in FILE, --frames measured frames
+	* --warmup N           : frames rendered before a benchmark measures (default 30)
+	* --timestep SECONDS   : simulated time per benchmark frame (default 1/60)
+	* --benchmark-output FILE: JSON results of a benchmark (default benchmark.json)
+	*/
+	inline Settings ParseSettings(int argc, char** argv) {
+		Settings settings;
+		for (int i = 1; i < argc; i++) {
+			std::string option = argv[i];
+			if (option == "--frames-in-flight") {
+				settings.framesInFlight = ParseUnsignedOption(option, i, argc, argv);
+				if (settings.framesInFlight < 1 || settings.framesInFlight > 8) {
+					throw std::runtime_error("--frames-in-flight must be between 1 and 8");
+				}
+			}
+			else if (option == "--no-validation") {
+				settings.enableValidationLayers = false;
+			}
+			else if (option == "--headless") {
+				settings.headless = true;
+			}
+			else if (option == "--width") {
+				settings.width = ParseUnsignedOption(option, i, argc, argv);
+			}
+			else if (option == "--height") {
+				settings.height = ParseUnsignedOption(option, i, argc, argv);
+			}
+			else if (option == "--frames") {
+				settings.frameCount = ParseUnsignedOption(option, i, argc, argv);
+			}
+			else if (option == "--output") {
+				settings.outputDirectory = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--output-format") {
+				settings.outputFormat = ParseStringOption(option, i, argc, argv);
+				if (settings.outputFormat != "png" && settings.outputFormat != "raw") {
+					throw std::runtime_error("--output-format must be png or raw");
+				}
+			}
+			else if (option == "--pipeline-cache") {
+				settings.pipelineCachePath = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--globe") {
+				settings.globe = ParseStringOption(option, i, argc, argv);
+				if (settings.globe != "cube" && settings.globe != "uv" && settings.globe != "procedural") {
+					throw std::runtime_error("--globe must be cube, uv or procedural");
+				}
+			}
+			else if (option == "--sphere-resolution") {
+				settings.sphereResolution = ParseUnsignedOption(option, i, argc, argv);
+				if (settings.sphereResolution < 3 || settings.sphereResolution > 2048) {
+					throw std::runtime_error("--sphere-resolution must be between 3 and 2048");
+				}
+			}
+			else if (option == "--lod-error") {
+				settings.lodErrorPixels = ParseFloatOption(option, i, argc, argv);
+				if (!(settings.lodErrorPixels > 0.0f)) {
+					throw std::runtime_error("--lod-error must be positive");
+				}
+			}
+			else if (option == "--transform") {
+				settings.transform = ParseStringOption(option, i, argc, argv);
+				if (settings.transform != "push" && settings.transform != "ubo") {
+					throw std::runtime_error("--transform must be push or ubo");
+				}
+			}
+			else if (option == "--terrain") {
+				settings.terrainDirectory = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--terrain-cache") {
+				settings.terrainCacheMegabytes = ParseUnsignedOption(option, i, argc, argv);
+			}
+			else if (option == "--terrain-scale") {
+				settings.terrainScale = ParseFloatOption(option, i, argc, argv);
+				if (!(settings.terrainScale >= 0.0f)) {
+					throw std::runtime_error("--terrain-scale must not be negative");
+				}
+			}
+			else if (option == "--virtual-texture") {
+				settings.virtualTextureDirectory = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--vt-cache") {
+				settings.virtualTextureCacheTiles = ParseUnsignedOption(option, i, argc, argv);
+				if (settings.virtualTextureCacheTiles < 2 || settings.virtualTextureCacheTiles > 255) {
+					throw std::runtime_error("--vt-cache must be between 2 and 255");
+				}
+			}
+			else if (option == "--build-tiles") {
+				settings.buildTilesSource = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--cpu-mips") {
+				settings.cpuMipmaps = true;
+			}
+			else if (option == "--uncompressed-texture") {
+				settings.compressTexture = false;
+			}
+			else if (option == "--compress-texture") {
+				settings.compressTextureSource = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--block-format") {
+				settings.blockFormat = ParseStringOption(option, i, argc, argv);
+				if (settings.blockFormat != "bc7" && settings.blockFormat != "bc4" && settings.blockFormat != "bc5") {
+					throw std::runtime_error("--block-format must be bc7, bc4 or bc5");
+				}
+			}
+			else if (option == "--worker-threads") {
+				settings.workerThreads = ParseUnsignedOption(option, i, argc, argv);
+				if (settings.workerThreads > 64) {
+					throw std::runtime_error("--worker-threads must be between 0 and 64");
+				}
+			}
+			else if (option == "--bench-jobs") {
+				settings.benchJobs = true;
+			}
+			else if (option == "--bench-vertices") {
+				settings.benchVertices = true;
+			}
+			else if (option == "--bench-sphere") {
+				settings.benchSphere = true;
+			}
+			else if (option == "--record-threads") {
+				settings.recordThreads = ParseUnsignedOption(option, i, argc, argv);
+				if (settings.recordThreads > 16) {
+					throw std::runtime_error("--record-threads must be between 0 and 16");
+				}
+			}
+			else if (option == "--pipeline-stats") {
+				settings.pipelineStatistics = true;
+			}
+			else if (option == "--trace") {
+				settings.tracePath = ParseStringOption(option, i, argc, argv);
+			}
+			else if (option == "--benchmark") {
+				settings.benchmarkCameraPath = ParseStringOption(option, i, argc, argv);
+				settings.headless = true;
+			}
+			else if (option == "--warmup") {
+				settings.warmupFrames = ParseUnsignedOption(option, i, argc, argv);
+			}
+			else if (option == "--timestep") {
+				settings.benchmarkTimestep = ParseFloatOption(option, i, argc, argv);
+				if (!(settings.benchmarkTimestep > 0.0f)) {
+					throw std::runtime_error("--timestep must be positive");
+				}
+			}
+			else if (option == "--benchmark-output") {
+				settings.benchmarkOutput = ParseStringOption(option, i, argc, argv);
+			}
+			else {
+				throw std::runtime_error("Unknown option: " + option);
+			}
+		}
+		if (settings.width == 0 || settings.height == 0) {
+			throw std::runtime_error("--width and --height must be non-zero");
+		}
+		if (!settings.buildTilesSource.empty() && settings.virtualTextureDirectory.empty()) {
+			throw std::runtime_error("--build-tiles needs --virtual-texture DIR as the output directory");
+		}
+		return settings;
+	}
+}
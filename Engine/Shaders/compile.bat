@@ -1,3 +1,6 @@
 C:/VulkanSDK/1.0.51.0/Bin32/glslangValidator.exe -V earth.vert
 C:/VulkanSDK/1.0.51.0/Bin32/glslangValidator.exe -V earth.frag
+C:/VulkanSDK/1.0.51.0/Bin32/glslangValidator.exe -V globe.vert -o globe.spv
+C:/VulkanSDK/1.0.51.0/Bin32/glslangValidator.exe -V sphere.vert -o sphere.spv
+C:/VulkanSDK/1.0.51.0/Bin32/glslangValidator.exe -V virtual.frag -o virtual.spv
 pause
\ No newline at end of file
@@ -7,9 +7,15 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
+// True when the CPU premultiplies the MVP into the push constants, set when the pipeline is created
+layout(constant_id = 0) const bool pushMvp = true;
+
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+} drawConstants;
+
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 1) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
@@ -19,7 +25,7 @@ out gl_PerVertex {
 };
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
+    gl_Position = (pushMvp ? drawConstants.mvp : ubo.proj * ubo.view * ubo.model) * vec4(inPosition, 1.0);
+    fragColor = vec3(1.0);
     fragTexCoord = inTexCoord;
 }
\ No newline at end of file
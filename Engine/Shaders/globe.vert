@@ -0,0 +1,68 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 cameraPosition;
+    vec4 terrain;
+} ubo;
+
+// Height tiles of all resident patches, one 17x17 tile per vertex pool slot
+layout(binding = 2) uniform sampler2D heightAtlas;
+
+// True when the CPU premultiplies the MVP into the push constants, set when the pipeline is created
+layout(constant_id = 0) const bool pushMvp = true;
+
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    ivec2 heightTile;
+    vec2 morphRange;
+    // Origin and size of the patch's bounding cube and texture coordinate rectangle, see PatchVertex
+    vec4 positionBounds;
+    vec4 texCoordBounds;
+} drawConstants;
+
+// xyz position quantized within the patch bounds, w the patch grid position as i | j << 8
+layout(location = 0) in uvec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+vec3 decodeOctahedral(vec2 square) {
+    vec3 n = vec3(square, 1.0 - abs(square.x) - abs(square.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+float height(ivec2 grid) {
+    return texelFetch(heightAtlas, drawConstants.heightTile + grid, 0).r;
+}
+
+void main() {
+    vec3 spherePosition = drawConstants.positionBounds.xyz + vec3(inPosition.xyz) * (drawConstants.positionBounds.w / 65535.0);
+    vec3 normal = decodeOctahedral(inNormal);
+    ivec2 grid = ivec2(inPosition.w & 0xFFu, inPosition.w >> 8);
+
+    // The parent patch only has the even grid vertices, odd ones lie halfway between two of them
+    ivec2 odd = grid & 1;
+    float h = height(grid);
+    float hParent = 0.5 * (height(grid - odd) + height(grid + odd));
+
+    float cameraDistance = length(spherePosition - ubo.cameraPosition.xyz);
+    float morph = clamp((cameraDistance - drawConstants.morphRange.x) / (drawConstants.morphRange.y - drawConstants.morphRange.x), 0.0, 1.0);
+
+    vec3 position = spherePosition + normal * mix(h, hParent, morph) * ubo.terrain.x;
+    gl_Position = (pushMvp ? drawConstants.mvp : ubo.proj * ubo.view * ubo.model) * vec4(position, 1.0);
+    fragColor = vec3(1.0);
+    fragTexCoord = drawConstants.texCoordBounds.xy + inTexCoord * drawConstants.texCoordBounds.zw;
+}
@@ -0,0 +1,47 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+// True when the CPU premultiplies the MVP into the push constants, set when the pipeline is created
+layout(constant_id = 0) const bool pushMvp = true;
+
+// Renderer::SphereConstants follow the MVP, where the globe patches have their height tile
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    uvec2 grid;
+    float radius;
+} drawConstants;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+const float PI = 3.1415926535897932384626433832795;
+
+/*
+* The UV sphere of CreateSphere without a vertex or index buffer. Every
+* instance is one stack of the grid (slices, stacks), drawn as a triangle
+* strip that alternates between the stack's lower and upper ring. The lower
+* ring comes first, so the triangles wind like CreateSphere's
+*/
+void main() {
+    uint column = uint(gl_VertexIndex) >> 1;
+    uint row = uint(gl_InstanceIndex) + 1u - (uint(gl_VertexIndex) & 1u);
+    vec2 uv = vec2(column, row) / vec2(drawConstants.grid);
+
+    float theta = uv.x * 2.0 * PI;
+    float phi = uv.y * PI;
+    vec3 position = vec3(cos(theta) * sin(phi), cos(phi), sin(theta) * sin(phi)) * drawConstants.radius;
+
+    gl_Position = (pushMvp ? drawConstants.mvp : ubo.proj * ubo.view * ubo.model) * vec4(position, 1.0);
+    fragColor = vec3(1.0);
+    fragTexCoord = vec2(-uv.x, uv.y);
+}
\ No newline at end of file
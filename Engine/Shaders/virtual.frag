@@ -0,0 +1,55 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+// Resident tiles of the virtual texture, each with a border for filtering
+layout(binding = 1) uniform sampler2D tileCache;
+
+// See VirtualTexture.h for the layout
+layout(std430, binding = 3) readonly buffer PageTable {
+    uvec4 info;
+    uvec4 cache;
+    uvec4 levels[16];
+    uint entries[];
+} pageTable;
+
+// One bit per tile this frame would like to sample
+layout(std430, binding = 4) buffer Feedback {
+    uint requested[];
+} feedback;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    uint levelCount = pageTable.info.z;
+    uint tileSize = pageTable.info.w;
+    vec2 texel = clamp(fragTexCoord, 0.0, 1.0) * vec2(pageTable.info.xy);
+
+    // Level whose texels match the screen pixels, like regular mip selection
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(floor(lod), 0.0, float(levelCount - 1)));
+
+    uvec4 levelInfo = pageTable.levels[level];
+    uvec2 tile = min(uvec2(texel / float(tileSize << level)), levelInfo.xy - 1);
+    uint index = levelInfo.z + tile.y * levelInfo.x + tile.x;
+
+    // Every 4x4 block of pixels reports once, which is plenty to find the visible tiles
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if ((pixel.x & 3) == 0 && (pixel.y & 3) == 0) {
+        atomicOr(feedback.requested[index >> 5], 1u << (index & 31u));
+    }
+
+    // The entry points at the finest resident tile covering this one
+    uint entry = pageTable.entries[index];
+    uint mappedLevel = (entry >> 16) & 0xFFu;
+    vec2 slot = vec2(entry & 0xFFu, (entry >> 8) & 0xFFu);
+    float mappedSize = float(tileSize << mappedLevel);
+    vec2 inTile = fract(texel / mappedSize);
+
+    vec2 atlasTexel = slot * float(pageTable.cache.x) + float(pageTable.cache.z) + inTile * float(tileSize);
+    outColor = textureLod(tileCache, atlasTexel / float(pageTable.cache.y), 0.0);
+}
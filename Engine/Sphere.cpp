@@ -0,0 +1,114 @@
+// User-defined Headers
+#include "Sphere.h"
+#include "VertexFormat.h"
+#include "Profiler.h"
+
+// System Headers
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENGINE_SPHERE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const double kPi = 3.1415926535897932384626433832795;
+
+	const uint32_t kRowsPerJob = 8;
+	const uint32_t kQuadsPerJob = 16 * 1024;
+
+	// The SSE2 path writes every vertex as one 16 byte store, the texture coordinates as the last 4 bytes
+	static_assert(sizeof(Engine::Vertex) == 16 && offsetof(Engine::Vertex, texCoord) == 12, "Vertex layout changed");
+
+	// Both texture coordinates in the bit pattern they have in memory, U in the low half
+	uint32_t PackTexCoord(int16_t u, int16_t v)
+	{
+		return uint32_t(uint16_t(u)) | uint32_t(uint16_t(v)) << 16;
+	}
+}
+
+void Engine::CreateSphere(float radius, float slices, float stacks, std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, JobSystem& jobSystem)
+{
+	PROFILE_SCOPE("CreateSphere");
+	const uint32_t rowVertices = static_cast<uint32_t>(slices) + 1;
+	const uint32_t rows = static_cast<uint32_t>(stacks) + 1;
+	vertices->resize(size_t(rows) * rowVertices);
+
+	/*
+	* Vertex (i, j) is at (cos theta_j sin phi_i, cos phi_i, sin theta_j sin phi_i),
+	* theta going around with the column and phi down from the pole with the
+	* row. The column terms are the same for every row, so they are computed
+	* once, padded to a multiple of 4 for the SIMD loads
+	*/
+	const uint32_t paddedColumns = (rowVertices + 3) & ~3u;
+	std::vector<float> columnCos(paddedColumns, 0.0f);
+	std::vector<float> columnSin(paddedColumns, 0.0f);
+	std::vector<uint32_t> columnU(paddedColumns, 0);
+	for (uint32_t j = 0; j < rowVertices; ++j) {
+		// U texture coordinate
+		double U = j / static_cast<double>(slices);
+		double theta = U * 2.0 * kPi;
+		columnCos[j] = static_cast<float>(std::cos(theta));
+		columnSin[j] = static_cast<float>(std::sin(theta));
+		columnU[j] = PackTexCoord(QuantizeSnorm16(static_cast<float>(-U)), 0);
+	}
+
+	jobSystem.ParallelFor(rows, kRowsPerJob, [&](uint32_t firstStack, uint32_t lastStack) {
+		for (uint32_t i = firstStack; i < lastStack; ++i) {
+
+			// V texture coordinate
+			double V = i / static_cast<double>(stacks);
+			double phi = V * kPi;
+			const float ringRadius = static_cast<float>(std::sin(phi) * radius);
+			const float y = static_cast<float>(std::cos(phi) * radius);
+			const uint32_t rowV = PackTexCoord(0, QuantizeSnorm16(static_cast<float>(V)));
+
+			Vertex* row = vertices->data() + size_t(i) * rowVertices;
+			uint32_t j = 0;
+#ifdef ENGINE_SPHERE_SSE2
+			// Four vertices per iteration, built as x, y, z and texture coordinate vectors and transposed into four vertices
+			const __m128 ring = _mm_set1_ps(ringRadius);
+			const __m128 height = _mm_set1_ps(y);
+			const __m128i v = _mm_set1_epi32(static_cast<int>(rowV));
+			for (; j + 4 <= rowVertices; j += 4) {
+				__m128 x4 = _mm_mul_ps(_mm_loadu_ps(&columnCos[j]), ring);
+				__m128 y4 = height;
+				__m128 z4 = _mm_mul_ps(_mm_loadu_ps(&columnSin[j]), ring);
+				__m128 uv4 = _mm_castsi128_ps(_mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&columnU[j])), v));
+				_MM_TRANSPOSE4_PS(x4, y4, z4, uv4);
+
+				float* out = reinterpret_cast<float*>(row + j);
+				_mm_storeu_ps(out, x4);
+				_mm_storeu_ps(out + 4, y4);
+				_mm_storeu_ps(out + 8, z4);
+				_mm_storeu_ps(out + 12, uv4);
+			}
+#endif
+			for (; j < rowVertices; ++j) {
+				// Add this vertex
+				Vertex& vertex = row[j];
+				vertex.pos = glm::vec3(columnCos[j] * ringRadius, y, columnSin[j] * ringRadius); // Vertex Position
+				vertex.texCoord[0] = static_cast<int16_t>(columnU[j] & 0xffff); // Texture Coordinates
+				vertex.texCoord[1] = static_cast<int16_t>(rowV >> 16);
+			}
+		}
+	});
+
+	const uint32_t quadCount = static_cast<uint32_t>(slices * stacks + slices);
+	indices->resize(size_t(quadCount) * 6);
+
+	jobSystem.ParallelFor(quadCount, kQuadsPerJob, [&](uint32_t firstQuad, uint32_t lastQuad) {
+		for (uint32_t i = firstQuad; i < lastQuad; ++i) {
+			uint32_t* triangles = indices->data() + size_t(i) * 6;
+
+			triangles[0] = i;
+			triangles[1] = i + rowVertices;
+			triangles[2] = i + rowVertices - 1;
+
+			triangles[3] = i + rowVertices;
+			triangles[4] = i;
+			triangles[5] = i + 1;
+		}
+	});
+}
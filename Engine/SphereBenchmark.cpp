@@ -0,0 +1,121 @@
+// User-defined Headers
+#include "SphereBenchmark.h"
+#include "Sphere.h"
+#include "VertexFormat.h"
+
+// System Headers
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+namespace {
+	const uint32_t kRuns = 5;
+	const uint32_t kResolutions[] = { 256, 1024, 2048 };
+
+	// Best of kRuns, in milliseconds
+	double Measure(const std::function<void()>& run)
+	{
+		double best = 1e30;
+		for (uint32_t i = 0; i < kRuns; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			run();
+			auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+
+	// CreateSphere before the trig tables, four sines and cosines per vertex
+	void CreateSphereReference(float radius, float slices, float stacks, std::vector<Engine::Vertex>* vertices, std::vector<uint32_t>* indices, Engine::JobSystem& jobSystem)
+	{
+		const double pi = 3.1415926535897932384626433832795;
+		const uint32_t rowVertices = static_cast<uint32_t>(slices) + 1;
+		vertices->resize(size_t(stacks + 1) * rowVertices);
+
+		jobSystem.ParallelFor(static_cast<uint32_t>(stacks) + 1, 8, [&](uint32_t firstStack, uint32_t lastStack) {
+			for (uint32_t i = firstStack; i < lastStack; ++i) {
+				double V = i / static_cast<double>(stacks);
+				double phi = V * pi;
+
+				for (uint32_t j = 0; j <= slices; ++j) {
+					double U = j / static_cast<double>(slices);
+					double theta = U * pi * 2;
+
+					double X = cos(theta) * sin(phi);
+					double Y = cos(phi);
+					double Z = sin(theta) * sin(phi);
+
+					Engine::Vertex& vertex = (*vertices)[i * rowVertices + j];
+					vertex.pos = glm::vec3(X * radius, Y * radius, Z * radius);
+					vertex.texCoord[0] = Engine::QuantizeSnorm16(static_cast<float>(-U));
+					vertex.texCoord[1] = Engine::QuantizeSnorm16(static_cast<float>(V));
+				}
+			}
+		});
+
+		const uint32_t quadCount = static_cast<uint32_t>(slices * stacks + slices);
+		indices->resize(size_t(quadCount) * 6);
+
+		jobSystem.ParallelFor(quadCount, 1024, [&](uint32_t firstQuad, uint32_t lastQuad) {
+			for (uint32_t i = firstQuad; i < lastQuad; ++i) {
+				uint32_t* triangles = indices->data() + size_t(i) * 6;
+
+				triangles[0] = i;
+				triangles[1] = i + rowVertices;
+				triangles[2] = i + rowVertices - 1;
+
+				triangles[3] = i + rowVertices;
+				triangles[4] = i;
+				triangles[5] = i + 1;
+			}
+		});
+	}
+}
+
+void Engine::RunSphereBenchmarks(uint32_t maxThreads, std::ostream& out)
+{
+	maxThreads = std::max(1u, maxThreads);
+	std::vector<uint32_t> threadCounts = { 1 };
+	if (maxThreads > 1) threadCounts.push_back(maxThreads);
+
+	out << "UV sphere generation, best of " << kRuns << " runs, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+	out << std::left << std::setw(12) << "resolution" << std::right << std::setw(8) << "threads"
+		<< std::setw(14) << "reference ms" << std::setw(14) << "Mvertices/s" << std::setw(10) << "tables ms" << std::setw(14) << "Mvertices/s"
+		<< std::setw(10) << "speedup" << std::setw(14) << "max |dpos|" << std::setw(11) << "identical" << std::endl;
+
+	std::vector<Vertex> referenceVertices, vertices;
+	std::vector<uint32_t> referenceIndices, indices;
+	for (uint32_t threads : threadCounts) {
+		JobSystem jobs;
+		jobs.Init(threads - 1);
+
+		for (uint32_t resolution : kResolutions) {
+			float size = static_cast<float>(resolution);
+			double referenceTime = Measure([&] { CreateSphereReference(1, size, size, &referenceVertices, &referenceIndices, jobs); });
+			double time = Measure([&] { CreateSphere(1, size, size, &vertices, &indices, jobs); });
+
+			float maxDifference = 0.0f;
+			bool identical = indices == referenceIndices;
+			for (size_t i = 0; i < vertices.size(); i++) {
+				glm::vec3 difference = glm::abs(vertices[i].pos - referenceVertices[i].pos);
+				maxDifference = std::max(maxDifference, std::max(difference.x, std::max(difference.y, difference.z)));
+				identical = identical && vertices[i].texCoord[0] == referenceVertices[i].texCoord[0] && vertices[i].texCoord[1] == referenceVertices[i].texCoord[1];
+			}
+
+			double vertexCount = static_cast<double>(vertices.size());
+			out << std::left << std::setw(12) << resolution << std::right << std::setw(8) << threads << std::fixed
+				<< std::setw(14) << std::setprecision(3) << referenceTime
+				<< std::setw(14) << std::setprecision(1) << vertexCount / referenceTime * 1e-3
+				<< std::setw(10) << std::setprecision(3) << time
+				<< std::setw(14) << std::setprecision(1) << vertexCount / time * 1e-3
+				<< std::setw(9) << std::setprecision(2) << referenceTime / time << "x"
+				<< std::setw(14) << std::scientific << std::setprecision(2) << maxDifference
+				<< std::setw(11) << (identical ? "yes" : "no") << std::endl;
+		}
+		jobs.Shutdown();
+	}
+}
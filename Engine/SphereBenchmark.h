@@ -0,0 +1,18 @@
+#pragma once
+
+// System Headers
+#include <cstdint>
+#include <ostream>
+
+namespace Engine {
+
+	/*
+	* UV sphere generation microbenchmark, run by --bench-sphere. Times
+	* CreateSphere against the per-vertex sine and cosine version it replaced
+	* at several resolutions, with 1 thread and with maxThreads, and reports
+	* the best of several runs in vertices per second, with the largest position
+	* difference between both versions' output and whether their texture
+	* coordinates and indices are identical
+	*/
+	void RunSphereBenchmarks(uint32_t maxThreads, std::ostream& out);
+}
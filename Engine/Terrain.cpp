@@ -0,0 +1,366 @@
+// User-defined Headers
+#include "Terrain.h"
+#include "Profiler.h"
+
+// System Headers
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	const double kPi = 3.14159265358979323846;
+
+	// Patches with grid cells smaller than this decode whole .hgt tiles
+	const double kDecodeBelowDegrees = 0.02;
+
+	// SRTM marks missing measurements with this value
+	const int16_t kVoidHeight = -32768;
+
+	int TileKey(int latitude, int longitude)
+	{
+		return (latitude + 90) * 360 + (longitude + 180);
+	}
+
+	/*
+	* Inverse of the texture mapping of the globe, so heights line up with
+	* Textures/Earth.png: u = 0 is 180 degrees west, v = 0 the north pole
+	*/
+	void DirectionToLatLon(const glm::vec3& direction, double& latitude, double& longitude)
+	{
+		double u = -std::atan2(direction.z, direction.x) / (2.0 * kPi);
+		u -= std::floor(u);
+		double v = std::acos(std::max(-1.0, std::min(1.0, double(direction.y)))) / kPi;
+
+		longitude = std::min(u * 360.0 - 180.0, 179.999999);
+		latitude = std::max(-89.999999, std::min(89.999999, 90.0 - v * 180.0));
+	}
+}
+
+float Engine::HgtTile::Sample(double lat, double lon) const
+{
+	if (size == 0) return 0.0f;
+
+	// Row 0 is the northern edge, adjacent tiles share their border rows and columns
+	double y = (latitude + 1 - lat) * (size - 1);
+	double x = (lon - longitude) * (size - 1);
+	y = std::max(0.0, std::min(y, double(size - 1)));
+	x = std::max(0.0, std::min(x, double(size - 1)));
+
+	uint32_t x0 = std::min(static_cast<uint32_t>(x), size - 2);
+	uint32_t y0 = std::min(static_cast<uint32_t>(y), size - 2);
+	float fx = static_cast<float>(x - x0);
+	float fy = static_cast<float>(y - y0);
+
+	const int16_t* row0 = heights.data() + y0 * size;
+	const int16_t* row1 = row0 + size;
+	float top = row0[x0] + (row0[x0 + 1] - row0[x0]) * fx;
+	float bottom = row1[x0] + (row1[x0 + 1] - row1[x0]) * fx;
+	return top + (bottom - top) * fy;
+}
+
+Engine::Terrain::~Terrain()
+{
+	Shutdown();
+}
+
+void Engine::Terrain::Init(const std::string& terrainDirectory, size_t cacheLimit, uint32_t patchCapacity, JobSystem* jobs)
+{
+	directory = terrainDirectory;
+	cacheBytes = cacheLimit;
+	jobSystem = jobs;
+	slotHeights.assign(size_t(patchCapacity) * kTileSize * kTileSize, 0.0f);
+
+	if (directory.empty()) return;
+
+	std::cout << "Terrain: streaming elevation from " << directory << " on " << jobSystem->GetThreadCount() - 1 << " worker thread(s)" << std::endl;
+}
+
+void Engine::Terrain::Shutdown()
+{
+	if (!jobSystem) return;
+
+	// Background jobs finding the queue empty return right away
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.clear();
+	}
+	jobSystem->Wait(runningJobs);
+	jobSystem = nullptr;
+}
+
+void Engine::Terrain::OnPatchGenerated(const PatchKey& key, uint32_t slot, int32_t parentSlot)
+{
+	const uint32_t n = kTileSize - 1;
+	float* heights = slotHeights.data() + slot * kTileSize * kTileSize;
+
+	/*
+	* Until the exact heights arrive, the patch shows the heights of the quarter
+	* of its parent it covers, which is exactly what was on screen before
+	*/
+	if (parentSlot < 0) {
+		std::fill(heights, heights + kTileSize * kTileSize, 0.0f);
+	}
+	else {
+		const float* parent = GetHeights(static_cast<uint32_t>(parentSlot));
+		uint32_t offsetX = (key.x & 1) * n;
+		uint32_t offsetY = (key.y & 1) * n;
+		for (uint32_t j = 0; j <= n; j++) {
+			for (uint32_t i = 0; i <= n; i++) {
+				uint32_t px = (offsetX + i) / 2;
+				uint32_t py = (offsetY + j) / 2;
+				uint32_t qx = (offsetX + i + 1) / 2;
+				uint32_t qy = (offsetY + j + 1) / 2;
+				heights[j * kTileSize + i] = 0.25f * (parent[py * kTileSize + px] + parent[py * kTileSize + qx] +
+					parent[qy * kTileSize + px] + parent[qy * kTileSize + qx]);
+			}
+		}
+	}
+
+	if (directory.empty()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back({ key, slot });
+	}
+	jobSystem->RunBackground([this] { RunJob(); }, &runningJobs);
+}
+
+void Engine::Terrain::CollectFinished(const std::function<bool(const PatchKey&, uint32_t)>& isResident, std::vector<uint32_t>& changedSlots)
+{
+	std::vector<Result> finished;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		finished.swap(results);
+	}
+
+	for (const auto& result : finished) {
+		if (!isResident(result.key, result.slot)) continue;
+
+		std::copy(result.heights.begin(), result.heights.end(), slotHeights.begin() + result.slot * kTileSize * kTileSize);
+		changedSlots.push_back(result.slot);
+	}
+}
+
+Engine::Terrain::Stats Engine::Terrain::GetStats()
+{
+	Stats stats;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		stats.cachedTiles = tileCache.size();
+		stats.cachedBytes = cachedBytes;
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stats.pendingPatches = jobs.size();
+	}
+	return stats;
+}
+
+void Engine::Terrain::RunJob()
+{
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		if (jobs.empty()) return;
+
+		// Newest first, older requests may belong to patches the camera has already left
+		job = jobs.back();
+		jobs.pop_back();
+	}
+
+	Result result = { job.key, job.slot, std::vector<float>(kTileSize * kTileSize) };
+	ComputePatchHeights(job.key, result.heights.data());
+
+	std::lock_guard<std::mutex> lock(jobMutex);
+	results.push_back(std::move(result));
+}
+
+void Engine::Terrain::ComputePatchHeights(const PatchKey& key, float* heights)
+{
+	PROFILE_SCOPE("ComputePatchHeights");
+	const uint32_t n = kTileSize - 1;
+	double cellDegrees = 90.0 / double(1u << key.level) / n;
+	bool decodeTiles = cellDegrees < kDecodeBelowDegrees;
+
+	// Samples of a coarse patch, read once all are known so that every tile file is opened once
+	struct CoarseSample {
+		uint32_t index;
+		int tileKey;
+		double latitude;
+		double longitude;
+	};
+	std::vector<CoarseSample> coarseSamples;
+
+	std::shared_ptr<const HgtTile> tile;
+	for (uint32_t j = 0; j <= n; j++) {
+		for (uint32_t i = 0; i <= n; i++) {
+			double latitude, longitude;
+			DirectionToLatLon(CubeSphere::PatchDirection(key, i / float(n), j / float(n)), latitude, longitude);
+
+			int tileLatitude = static_cast<int>(std::floor(latitude));
+			int tileLongitude = static_cast<int>(std::floor(longitude));
+			if (!decodeTiles) {
+				coarseSamples.push_back({ j * kTileSize + i, TileKey(tileLatitude, tileLongitude), latitude, longitude });
+				continue;
+			}
+
+			// A fine patch touches very few tiles, keep the last one at hand
+			if (!tile || tile->latitude != tileLatitude || tile->longitude != tileLongitude) {
+				tile = GetTile(tileLatitude, tileLongitude);
+			}
+			heights[j * kTileSize + i] = tile->Sample(latitude, longitude);
+		}
+	}
+
+	// A coarse patch spreads over many tiles, its samples are read grouped by tile with the tile's file kept open
+	std::stable_sort(coarseSamples.begin(), coarseSamples.end(),
+		[](const CoarseSample& a, const CoarseSample& b) { return a.tileKey < b.tileKey; });
+	TileFile tileFile;
+	for (size_t s = 0; s < coarseSamples.size(); s++) {
+		const CoarseSample& sample = coarseSamples[s];
+		if (s == 0 || sample.tileKey != coarseSamples[s - 1].tileKey) {
+			CloseTileFile(tileFile);
+			OpenTileFile(static_cast<int>(std::floor(sample.latitude)), static_cast<int>(std::floor(sample.longitude)), tileFile);
+		}
+		heights[sample.index] = ReadHeight(tileFile, sample.latitude, sample.longitude);
+	}
+	CloseTileFile(tileFile);
+}
+
+std::shared_ptr<const Engine::HgtTile> Engine::Terrain::GetTile(int latitude, int longitude)
+{
+	int key = TileKey(latitude, longitude);
+
+	std::unique_lock<std::mutex> lock(cacheMutex);
+	for (;;) {
+		auto it = tileCache.find(key);
+		if (it != tileCache.end()) {
+			lruOrder.splice(lruOrder.begin(), lruOrder, it->second.lruPosition);
+			return it->second.tile;
+		}
+		if (loadingTiles.count(key) == 0) break;
+		tileLoaded.wait(lock);
+	}
+	loadingTiles.insert(key);
+	lock.unlock();
+
+	std::shared_ptr<const HgtTile> tile = LoadTile(latitude, longitude);
+
+	lock.lock();
+	loadingTiles.erase(key);
+	lruOrder.push_front(key);
+	tileCache[key] = { tile, lruOrder.begin() };
+	cachedBytes += tile->heights.size() * sizeof(int16_t);
+
+	// Tiles still referenced by other jobs stay alive until they are done with them
+	while (cachedBytes > cacheBytes && lruOrder.size() > 1) {
+		auto evicted = tileCache.find(lruOrder.back());
+		cachedBytes -= evicted->second.tile->heights.size() * sizeof(int16_t);
+		tileCache.erase(evicted);
+		lruOrder.pop_back();
+	}
+	tileLoaded.notify_all();
+	return tile;
+}
+
+std::shared_ptr<const Engine::HgtTile> Engine::Terrain::LoadTile(int latitude, int longitude)
+{
+	auto tile = std::make_shared<HgtTile>();
+	tile->latitude = latitude;
+	tile->longitude = longitude;
+
+	std::ifstream file(TilePath(latitude, longitude), std::ios::ate | std::ios::binary);
+	if (!file.is_open()) return tile;
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	uint32_t size = static_cast<uint32_t>(std::lround(std::sqrt(fileSize / 2.0)));
+	if (size < 2 || size_t(size) * size * 2 != fileSize) {
+		std::cerr << "Terrain: ignoring " << TilePath(latitude, longitude) << ", not a square grid of 16-bit heights" << std::endl;
+		return tile;
+	}
+
+	std::vector<uint8_t> bytes(fileSize);
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(bytes.data()), fileSize);
+
+	tile->size = size;
+	tile->heights.resize(size_t(size) * size);
+	for (size_t i = 0; i < tile->heights.size(); i++) {
+		int16_t height = static_cast<int16_t>((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+		tile->heights[i] = height == kVoidHeight ? 0 : height;
+	}
+	return tile;
+}
+
+void Engine::Terrain::OpenTileFile(int latitude, int longitude, TileFile& tileFile)
+{
+	int key = TileKey(latitude, longitude);
+	tileFile.latitude = latitude;
+	tileFile.longitude = longitude;
+	tileFile.size = 0;
+
+	uint32_t size = 0;
+	bool known = false;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto it = tileFileSizes.find(key);
+		if (it != tileFileSizes.end()) {
+			size = it->second;
+			known = true;
+		}
+	}
+	if (known && size == 0) return;
+
+	FILE* file = std::fopen(TilePath(latitude, longitude).c_str(), "rb");
+	if (!known) {
+		if (file) {
+			std::fseek(file, 0, SEEK_END);
+			long fileSize = std::ftell(file);
+			size = static_cast<uint32_t>(std::lround(std::sqrt(fileSize / 2.0)));
+			if (size < 2 || long(size) * size * 2 != fileSize) size = 0;
+		}
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		tileFileSizes[key] = size;
+	}
+	if (file && size == 0) {
+		std::fclose(file);
+		return;
+	}
+	tileFile.file = file;
+	tileFile.size = file ? size : 0;
+}
+
+void Engine::Terrain::CloseTileFile(TileFile& tileFile)
+{
+	if (tileFile.file) {
+		std::fclose(tileFile.file);
+	}
+	tileFile = TileFile();
+}
+
+float Engine::Terrain::ReadHeight(const TileFile& tileFile, double latitude, double longitude)
+{
+	if (!tileFile.file) return 0.0f;
+
+	// Nearest sample, coarse patches are far apart compared to the grid spacing
+	uint32_t size = tileFile.size;
+	long row = std::lround((tileFile.latitude + 1 - latitude) * (size - 1));
+	long column = std::lround((longitude - tileFile.longitude) * (size - 1));
+	uint8_t bytes[2] = { 0, 0 };
+	std::fseek(tileFile.file, (row * size + column) * 2, SEEK_SET);
+	size_t read = std::fread(bytes, 1, 2, tileFile.file);
+
+	int16_t height = static_cast<int16_t>((bytes[0] << 8) | bytes[1]);
+	return (read != 2 || height == kVoidHeight) ? 0.0f : float(height);
+}
+
+std::string Engine::Terrain::TilePath(int latitude, int longitude) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%c%02d%c%03d.hgt",
+		latitude < 0 ? 'S' : 'N', std::abs(latitude),
+		longitude < 0 ? 'W' : 'E', std::abs(longitude));
+	return directory + "/" + name;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// User-defined Headers
+#include "CubeSphere.h"
+#include "JobSystem.h"
+
+// System Headers
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+
+namespace Engine {
+
+	/*
+	* One 1x1 degree SRTM .hgt elevation tile: size x size big endian int16
+	* heights in meters, rows from north to south. size is 0 for tiles without
+	* a file, which are ocean at sea level
+	*/
+	struct HgtTile {
+		int latitude = 0;
+		int longitude = 0;
+		uint32_t size = 0;
+		std::vector<int16_t> heights;
+
+		float Sample(double latitude, double longitude) const;
+	};
+
+	/*
+	* Elevation of the globe patches, read from a directory of SRTM style
+	* .hgt files (N37W123.hgt covers 37..38 N, 123..122 W).
+	*
+	* Every patch resident in the CubeSphere vertex pool owns a
+	* kTileSize x kTileSize height tile, one height per patch grid vertex.
+	* A new patch immediately gets the heights of its parent upsampled, background
+	* jobs then sample the DEM at the patch vertices and hand back the exact
+	* tile, so the main thread never waits for disk I/O.
+	*
+	* Fine patches sample decoded .hgt tiles kept in an LRU cache bounded by
+	* cacheBytes. Coarse patches spread their samples over far too many files
+	* to decode them all, they read single heights straight from the files
+	*/
+	class Terrain {
+	public:
+		static const uint32_t kTileSize = CubeSphere::kPatchResolution + 1;
+		// Mount Everest, bounds the displacement for culling
+		static constexpr float kMaxElevation = 8848.0f;
+
+		~Terrain();
+
+		// An empty directory keeps the globe at sea level
+		void Init(const std::string& directory, size_t cacheBytes, uint32_t patchCapacity, JobSystem* jobSystem);
+		void Shutdown();
+
+		// A patch was written into slot, parentSlot is -1 for root patches
+		void OnPatchGenerated(const PatchKey& key, uint32_t slot, int32_t parentSlot);
+
+		/*
+		* Moves finished height tiles into their slots and appends those slots to
+		* changedSlots. Tiles of patches that were evicted in the meantime are
+		* dropped, isResident tells whether the patch still occupies the slot
+		*/
+		void CollectFinished(const std::function<bool(const PatchKey&, uint32_t)>& isResident, std::vector<uint32_t>& changedSlots);
+
+		// kTileSize * kTileSize heights in meters
+		const float* GetHeights(uint32_t slot) const { return slotHeights.data() + slot * kTileSize * kTileSize; }
+
+		struct Stats {
+			size_t cachedTiles = 0;
+			size_t cachedBytes = 0;
+			size_t pendingPatches = 0;
+		};
+		Stats GetStats();
+
+	private:
+		struct Job {
+			PatchKey key;
+			uint32_t slot;
+		};
+
+		struct Result {
+			PatchKey key;
+			uint32_t slot;
+			std::vector<float> heights;
+		};
+
+		// Background job computing the newest queued patch
+		void RunJob();
+		void ComputePatchHeights(const PatchKey& key, float* heights);
+
+		// Decoded tile through the LRU cache, loads it on the calling thread if needed
+		std::shared_ptr<const HgtTile> GetTile(int latitude, int longitude);
+		std::shared_ptr<const HgtTile> LoadTile(int latitude, int longitude);
+		/*
+		* A tile file kept open while the samples of a coarse patch that fall
+		* into it are read. size is 0 if the file is missing or not a grid of heights
+		*/
+		struct TileFile {
+			int latitude = 0;
+			int longitude = 0;
+			FILE* file = nullptr;
+			uint32_t size = 0;
+		};
+		void OpenTileFile(int latitude, int longitude, TileFile& tileFile);
+		void CloseTileFile(TileFile& tileFile);
+		// Single height read from an open tile file, for samples far apart from each other
+		float ReadHeight(const TileFile& tileFile, double latitude, double longitude);
+		std::string TilePath(int latitude, int longitude) const;
+
+		std::string directory;
+		size_t cacheBytes = 0;
+
+		std::vector<float> slotHeights;
+
+		// Jobs and results, guarded by jobMutex. Every queued job has one background job to run it
+		JobSystem* jobSystem = nullptr;
+		JobCounter runningJobs;
+		std::deque<Job> jobs;
+		std::vector<Result> results;
+		std::mutex jobMutex;
+
+		/*
+		* LRU cache of decoded tiles, most recently used at the front, guarded by
+		* cacheMutex. A tile being loaded by one job is waited for by the others
+		*/
+		struct CacheEntry {
+			std::shared_ptr<const HgtTile> tile;
+			std::list<int>::iterator lruPosition;
+		};
+		std::unordered_map<int, CacheEntry> tileCache;
+		std::list<int> lruOrder;
+		std::unordered_set<int> loadingTiles;
+		// Size of every tile file opened so far, 0 if there is no file
+		std::unordered_map<int, uint32_t> tileFileSizes;
+		size_t cachedBytes = 0;
+		std::mutex cacheMutex;
+		std::condition_variable tileLoaded;
+	};
+}
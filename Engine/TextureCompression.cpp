@@ -0,0 +1,582 @@
+// User-defined Headers
+#include "TextureCompression.h"
+#include "Mipmaps.h"
+
+// External Headers
+#include <stb_image.h>
+
+// System Headers
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace {
+	// Block rows per thread below which starting more threads does not pay off
+	const uint32_t kBlockRowsPerThread = 16;
+
+	// Interpolation weights of the 4-bit BC7 indices, out of 64
+	const int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	const uint8_t kKtx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+	const size_t kKtx2HeaderBytes = 80;
+	const size_t kKtx2LevelIndexBytes = 24;
+	// Key of the source stamp in the key/value data, keys starting with KTX are reserved
+	const char kKtx2SourceKey[] = "EngineSource";
+
+	// Khronos data format descriptor color models and transfer functions
+	const uint32_t kDfdModelBC4 = 131;
+	const uint32_t kDfdModelBC5 = 132;
+	const uint32_t kDfdModelBC7 = 134;
+	const uint32_t kDfdPrimariesBT709 = 1;
+	const uint32_t kDfdTransferLinear = 1;
+
+	// Writes values into a zeroed block, least significant bit first
+	struct BitWriter {
+		uint8_t* block;
+		uint32_t position = 0;
+
+		explicit BitWriter(uint8_t* block) : block(block) {}
+
+		void Write(uint32_t value, uint32_t bits)
+		{
+			for (uint32_t i = 0; i < bits; i++, position++) {
+				if ((value >> i) & 1) {
+					block[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+				}
+			}
+		}
+	};
+
+	/*
+	* Quantizes the endpoints to 7 bits plus the given p-bits, picks the closest
+	* palette entry for every texel and returns the total squared error
+	*/
+	uint32_t FitMode6(const uint8_t texels[16][4], const float endpoint0[4], const float endpoint1[4], uint32_t p0, uint32_t p1,
+		uint8_t quantized0[4], uint8_t quantized1[4], uint8_t indices[16])
+	{
+		int end0[4], end1[4], axis[4];
+		int axisLength = 0;
+		for (int c = 0; c < 4; c++) {
+			quantized0[c] = static_cast<uint8_t>(std::max(0l, std::min(127l, std::lround((endpoint0[c] - p0) * 0.5f))));
+			quantized1[c] = static_cast<uint8_t>(std::max(0l, std::min(127l, std::lround((endpoint1[c] - p1) * 0.5f))));
+			end0[c] = quantized0[c] * 2 + p0;
+			end1[c] = quantized1[c] * 2 + p1;
+			axis[c] = end1[c] - end0[c];
+			axisLength += axis[c] * axis[c];
+		}
+
+		int palette[16][4];
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 4; c++) {
+				palette[i][c] = ((64 - kWeights4[i]) * end0[c] + kWeights4[i] * end1[c] + 32) >> 6;
+			}
+		}
+
+		uint32_t totalError = 0;
+		for (int t = 0; t < 16; t++) {
+			// The palette lies on the endpoint axis, so only the entries around the projection can be closest
+			int guess = 0;
+			if (axisLength > 0) {
+				int projection = 0;
+				for (int c = 0; c < 4; c++) {
+					projection += (texels[t][c] - end0[c]) * axis[c];
+				}
+				guess = std::max(0, std::min(15, static_cast<int>(std::floor(projection * 15.0f / axisLength + 0.5f))));
+			}
+
+			uint32_t bestError = UINT32_MAX;
+			for (int i = std::max(0, guess - 1); i <= std::min(15, guess + 1); i++) {
+				uint32_t error = 0;
+				for (int c = 0; c < 4; c++) {
+					int difference = texels[t][c] - palette[i][c];
+					error += difference * difference;
+				}
+				if (error < bestError) {
+					bestError = error;
+					indices[t] = static_cast<uint8_t>(i);
+				}
+			}
+			totalError += bestError;
+		}
+		return totalError;
+	}
+
+	struct Mode6Fit {
+		uint32_t error = UINT32_MAX;
+		uint8_t quantized0[4];
+		uint8_t quantized1[4];
+		uint32_t p0;
+		uint32_t p1;
+		uint8_t indices[16];
+	};
+
+	// Tries all four p-bit combinations for the endpoints and keeps the best one in fit
+	void FitMode6PBits(const uint8_t texels[16][4], const float endpoint0[4], const float endpoint1[4], Mode6Fit& fit)
+	{
+		for (uint32_t p = 0; p < 4; p++) {
+			Mode6Fit candidate;
+			candidate.p0 = p & 1;
+			candidate.p1 = p >> 1;
+			candidate.error = FitMode6(texels, endpoint0, endpoint1, candidate.p0, candidate.p1,
+				candidate.quantized0, candidate.quantized1, candidate.indices);
+			if (candidate.error < fit.error) {
+				fit = candidate;
+			}
+		}
+	}
+
+	/*
+	* BC7 mode 6: a single RGBA line segment with 7-bit endpoints, a p-bit each
+	* and 4-bit indices. It is the mode that suits smooth imagery like the
+	* Earth texture best, and on its own reaches most of the quality of a full
+	* BC7 mode search at a small fraction of the cost
+	*/
+	void EncodeBC7Block(const uint8_t texels[16][4], uint8_t* block)
+	{
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int t = 0; t < 16; t++) {
+			for (int c = 0; c < 4; c++) {
+				mean[c] += texels[t][c] / 16.0f;
+			}
+		}
+
+		float covariance[4][4] = {};
+		for (int t = 0; t < 16; t++) {
+			float d[4];
+			for (int c = 0; c < 4; c++) {
+				d[c] = texels[t][c] - mean[c];
+			}
+			for (int i = 0; i < 4; i++) {
+				for (int j = 0; j < 4; j++) {
+					covariance[i][j] += d[i] * d[j];
+				}
+			}
+		}
+
+		// Principal axis by power iteration, starting from the channel that varies most
+		int start = 0;
+		for (int c = 1; c < 4; c++) {
+			if (covariance[c][c] > covariance[start][start]) start = c;
+		}
+		float axis[4] = { covariance[start][0], covariance[start][1], covariance[start][2], covariance[start][3] };
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float length = 0.0f;
+			for (int i = 0; i < 4; i++) {
+				for (int j = 0; j < 4; j++) {
+					next[i] += covariance[i][j] * axis[j];
+				}
+				length += next[i] * next[i];
+			}
+			if (length < 1e-12f) break;
+			length = 1.0f / std::sqrt(length);
+			for (int c = 0; c < 4; c++) {
+				axis[c] = next[c] * length;
+			}
+		}
+		float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+		if (axisLength > 0.0f) {
+			axisLength = 1.0f / std::sqrt(axisLength);
+			for (int c = 0; c < 4; c++) {
+				axis[c] *= axisLength;
+			}
+		}
+
+		float minimum = 0.0f, maximum = 0.0f;
+		for (int t = 0; t < 16; t++) {
+			float projection = 0.0f;
+			for (int c = 0; c < 4; c++) {
+				projection += (texels[t][c] - mean[c]) * axis[c];
+			}
+			minimum = std::min(minimum, projection);
+			maximum = std::max(maximum, projection);
+		}
+
+		float endpoint0[4], endpoint1[4];
+		for (int c = 0; c < 4; c++) {
+			endpoint0[c] = std::max(0.0f, std::min(255.0f, mean[c] + minimum * axis[c]));
+			endpoint1[c] = std::max(0.0f, std::min(255.0f, mean[c] + maximum * axis[c]));
+		}
+
+		Mode6Fit fit;
+		FitMode6PBits(texels, endpoint0, endpoint1, fit);
+
+		// One least squares refit of the endpoints to the chosen indices
+		if (fit.error > 0) {
+			float a = 0.0f, b = 0.0f, d = 0.0f;
+			float x0[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float x1[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int t = 0; t < 16; t++) {
+				float w = kWeights4[fit.indices[t]] / 64.0f;
+				a += (1.0f - w) * (1.0f - w);
+				b += (1.0f - w) * w;
+				d += w * w;
+				for (int c = 0; c < 4; c++) {
+					x0[c] += (1.0f - w) * texels[t][c];
+					x1[c] += w * texels[t][c];
+				}
+			}
+			float determinant = a * d - b * b;
+			if (std::fabs(determinant) > 1e-6f) {
+				for (int c = 0; c < 4; c++) {
+					endpoint0[c] = std::max(0.0f, std::min(255.0f, (d * x0[c] - b * x1[c]) / determinant));
+					endpoint1[c] = std::max(0.0f, std::min(255.0f, (a * x1[c] - b * x0[c]) / determinant));
+				}
+				FitMode6PBits(texels, endpoint0, endpoint1, fit);
+			}
+		}
+
+		// The anchor index is stored without its top bit, so it must be below 8
+		if (fit.indices[0] >= 8) {
+			std::swap(fit.quantized0, fit.quantized1);
+			std::swap(fit.p0, fit.p1);
+			for (int t = 0; t < 16; t++) {
+				fit.indices[t] = static_cast<uint8_t>(15 - fit.indices[t]);
+			}
+		}
+
+		std::memset(block, 0, 16);
+		BitWriter writer(block);
+		writer.Write(1 << 6, 7);
+		for (int c = 0; c < 4; c++) {
+			writer.Write(fit.quantized0[c], 7);
+			writer.Write(fit.quantized1[c], 7);
+		}
+		writer.Write(fit.p0, 1);
+		writer.Write(fit.p1, 1);
+		writer.Write(fit.indices[0], 3);
+		for (int t = 1; t < 16; t++) {
+			writer.Write(fit.indices[t], 4);
+		}
+	}
+
+	/*
+	* BC4 with the 8 value palette: the block's maximum and minimum as
+	* endpoints and every texel snapped to the nearest of the 8 steps between them
+	*/
+	void EncodeBC4Block(const uint8_t values[16], uint8_t* block)
+	{
+		uint8_t minimum = *std::min_element(values, values + 16);
+		uint8_t maximum = *std::max_element(values, values + 16);
+		block[0] = maximum;
+		block[1] = minimum;
+
+		uint64_t bits = 0;
+		int range = maximum - minimum;
+		if (range > 0) {
+			for (int t = 0; t < 16; t++) {
+				// Step 0 is the maximum, step 7 the minimum, indices 0 and 1 hold the endpoints themselves
+				int step = ((maximum - values[t]) * 14 + range) / (2 * range);
+				uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+				bits |= index << (3 * t);
+			}
+		}
+		for (int i = 0; i < 6; i++) {
+			block[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+		}
+	}
+
+	void CompressBlockRows(Engine::BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height,
+		uint8_t* blocks, uint32_t firstRow, uint32_t lastRow)
+	{
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blockBytes = Engine::GetBlockBytes(format);
+		for (uint32_t by = firstRow; by < lastRow; by++) {
+			for (uint32_t bx = 0; bx < blocksX; bx++) {
+				uint8_t texels[16][4];
+				for (uint32_t t = 0; t < 16; t++) {
+					uint32_t x = std::min(bx * 4 + t % 4, width - 1);
+					uint32_t y = std::min(by * 4 + t / 4, height - 1);
+					std::memcpy(texels[t], rgba + (size_t(y) * width + x) * 4, 4);
+				}
+
+				uint8_t* block = blocks + (size_t(by) * blocksX + bx) * blockBytes;
+				if (format == Engine::BlockFormat::BC7) {
+					EncodeBC7Block(texels, block);
+					continue;
+				}
+
+				// BC4 compresses the red channel, BC5 red and green as two BC4 blocks
+				for (uint32_t channel = 0; channel < blockBytes / 8; channel++) {
+					uint8_t values[16];
+					for (uint32_t t = 0; t < 16; t++) {
+						values[t] = texels[t][channel];
+					}
+					EncodeBC4Block(values, block + 8 * channel);
+				}
+			}
+		}
+	}
+
+	void Append32(std::vector<uint8_t>& bytes, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++) {
+			bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	void Append64(std::vector<uint8_t>& bytes, uint64_t value)
+	{
+		Append32(bytes, static_cast<uint32_t>(value));
+		Append32(bytes, static_cast<uint32_t>(value >> 32));
+	}
+
+	uint32_t Read32(const std::vector<uint8_t>& bytes, size_t offset)
+	{
+		return bytes[offset] | (bytes[offset + 1] << 8) | (bytes[offset + 2] << 16) | (uint32_t(bytes[offset + 3]) << 24);
+	}
+
+	uint64_t Read64(const std::vector<uint8_t>& bytes, size_t offset)
+	{
+		return Read32(bytes, offset) | (uint64_t(Read32(bytes, offset + 4)) << 32);
+	}
+
+	bool FindBlockFormat(VkFormat vkFormat, Engine::BlockFormat& format)
+	{
+		for (Engine::BlockFormat candidate : { Engine::BlockFormat::BC7, Engine::BlockFormat::BC4, Engine::BlockFormat::BC5 }) {
+			if (Engine::GetVkFormat(candidate) == vkFormat) {
+				format = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t LevelBytes(Engine::BlockFormat format, uint32_t width, uint32_t height)
+	{
+		return size_t((width + 3) / 4) * ((height + 3) / 4) * Engine::GetBlockBytes(format);
+	}
+}
+
+VkFormat Engine::GetVkFormat(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC4: return VK_FORMAT_BC4_UNORM_BLOCK;
+	case BlockFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+	default: return VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+}
+
+uint32_t Engine::GetBlockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC4 ? 8 : 16;
+}
+
+std::vector<uint8_t> Engine::CompressImage(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	uint32_t blocksY = (height + 3) / 4;
+	std::vector<uint8_t> blocks(LevelBytes(format, width, height));
+
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t chunks = std::min(threadCount, std::max(1u, blocksY / kBlockRowsPerThread));
+	uint32_t rowsPerChunk = (blocksY + chunks - 1) / chunks;
+	std::vector<std::thread> threads;
+	for (uint32_t chunk = 1; chunk < chunks; chunk++) {
+		uint32_t firstRow = chunk * rowsPerChunk;
+		uint32_t lastRow = std::min(firstRow + rowsPerChunk, blocksY);
+		threads.emplace_back(CompressBlockRows, format, rgba, width, height, blocks.data(), firstRow, lastRow);
+	}
+	CompressBlockRows(format, rgba, width, height, blocks.data(), 0, std::min(rowsPerChunk, blocksY));
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	return blocks;
+}
+
+Engine::KtxTexture Engine::CompressTexture(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	std::vector<uint8_t> chain;
+	std::vector<MipLevel> mipLevels = GenerateMipChain(rgba, width, height, chain);
+
+	KtxTexture texture;
+	texture.format = GetVkFormat(format);
+	texture.width = width;
+	texture.height = height;
+	for (const MipLevel& mipLevel : mipLevels) {
+		std::vector<uint8_t> blocks = CompressImage(format, chain.data() + mipLevel.offset, mipLevel.width, mipLevel.height);
+		texture.levels.push_back({ mipLevel.width, mipLevel.height, texture.data.size(), blocks.size() });
+		texture.data.insert(texture.data.end(), blocks.begin(), blocks.end());
+	}
+	return texture;
+}
+
+Engine::KtxTexture Engine::CompressImageFile(BlockFormat format, const std::string& sourceImage)
+{
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(sourceImage.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("Failed to load " + sourceImage + "!");
+	}
+	KtxTexture texture = CompressTexture(format, pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+	stbi_image_free(pixels);
+	texture.source = GetSourceStamp(sourceImage);
+	return texture;
+}
+
+std::string Engine::GetSourceStamp(const std::string& filename)
+{
+	struct stat status;
+	if (stat(filename.c_str(), &status) != 0) {
+		return std::string();
+	}
+	return std::to_string(static_cast<long long>(status.st_size)) + " " + std::to_string(static_cast<long long>(status.st_mtime));
+}
+
+void Engine::WriteKTX2(const std::string& filename, const KtxTexture& texture)
+{
+	BlockFormat format;
+	if (!FindBlockFormat(texture.format, format)) {
+		throw std::runtime_error("KTX2 writer only supports BC4, BC5 and BC7 textures!");
+	}
+	uint32_t blockBytes = GetBlockBytes(format);
+	uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+
+	// Basic data format descriptor, one 64-bit sample per BC4 block or BC5 channel, one 128-bit sample for BC7
+	uint32_t model = format == BlockFormat::BC7 ? kDfdModelBC7 : format == BlockFormat::BC4 ? kDfdModelBC4 : kDfdModelBC5;
+	uint32_t sampleCount = format == BlockFormat::BC5 ? 2 : 1;
+	uint32_t sampleBits = format == BlockFormat::BC7 ? 128 : 64;
+	std::vector<uint8_t> dfd;
+	Append32(dfd, 4 + 24 + 16 * sampleCount);
+	Append32(dfd, 0);
+	Append32(dfd, 2 | ((24 + 16 * sampleCount) << 16));
+	Append32(dfd, model | (kDfdPrimariesBT709 << 8) | (kDfdTransferLinear << 16));
+	Append32(dfd, 3 | (3 << 8));
+	Append32(dfd, blockBytes);
+	Append32(dfd, 0);
+	for (uint32_t sample = 0; sample < sampleCount; sample++) {
+		// Bit offset, bit length - 1 and channel: red then green for BC5, channel 0 otherwise
+		Append32(dfd, (sample * sampleBits) | ((sampleBits - 1) << 16) | (sample << 24));
+		Append32(dfd, 0);
+		Append32(dfd, 0);
+		Append32(dfd, UINT32_MAX);
+	}
+
+	// One key/value entry for the source stamp, its length leaves out the padding to 4 bytes
+	std::vector<uint8_t> kvd;
+	if (!texture.source.empty()) {
+		Append32(kvd, static_cast<uint32_t>(sizeof(kKtx2SourceKey) + texture.source.size() + 1));
+		kvd.insert(kvd.end(), kKtx2SourceKey, kKtx2SourceKey + sizeof(kKtx2SourceKey));
+		kvd.insert(kvd.end(), texture.source.begin(), texture.source.end());
+		kvd.push_back(0);
+		kvd.resize((kvd.size() + 3) & ~size_t(3), 0);
+	}
+
+	size_t dfdOffset = kKtx2HeaderBytes + kKtx2LevelIndexBytes * levelCount;
+	size_t kvdOffset = dfdOffset + dfd.size();
+
+	// Level data follows, smallest level first, each one aligned to a block
+	std::vector<uint64_t> levelOffsets(levelCount);
+	size_t fileSize = kvdOffset + kvd.size();
+	for (uint32_t level = levelCount; level-- > 0;) {
+		fileSize = (fileSize + blockBytes - 1) / blockBytes * blockBytes;
+		levelOffsets[level] = fileSize;
+		fileSize += texture.levels[level].size;
+	}
+
+	std::vector<uint8_t> bytes(kKtx2Identifier, kKtx2Identifier + sizeof(kKtx2Identifier));
+	Append32(bytes, texture.format);
+	Append32(bytes, 1);
+	Append32(bytes, texture.width);
+	Append32(bytes, texture.height);
+	Append32(bytes, 0);
+	Append32(bytes, 0);
+	Append32(bytes, 1);
+	Append32(bytes, levelCount);
+	Append32(bytes, 0);
+	Append32(bytes, static_cast<uint32_t>(dfdOffset));
+	Append32(bytes, static_cast<uint32_t>(dfd.size()));
+	Append32(bytes, kvd.empty() ? 0 : static_cast<uint32_t>(kvdOffset));
+	Append32(bytes, static_cast<uint32_t>(kvd.size()));
+	Append64(bytes, 0);
+	Append64(bytes, 0);
+	for (uint32_t level = 0; level < levelCount; level++) {
+		Append64(bytes, levelOffsets[level]);
+		Append64(bytes, texture.levels[level].size);
+		Append64(bytes, texture.levels[level].size);
+	}
+	bytes.insert(bytes.end(), dfd.begin(), dfd.end());
+	bytes.insert(bytes.end(), kvd.begin(), kvd.end());
+
+	bytes.resize(fileSize, 0);
+	for (uint32_t level = 0; level < levelCount; level++) {
+		const KtxLevel& source = texture.levels[level];
+		std::memcpy(bytes.data() + levelOffsets[level], texture.data.data() + source.offset, source.size);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size())) {
+		throw std::runtime_error("Failed to write " + filename + "!");
+	}
+}
+
+bool Engine::ReadKTX2(const std::string& filename, KtxTexture& texture)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	if (bytes.size() < kKtx2HeaderBytes || std::memcmp(bytes.data(), kKtx2Identifier, sizeof(kKtx2Identifier)) != 0) {
+		throw std::runtime_error(filename + " is not a KTX2 file!");
+	}
+
+	BlockFormat format;
+	VkFormat vkFormat = static_cast<VkFormat>(Read32(bytes, 12));
+	uint32_t width = Read32(bytes, 20);
+	uint32_t height = Read32(bytes, 24);
+	uint32_t levelCount = Read32(bytes, 40);
+	bool plain2D = Read32(bytes, 28) == 0 && Read32(bytes, 32) == 0 && Read32(bytes, 36) == 1 && Read32(bytes, 44) == 0;
+	if (!FindBlockFormat(vkFormat, format) || !plain2D || width == 0 || height == 0 || levelCount == 0 ||
+		bytes.size() < kKtx2HeaderBytes + kKtx2LevelIndexBytes * levelCount) {
+		throw std::runtime_error(filename + " is not a BC4, BC5 or BC7 2D texture without supercompression!");
+	}
+	if (levelCount > MipLevelCount(width, height)) {
+		throw std::runtime_error(filename + " has more mip levels than a " + std::to_string(width) + "x" + std::to_string(height) + " texture!");
+	}
+
+	texture = KtxTexture();
+	texture.format = vkFormat;
+	texture.width = width;
+	texture.height = height;
+	for (uint32_t level = 0; level < levelCount; level++) {
+		size_t entry = kKtx2HeaderBytes + kKtx2LevelIndexBytes * level;
+		uint64_t offset = Read64(bytes, entry);
+		uint64_t length = Read64(bytes, entry + 8);
+
+		uint32_t levelWidth = std::max(width >> level, 1u);
+		uint32_t levelHeight = std::max(height >> level, 1u);
+		if (length != LevelBytes(format, levelWidth, levelHeight) || offset > bytes.size() || length > bytes.size() - offset) {
+			throw std::runtime_error(filename + " has a truncated or malformed mip level!");
+		}
+
+		texture.levels.push_back({ levelWidth, levelHeight, texture.data.size(), static_cast<size_t>(length) });
+		texture.data.insert(texture.data.end(), bytes.begin() + offset, bytes.begin() + offset + length);
+	}
+
+	// Entries are a 4-byte length, a null-terminated key and the value, padded to 4 bytes
+	size_t kvdOffset = Read32(bytes, 56);
+	size_t kvdEnd = kvdOffset + Read32(bytes, 60);
+	if (kvdEnd > bytes.size()) {
+		throw std::runtime_error(filename + " has truncated key/value data!");
+	}
+	for (size_t entry = kvdOffset; entry + 4 <= kvdEnd;) {
+		size_t length = Read32(bytes, entry);
+		if (length > kvdEnd - entry - 4) {
+			throw std::runtime_error(filename + " has malformed key/value data!");
+		}
+		const char* key = reinterpret_cast<const char*>(bytes.data() + entry + 4);
+		if (length > sizeof(kKtx2SourceKey) && std::memcmp(key, kKtx2SourceKey, sizeof(kKtx2SourceKey)) == 0) {
+			// The stored value ends with a null
+			texture.source.assign(key + sizeof(kKtx2SourceKey), length - sizeof(kKtx2SourceKey) - 1);
+		}
+		entry += 4 + ((length + 3) & ~size_t(3));
+	}
+	return true;
+}
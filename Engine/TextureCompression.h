@@ -0,0 +1,67 @@
+#pragma once
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Engine {
+
+	/*
+	* Block compressed formats the encoders below produce. BC7 is meant for
+	* color imagery, BC4 keeps only the red channel (masks, heights) and BC5
+	* the red and green channels (tangent space normals). All of them work on
+	* 4x4 texel blocks, BC7 and BC5 store 16 bytes per block, BC4 8 bytes
+	*/
+	enum class BlockFormat { BC7, BC4, BC5 };
+
+	VkFormat GetVkFormat(BlockFormat format);
+	uint32_t GetBlockBytes(BlockFormat format);
+
+	/*
+	* Compresses a tightly packed RGBA image. Edge blocks of images whose size is
+	* not a multiple of 4 repeat their last row and column. Rows of blocks are
+	* split across all hardware threads
+	*/
+	std::vector<uint8_t> CompressImage(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height);
+
+	struct KtxLevel {
+		uint32_t width;
+		uint32_t height;
+		// Byte offset of the level in KtxTexture::data
+		size_t offset;
+		size_t size;
+	};
+
+	// A single 2D texture with its mip levels, as stored in a KTX2 file
+	struct KtxTexture {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<KtxLevel> levels;
+		std::vector<uint8_t> data;
+		// GetSourceStamp of the image file the texture was compressed from, empty if unknown
+		std::string source;
+	};
+
+	// Builds the full mip chain of the image and compresses every level
+	KtxTexture CompressTexture(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height);
+	// Same for an image file stb_image can decode
+	KtxTexture CompressImageFile(BlockFormat format, const std::string& sourceImage);
+
+	// Size and modification time of a file, changing when it is replaced, empty if it does not exist
+	std::string GetSourceStamp(const std::string& filename);
+
+	/*
+	* Minimal KTX2 support for what CompressTexture produces: one face, one layer,
+	* no supercompression and a basic data format descriptor. The source stamp
+	* is stored in the key/value data under EngineSource. ReadKTX2 returns
+	* false if the file does not exist and throws if it is not such a texture
+	*/
+	void WriteKTX2(const std::string& filename, const KtxTexture& texture);
+	bool ReadKTX2(const std::string& filename, KtxTexture& texture);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <vector>
+#include <stdexcept>
+
+namespace Engine {
+
+	/*
+	* Ring allocator over a single persistently mapped uniform buffer.
+	*
+	* Every frame slot allocates its uniform data from the head of the ring.
+	* Once the fence of a frame slot has been waited on, BeginFrame releases
+	* everything that slot allocated the last time it was used, so the CPU never
+	* writes to memory the GPU may still be reading. Allocations are aligned to
+	* minUniformBufferOffsetAlignment and are meant to be bound with dynamic
+	* descriptor offsets, so any number of objects can share the one buffer.
+	*
+	* Offsets are tracked as ever-increasing virtual positions; the physical
+	* offset is the virtual position modulo the capacity.
+	*/
+	class UniformRing {
+	public:
+		void Init(void* mappedMemory, VkDeviceSize capacity, VkDeviceSize alignment, uint32_t frameCount) {
+			if (capacity % alignment != 0) {
+				throw std::invalid_argument("Uniform ring capacity must be a multiple of its alignment!");
+			}
+			pMapped = static_cast<char*>(mappedMemory);
+			ringCapacity = capacity;
+			ringAlignment = alignment;
+			head = tail = 0;
+			frameEnds.assign(frameCount, 0);
+			currentFrame = 0;
+		}
+
+		// Called after the fence of frameIndex has been waited on
+		void BeginFrame(uint32_t frameIndex) {
+			currentFrame = frameIndex;
+			// Frame slots complete in order, so the end of this slot's previous frame becomes the new tail
+			if (frameEnds[frameIndex] > tail) {
+				tail = frameEnds[frameIndex];
+			}
+			frameEnds[frameIndex] = head;
+		}
+
+		/*
+		* Returns the offset of an aligned sub-range of `size` bytes and
+		* writes a pointer to its mapped memory into pData
+		*/
+		VkDeviceSize Allocate(VkDeviceSize size, void** pData) {
+			VkDeviceSize offset = AlignUp(head, ringAlignment);
+
+			// Sub-ranges never straddle the end of the buffer, skip to the start instead
+			if (offset % ringCapacity + size > ringCapacity) {
+				offset = AlignUp(offset, ringCapacity);
+			}
+			if (offset + size - tail > ringCapacity) {
+				throw std::runtime_error("Uniform ring buffer exhausted!");
+			}
+
+			head = offset + size;
+			frameEnds[currentFrame] = head;
+
+			VkDeviceSize physicalOffset = offset % ringCapacity;
+			*pData = pMapped + physicalOffset;
+			return physicalOffset;
+		}
+
+		// Size of a single allocation rounded up to the ring alignment
+		VkDeviceSize AlignedSize(VkDeviceSize size) const {
+			return AlignUp(size, ringAlignment);
+		}
+
+	private:
+		static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		char* pMapped = nullptr;
+		VkDeviceSize ringCapacity = 0;
+		VkDeviceSize ringAlignment = 1;
+		VkDeviceSize head = 0;
+		VkDeviceSize tail = 0;
+		std::vector<VkDeviceSize> frameEnds;
+		uint32_t currentFrame = 0;
+	};
+}
@@ -0,0 +1,269 @@
+// User-defined Headers
+#include "UploadContext.h"
+
+// System Headers
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+	// Satisfies the offset rules of buffer to image copies for every format the renderer uploads
+	const VkDeviceSize kStagingAlignment = 16;
+
+	void CreateStagingBuffer(VkDevice device, Engine::MemoryAllocator& allocator, VkDeviceSize size, VkBuffer& buffer, Engine::Allocation& memory)
+	{
+		VkBufferCreateInfo bufferInfo = {};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload staging buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		memory = allocator.Allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
+		vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+	}
+}
+
+void Engine::UploadContext::Init(VkDevice logicalDevice, MemoryAllocator* memoryAllocator, VkQueue uploadQueue, uint32_t queueFamily, VkDeviceSize capacity)
+{
+	device = logicalDevice;
+	allocator = memoryAllocator;
+	queue = uploadQueue;
+	ringCapacity = AlignUp(capacity, kStagingAlignment);
+	head = tail = 0;
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	// Command buffers are reused once their batch has finished
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create upload Command Pool!");
+	}
+
+	CreateStagingBuffer(device, *allocator, ringCapacity, ringBuffer, ringMemory);
+}
+
+void Engine::UploadContext::Destroy()
+{
+	if (recording) {
+		SubmitBatch();
+	}
+	WaitIdle();
+
+	for (VkFence fence : freeFences) {
+		vkDestroyFence(device, fence, nullptr);
+	}
+	freeFences.clear();
+	freeCommandBuffers.clear();
+	vkDestroyCommandPool(device, commandPool, nullptr);
+
+	vkDestroyBuffer(device, ringBuffer, nullptr);
+	allocator->Free(ringMemory);
+}
+
+VkCommandBuffer Engine::UploadContext::Record()
+{
+	if (recording) {
+		return current.commandBuffer;
+	}
+
+	current = Batch();
+	if (freeCommandBuffers.empty()) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &current.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate upload Command Buffer!");
+		}
+	}
+	else {
+		current.commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(current.commandBuffer, &beginInfo);
+
+	recording = true;
+	return current.commandBuffer;
+}
+
+void Engine::UploadContext::CopyToBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	Stage(data, size, stagingBuffer, stagingOffset);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = stagingOffset;
+	copyRegion.dstOffset = offset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(Record(), stagingBuffer, buffer, 1, &copyRegion);
+	stats.copies++;
+}
+
+void Engine::UploadContext::CopyToImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	Stage(data, size, stagingBuffer, stagingOffset);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = stagingOffset;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyBufferToImage(Record(), stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	stats.copies++;
+}
+
+void Engine::UploadContext::ImageBarrier(VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, const VkImageMemoryBarrier& barrier)
+{
+	vkCmdPipelineBarrier(Record(), srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	stats.barriers++;
+}
+
+Engine::UploadContext::BatchStats Engine::UploadContext::Submit()
+{
+	if (recording) {
+		SubmitBatch();
+	}
+	BatchStats submittedStats = stats;
+	stats = BatchStats();
+	return submittedStats;
+}
+
+void Engine::UploadContext::Collect()
+{
+	while (!submitted.empty() && vkGetFenceStatus(device, submitted.front().fence) == VK_SUCCESS) {
+		Retire(submitted.front());
+		submitted.pop_front();
+	}
+}
+
+void Engine::UploadContext::WaitIdle()
+{
+	for (const Batch& batch : submitted) {
+		vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	Collect();
+}
+
+void Engine::UploadContext::Stage(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset)
+{
+	stats.bytes += size;
+
+	if (size > ringCapacity) {
+		std::pair<VkBuffer, Allocation> staging;
+		CreateStagingBuffer(device, *allocator, size, staging.first, staging.second);
+		memcpy(staging.second.mapped, data, static_cast<size_t>(size));
+
+		Record();
+		current.dedicatedStaging.push_back(staging);
+		buffer = staging.first;
+		offset = 0;
+		return;
+	}
+
+	VkDeviceSize position = AlignUp(head, kStagingAlignment);
+	// Staged data never straddles the end of the ring, skip to the start instead
+	if (position % ringCapacity + size > ringCapacity) {
+		position = AlignUp(position, ringCapacity);
+	}
+
+	// Make room by waiting for the oldest batch, or for the open one if it filled the ring on its own
+	while (position + size - tail > ringCapacity) {
+		if (submitted.empty()) {
+			// Nothing staged is in use any more, the whole ring is free
+			if (!recording) {
+				tail = position;
+				break;
+			}
+			SubmitBatch();
+		}
+		vkWaitForFences(device, 1, &submitted.front().fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		Retire(submitted.front());
+		submitted.pop_front();
+	}
+
+	Record();
+	head = position + size;
+	current.ringEnd = head;
+	memcpy(static_cast<char*>(ringMemory.mapped) + position % ringCapacity, data, static_cast<size_t>(size));
+	buffer = ringBuffer;
+	offset = position % ringCapacity;
+}
+
+void Engine::UploadContext::SubmitBatch()
+{
+	// Transfers become visible to whatever the following submissions do with the resources
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	vkCmdPipelineBarrier(current.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if (vkEndCommandBuffer(current.commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record upload Command Buffer!");
+	}
+
+	if (freeFences.empty()) {
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &current.fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload Fence!");
+		}
+	}
+	else {
+		current.fence = freeFences.back();
+		freeFences.pop_back();
+		vkResetFences(device, 1, &current.fence);
+	}
+
+	// Batches without staged data still keep the ring position of the previous one
+	if (current.ringEnd == 0) {
+		current.ringEnd = submitted.empty() ? tail : submitted.back().ringEnd;
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &current.commandBuffer;
+	if (vkQueueSubmit(queue, 1, &submitInfo, current.fence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit upload batch!");
+	}
+
+	submitted.push_back(current);
+	current = Batch();
+	recording = false;
+}
+
+void Engine::UploadContext::Retire(Batch& batch)
+{
+	if (batch.ringEnd > tail) {
+		tail = batch.ringEnd;
+	}
+	for (auto& staging : batch.dedicatedStaging) {
+		vkDestroyBuffer(device, staging.first, nullptr);
+		allocator->Free(staging.second);
+	}
+	freeCommandBuffers.push_back(batch.commandBuffer);
+	freeFences.push_back(batch.fence);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// User-defined Headers
+#include "MemoryAllocator.h"
+
+// External Headers
+#include <vulkan/vulkan.h>
+
+// System Headers
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace Engine {
+
+	/*
+	* Batches resource uploads into a single command buffer instead of one
+	* submission and vkQueueWaitIdle per copy or layout transition.
+	*
+	* Copies, clears and barriers are recorded into the open batch until
+	* Submit hands it to the queue with a fence. Data to copy is staged in a
+	* persistently mapped ring buffer. A batch's part of the ring is recycled
+	* once its fence has signaled, so the ring is only waited on when it
+	* runs full. Uploads larger than the whole ring get a staging buffer of
+	* their own, freed with their batch.
+	*
+	* Every batch ends with a memory barrier from its transfers to all later
+	* commands on the queue, so the uploaded resources can be used by the next
+	* submission without waiting for the fence
+	*/
+	class UploadContext {
+	public:
+		struct BatchStats {
+			VkDeviceSize bytes = 0;
+			uint32_t copies = 0;
+			uint32_t barriers = 0;
+		};
+
+		void Init(VkDevice device, MemoryAllocator* allocator, VkQueue queue, uint32_t queueFamily, VkDeviceSize ringCapacity);
+		// Waits for all batches, then destroys the ring, command pool and fences
+		void Destroy();
+
+		// Command buffer of the open batch, one is opened if needed
+		VkCommandBuffer Record();
+
+		void CopyToBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+		// Tightly packed texels into mip level 0 of an image in TRANSFER_DST_OPTIMAL
+		void CopyToImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size);
+		void ImageBarrier(VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, const VkImageMemoryBarrier& barrier);
+
+		/*
+		* Submits the open batch, if there is one, and returns everything recorded
+		* since the previous Submit. That can span several batches when the ring
+		* ran full in between
+		*/
+		BatchStats Submit();
+
+		// Recycles the ring space and fences of batches the GPU has finished
+		void Collect();
+
+		// Blocks until every submitted batch has finished
+		void WaitIdle();
+
+	private:
+		struct Batch {
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			// Virtual ring position after the batch's last staged byte
+			VkDeviceSize ringEnd = 0;
+			std::vector<std::pair<VkBuffer, Allocation>> dedicatedStaging;
+		};
+
+		// Copies data into staging memory of the open batch
+		void Stage(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset);
+		void SubmitBatch();
+		void Retire(Batch& batch);
+
+		static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		VkDevice device = VK_NULL_HANDLE;
+		MemoryAllocator* allocator = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+
+		// Positions grow forever like in UniformRing, the buffer offset is position modulo capacity
+		VkBuffer ringBuffer = VK_NULL_HANDLE;
+		Allocation ringMemory;
+		VkDeviceSize ringCapacity = 0;
+		VkDeviceSize head = 0;
+		VkDeviceSize tail = 0;
+
+		bool recording = false;
+		Batch current;
+		BatchStats stats;
+		std::deque<Batch> submitted;
+		std::vector<VkCommandBuffer> freeCommandBuffers;
+		std::vector<VkFence> freeFences;
+	};
+}
@@ -1,51 +1,78 @@
 #pragma once
 
+// User-defined Headers
+#include "VertexFormat.h"
+
 // External Headers
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 
 // System Headers
-#include <iostream>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <array>
 
 namespace Engine {
 
+	/*
+	* Vertex of the UV sphere. The texture coordinates, U in [-1, 0] and V in
+	* [0, 1], are stored as SNORM16
+	*/
 	struct Vertex {
 		glm::vec3 pos;
-		glm::vec3 color;
-		glm::vec2 texCoord;
+		int16_t texCoord[2];
+
+		static const VertexFormat& GetFormat() {
+			static const VertexFormat format(sizeof(Vertex), {
+				{ VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) },		// Location 0 = Vertex Position
+				{ VK_FORMAT_R16G16_SNORM, offsetof(Vertex, texCoord) }		// Location 1 = Vertex Texture Coordinates
+			});
+			return format;
+		}
 
 		static VkVertexInputBindingDescription GetBindingDescription() {
-			VkVertexInputBindingDescription bindingDescription = {};
-			bindingDescription.binding = 0;
-			bindingDescription.stride = sizeof(Vertex);
-			bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-			return bindingDescription;
+			return GetFormat().GetBindingDescription();
 		}
 
-		static std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions() {
-			std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
+		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() {
+			return GetFormat().GetAttributeDescriptions();
+		}
+	};
 
-			// Binding at location 0 = Vertex Position
-			attributeDescriptions[0].binding = 0;
-			attributeDescriptions[0].location = 0;
-			attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[0].offset = offsetof(Vertex, pos);
+	/*
+	* Vertex of a cube-sphere globe patch, 16 bytes.
+	*
+	* pos holds the position as UNORM16 within the patch's bounding cube, whose
+	* origin and edge length are pushed with every patch draw (see
+	* CubeSphere::PatchBounds). Its fourth component packs the (i, j) position
+	* of the vertex in the patch grid as i | j << 8, used by the vertex shader
+	* to fetch its height and the heights it morphs towards. The position is
+	* read as R16G16B16A16_UINT and scaled in the shader, since three component
+	* 16 bit vertex formats are not supported everywhere.
+	*
+	* normal is the octahedral encoded direction the terrain is displaced
+	* along, texCoord is UNORM16 within the patch's texture coordinate rectangle
+	*/
+	struct PatchVertex {
+		uint16_t pos[4];
+		int16_t normal[2];
+		uint16_t texCoord[2];
 
-			// Binding at location 1 = Vertex Color
-			attributeDescriptions[1].binding = 0;
-			attributeDescriptions[1].location = 1;
-			attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[1].offset = offsetof(Vertex, color);
+		static const VertexFormat& GetFormat() {
+			static const VertexFormat format(sizeof(PatchVertex), {
+				{ VK_FORMAT_R16G16B16A16_UINT, offsetof(PatchVertex, pos) },	// Location 0 = Quantized Position and Patch Grid Coordinates
+				{ VK_FORMAT_R16G16_SNORM, offsetof(PatchVertex, normal) },		// Location 1 = Octahedral Normal
+				{ VK_FORMAT_R16G16_UNORM, offsetof(PatchVertex, texCoord) }		// Location 2 = Vertex Texture Coordinates
+			});
+			return format;
+		}
 
-			// Binding at location 2 = Vertex Texture Coordinates
-			attributeDescriptions[2].binding = 0;
-			attributeDescriptions[2].location = 2;
-			attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-			attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+		static VkVertexInputBindingDescription GetBindingDescription() {
+			return GetFormat().GetBindingDescription();
+		}
 
-			return attributeDescriptions;
+		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() {
+			return GetFormat().GetAttributeDescriptions();
 		}
 	};
 
@@ -0,0 +1,146 @@
+// User-defined Headers
+#include "VertexBenchmark.h"
+#include "CubeSphere.h"
+#include "MeshOptimizer.h"
+#include "Sphere.h"
+
+// System Headers
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
+namespace {
+	// The layouts before quantization
+	struct FloatVertex {
+		glm::vec3 pos;
+		glm::vec3 color;
+		glm::vec2 texCoord;
+	};
+
+	struct FloatPatchVertex {
+		glm::vec3 pos;
+		glm::vec2 texCoord;
+		uint16_t grid[2];
+	};
+
+	const float kEarthRadiusMeters = 6371000.0f;
+	// Same mesh sizes as the renderer
+	const uint32_t kSphereVertices = 33 * 33;
+	const uint32_t kPoolPatches = 1024;
+	// Patches measured per level, spread over all faces
+	const uint32_t kPatchesPerLevel = 64;
+	const uint32_t kRuns = 5;
+
+	Engine::PatchKey SamplePatch(uint32_t level, uint32_t i)
+	{
+		uint32_t side = 1u << level;
+		return { i % 6, level, (i * 7919u) % side, (i * 104729u) % side };
+	}
+
+	void WriteSize(std::ostream& out, const char* mesh, size_t before, size_t after, size_t vertices)
+	{
+		out << std::left << std::setw(14) << mesh << std::right
+			<< std::setw(8) << before << std::setw(8) << after
+			<< std::setw(12) << before * vertices / 1024 << std::setw(12) << after * vertices / 1024
+			<< std::setw(9) << std::setprecision(2) << double(before) / after << "x" << std::endl;
+	}
+}
+
+void Engine::RunVertexBenchmarks(std::ostream& out)
+{
+	out << std::fixed;
+	out << "Vertex sizes, bytes per vertex and KiB per buffer" << std::endl;
+	out << std::left << std::setw(14) << "mesh" << std::right << std::setw(8) << "before" << std::setw(8) << "after"
+		<< std::setw(12) << "KiB before" << std::setw(12) << "KiB after" << std::setw(10) << "saving" << std::endl;
+	WriteSize(out, "uv-sphere", sizeof(FloatVertex), sizeof(Vertex), kSphereVertices);
+	WriteSize(out, "patch-pool", sizeof(FloatPatchVertex), sizeof(PatchVertex), size_t(kPoolPatches) * CubeSphere::kVerticesPerPatch);
+
+	// Both meshes as the renderer builds them, in generation order and after OptimizeMesh
+	JobSystem jobs;
+	jobs.Init(1);
+	std::vector<Vertex> sphereVertices;
+	std::vector<uint32_t> sphereIndices;
+	CreateSphere(1, 32, 32, &sphereVertices, &sphereIndices, jobs);
+	jobs.Shutdown();
+	std::vector<uint32_t> optimizedSphereIndices = sphereIndices;
+	std::vector<glm::vec3> spherePositions;
+	for (const Vertex& vertex : sphereVertices) {
+		spherePositions.push_back(vertex.pos);
+	}
+	OptimizeMesh(optimizedSphereIndices, spherePositions);
+	std::vector<uint32_t> patchIndices = CubeSphere::BuildPatchIndices();
+	const MeshIndices& patchMeshIndices = CubeSphere::GetPatchMesh().indices;
+	std::vector<uint32_t> optimizedPatchIndices(patchMeshIndices.GetCount());
+	for (uint32_t i = 0; i < patchMeshIndices.GetCount(); i++) {
+		optimizedPatchIndices[i] = patchMeshIndices[i];
+	}
+
+	out << std::endl << "Simulated FIFO post-transform cache, ACMR (vertex shader runs per triangle) and ATVR (runs per vertex)" << std::endl;
+	out << std::left << std::setw(14) << "mesh" << std::right << std::setw(7) << "cache"
+		<< std::setw(13) << "ACMR before" << std::setw(12) << "ACMR after" << std::setw(13) << "ATVR before" << std::setw(12) << "ATVR after" << std::endl;
+	for (uint32_t cacheSize : { 8u, 16u, 32u }) {
+		const char* names[] = { "uv-sphere", "patch" };
+		const std::vector<uint32_t>* before[] = { &sphereIndices, &patchIndices };
+		const std::vector<uint32_t>* after[] = { &optimizedSphereIndices, &optimizedPatchIndices };
+		const uint32_t vertexCounts[] = { static_cast<uint32_t>(sphereVertices.size()), CubeSphere::kVerticesPerPatch };
+		for (uint32_t mesh = 0; mesh < 2; mesh++) {
+			VertexCacheStats statsBefore = AnalyzeVertexCache(*before[mesh], vertexCounts[mesh], cacheSize);
+			VertexCacheStats statsAfter = AnalyzeVertexCache(*after[mesh], vertexCounts[mesh], cacheSize);
+			out << std::left << std::setw(14) << names[mesh] << std::right << std::setw(7) << cacheSize << std::setprecision(3)
+				<< std::setw(13) << statsBefore.acmr << std::setw(12) << statsAfter.acmr
+				<< std::setw(13) << statsBefore.atvr << std::setw(12) << statsAfter.atvr << std::endl;
+		}
+	}
+
+	const uint32_t n = CubeSphere::kPatchResolution;
+	const std::vector<uint32_t>& remap = CubeSphere::GetPatchMesh().optimization.remap;
+	std::vector<PatchVertex> vertices(CubeSphere::kVerticesPerPatch);
+	PatchBounds bounds;
+
+	out << std::endl << "Largest quantization error of " << kPatchesPerLevel << " patches per level" << std::endl;
+	out << std::setw(6) << "level" << std::setw(14) << "position m" << std::setw(12) << "of a cell" << std::setw(12) << "normal deg" << std::endl;
+	for (uint32_t level = 1; level <= CubeSphere::kMaxLevel; level++) {
+		double positionError = 0.0;
+		double cellError = 0.0;
+		double normalError = 0.0;
+		for (uint32_t i = 0; i < kPatchesPerLevel; i++) {
+			PatchKey key = SamplePatch(level, i);
+			CubeSphere::GeneratePatch(key, 1.0f, vertices.data(), bounds);
+			double cellSize = glm::length(CubeSphere::PatchDirection(key, 0.0f, 0.0f) - CubeSphere::PatchDirection(key, 1.0f / n, 0.0f));
+
+			for (uint32_t j = 0; j <= n; j++) {
+				for (uint32_t k = 0; k <= n; k++) {
+					const PatchVertex& vertex = vertices[remap[j * (n + 1) + k]];
+					glm::vec3 expected = CubeSphere::PatchDirection(key, k / float(n), j / float(n));
+					glm::vec3 position = glm::vec3(bounds.position) +
+						glm::vec3(vertex.pos[0], vertex.pos[1], vertex.pos[2]) * (bounds.position.w / 65535.0f);
+					double error = glm::length(position - expected);
+					positionError = std::max(positionError, error);
+					cellError = std::max(cellError, error / cellSize);
+
+					// acos of a float dot product close to 1 is far less precise than the encoding
+					glm::dvec3 normal(DecodeOctahedral(vertex.normal));
+					double angle = std::atan2(glm::length(glm::cross(normal, glm::dvec3(expected))), glm::dot(normal, glm::dvec3(expected)));
+					normalError = std::max(normalError, glm::degrees(angle));
+				}
+			}
+		}
+		out << std::setw(6) << level << std::setw(14) << std::setprecision(3) << positionError * kEarthRadiusMeters
+			<< std::setw(12) << std::setprecision(6) << cellError << std::setw(12) << std::setprecision(5) << normalError << std::endl;
+	}
+
+	// Patch generation now includes the bounds pass and quantization
+	const uint32_t timedLevel = 8;
+	double best = 1e30;
+	for (uint32_t run = 0; run < kRuns; run++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < kPatchesPerLevel; i++) {
+			CubeSphere::GeneratePatch(SamplePatch(timedLevel, i), 1.0f, vertices.data(), bounds);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::micro>(end - start).count());
+	}
+	out << std::endl << "GeneratePatch: " << std::setprecision(1) << best / kPatchesPerLevel << " us per patch, best of " << kRuns << " runs" << std::endl;
+}
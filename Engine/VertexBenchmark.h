@@ -0,0 +1,20 @@
+#pragma once
+
+// System Headers
+#include <ostream>
+
+namespace Engine {
+
+	/*
+	* Vertex format report, run by --bench-vertices. Lists the bytes per vertex
+	* and per buffer of the UV sphere and the globe patches, before and after
+	* quantization, and the largest error quantization introduces at every
+	* patch level: positions in meters on the Earth and relative to the grid
+	* cell, normals in degrees. Also times GeneratePatch, which now quantizes,
+	* and compares the post-transform cache efficiency of both meshes' index
+	* lists before and after OptimizeMesh in a simulated FIFO cache.
+	* Frame times of both formats come from --benchmark runs, whose results
+	* list the vertex size under configuration
+	*/
+	void RunVertexBenchmarks(std::ostream& out);
+}
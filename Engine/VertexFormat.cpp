@@ -0,0 +1,67 @@
+// User-defined Headers
+#include "VertexFormat.h"
+
+// System Headers
+#include <algorithm>
+#include <cmath>
+
+Engine::VertexFormat::VertexFormat(uint32_t vertexStride, std::initializer_list<Attribute> vertexAttributes)
+	: stride(vertexStride), attributes(vertexAttributes)
+{
+}
+
+VkVertexInputBindingDescription Engine::VertexFormat::GetBindingDescription() const
+{
+	VkVertexInputBindingDescription bindingDescription = {};
+	bindingDescription.binding = 0;
+	bindingDescription.stride = stride;
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return bindingDescription;
+}
+
+std::vector<VkVertexInputAttributeDescription> Engine::VertexFormat::GetAttributeDescriptions() const
+{
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(attributes.size());
+	for (uint32_t i = 0; i < attributes.size(); i++) {
+		attributeDescriptions[i].binding = 0;
+		attributeDescriptions[i].location = i;
+		attributeDescriptions[i].format = attributes[i].format;
+		attributeDescriptions[i].offset = attributes[i].offset;
+	}
+	return attributeDescriptions;
+}
+
+uint16_t Engine::QuantizeUnorm16(float value)
+{
+	return static_cast<uint16_t>(std::lround(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+int16_t Engine::QuantizeSnorm16(float value)
+{
+	return static_cast<int16_t>(std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+void Engine::EncodeOctahedral(const glm::vec3& direction, int16_t encoded[2])
+{
+	glm::vec3 n = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+	glm::vec2 square(n.x, n.y);
+	if (n.z < 0.0f) {
+		square.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		square.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	encoded[0] = QuantizeSnorm16(square.x);
+	encoded[1] = QuantizeSnorm16(square.y);
+}
+
+// Same as decodeOctahedral in Shaders/globe.vert
+glm::vec3 Engine::DecodeOctahedral(const int16_t encoded[2])
+{
+	glm::vec2 square(std::max(encoded[0] / 32767.0f, -1.0f), std::max(encoded[1] / 32767.0f, -1.0f));
+	glm::vec3 n(square.x, square.y, 1.0f - std::abs(square.x) - std::abs(square.y));
+	if (n.z < 0.0f) {
+		float x = n.x;
+		n.x = (1.0f - std::abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - std::abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// External Headers
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+// System Headers
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace Engine {
+
+	/*
+	* Layout of the vertices in binding 0. Attribute i is read by the vertex
+	* shader at location i, so a vertex struct only lists the format and offset
+	* of its members in the order its shader declares them, and the Vulkan
+	* binding and attribute descriptions are generated from that
+	*/
+	class VertexFormat {
+	public:
+		struct Attribute {
+			VkFormat format;
+			uint32_t offset;
+		};
+
+		VertexFormat(uint32_t stride, std::initializer_list<Attribute> attributes);
+
+		uint32_t GetStride() const { return stride; }
+
+		VkVertexInputBindingDescription GetBindingDescription() const;
+		std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() const;
+
+	private:
+		uint32_t stride;
+		std::vector<Attribute> attributes;
+	};
+
+	// Round to nearest, values outside [0, 1] and [-1, 1] are clamped
+	uint16_t QuantizeUnorm16(float value);
+	int16_t QuantizeSnorm16(float value);
+
+	/*
+	* Octahedral encoding of a unit vector: the direction is projected onto the
+	* octahedron |x| + |y| + |z| = 1, whose lower half is folded over the upper
+	* one, and the resulting square is stored as two SNORM16 values.
+	* The angular error stays below 0.005 degrees
+	*/
+	void EncodeOctahedral(const glm::vec3& direction, int16_t encoded[2]);
+	glm::vec3 DecodeOctahedral(const int16_t encoded[2]);
+}
@@ -0,0 +1,438 @@
+// User-defined Headers
+#include "VirtualTexture.h"
+#include "Profiler.h"
+#include "ImageWriter.h"
+
+// External Headers
+#include <stb_image.h>
+
+// System Headers
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	// Tiles queued for or being read by background jobs at any time
+	const size_t kMaxPendingLoads = 32;
+
+	std::string TileName(uint32_t level, uint32_t x, uint32_t y)
+	{
+		std::ostringstream name;
+		name << "/tile_" << level << "_" << y << "_" << x << ".png";
+		return name.str();
+	}
+}
+
+void Engine::BuildTilePyramid(const std::string& sourceImage, const std::string& directory, uint32_t tileSize)
+{
+	int sourceWidth, sourceHeight, sourceChannels;
+	stbi_uc* pixels = stbi_load(sourceImage.c_str(), &sourceWidth, &sourceHeight, &sourceChannels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("Failed to load " + sourceImage + "!");
+	}
+
+	std::vector<uint8_t> image(pixels, pixels + size_t(sourceWidth) * sourceHeight * 4);
+	stbi_image_free(pixels);
+
+	const uint32_t border = VirtualTexture::kBorder;
+	const uint32_t physicalSize = tileSize + 2 * border;
+	std::vector<uint8_t> tile(size_t(physicalSize) * physicalSize * 4);
+
+	uint32_t levelWidth = static_cast<uint32_t>(sourceWidth);
+	uint32_t levelHeight = static_cast<uint32_t>(sourceHeight);
+	uint32_t level = 0;
+	uint32_t tileTotal = 0;
+	for (;;) {
+		uint32_t tilesX = (levelWidth + tileSize - 1) / tileSize;
+		uint32_t tilesY = (levelHeight + tileSize - 1) / tileSize;
+
+		// Texels beyond the image edge repeat the edge, the border repeats the neighbouring tiles
+		for (uint32_t ty = 0; ty < tilesY; ty++) {
+			for (uint32_t tx = 0; tx < tilesX; tx++) {
+				for (uint32_t j = 0; j < physicalSize; j++) {
+					int sy = std::max(0, std::min(int(ty * tileSize + j) - int(border), int(levelHeight) - 1));
+					for (uint32_t i = 0; i < physicalSize; i++) {
+						int sx = std::max(0, std::min(int(tx * tileSize + i) - int(border), int(levelWidth) - 1));
+						std::copy_n(&image[(size_t(sy) * levelWidth + sx) * 4], 4, &tile[(size_t(j) * physicalSize + i) * 4]);
+					}
+				}
+				WritePNG(directory + TileName(level, tx, ty), physicalSize, physicalSize, tile.data());
+				tileTotal++;
+			}
+		}
+
+		level++;
+		if ((tilesX == 1 && tilesY == 1) || level == VirtualTexture::kMaxLevels) break;
+
+		// Box filter the level down to the next one
+		uint32_t nextWidth = (levelWidth + 1) / 2;
+		uint32_t nextHeight = (levelHeight + 1) / 2;
+		std::vector<uint8_t> next(size_t(nextWidth) * nextHeight * 4);
+		for (uint32_t y = 0; y < nextHeight; y++) {
+			uint32_t y0 = 2 * y;
+			uint32_t y1 = std::min(2 * y + 1, levelHeight - 1);
+			for (uint32_t x = 0; x < nextWidth; x++) {
+				uint32_t x0 = 2 * x;
+				uint32_t x1 = std::min(2 * x + 1, levelWidth - 1);
+				for (uint32_t c = 0; c < 4; c++) {
+					uint32_t sum = image[(size_t(y0) * levelWidth + x0) * 4 + c] + image[(size_t(y0) * levelWidth + x1) * 4 + c] +
+						image[(size_t(y1) * levelWidth + x0) * 4 + c] + image[(size_t(y1) * levelWidth + x1) * 4 + c];
+					next[(size_t(y) * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+		image.swap(next);
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	std::ofstream meta(directory + "/pyramid.txt");
+	meta << sourceWidth << " " << sourceHeight << " " << tileSize << " " << level << std::endl;
+	if (!meta) {
+		throw std::runtime_error("Failed to write " + directory + "/pyramid.txt!");
+	}
+	std::cout << "Tile pyramid: " << level << " levels, " << tileTotal << " tiles of " << tileSize << "x" << tileSize
+		<< " written to " << directory << std::endl;
+}
+
+Engine::VirtualTexture::~VirtualTexture()
+{
+	Shutdown();
+}
+
+void Engine::VirtualTexture::Init(const std::string& tileDirectory, uint32_t cacheSide, JobSystem* jobs)
+{
+	directory = tileDirectory;
+	jobSystem = jobs;
+
+	uint32_t levelCount = 0;
+	std::ifstream meta(directory + "/pyramid.txt");
+	if (!(meta >> width >> height >> tileSize >> levelCount)) {
+		throw std::runtime_error("Failed to read " + directory + "/pyramid.txt!");
+	}
+	if (width == 0 || height == 0 || tileSize == 0 || levelCount == 0 || levelCount > kMaxLevels) {
+		throw std::runtime_error("Invalid tile pyramid in " + directory + "!");
+	}
+	// Atlas coordinates are stored in 8 bits of the page table entries
+	if (cacheSide < 2 || cacheSide > 255) {
+		throw std::runtime_error("Virtual texture cache must be between 2 and 255 tiles per side!");
+	}
+	cacheTilesPerSide = cacheSide;
+
+	tileCount = 0;
+	for (uint32_t level = 0; level < levelCount; level++) {
+		uint64_t levelTileSize = uint64_t(tileSize) << level;
+		Level info;
+		info.tilesX = static_cast<uint32_t>((width + levelTileSize - 1) / levelTileSize);
+		info.tilesY = static_cast<uint32_t>((height + levelTileSize - 1) / levelTileSize);
+		info.firstTile = tileCount;
+		levels.push_back(info);
+		tileCount += info.tilesX * info.tilesY;
+	}
+	const Level& coarsest = levels.back();
+	if (coarsest.tilesX * coarsest.tilesY >= cacheSide * cacheSide) {
+		throw std::runtime_error("Virtual texture cache is too small for the coarsest level!");
+	}
+
+	pageTable.assign(kHeaderWords + tileCount, 0);
+	pageTable[0] = width;
+	pageTable[1] = height;
+	pageTable[2] = levelCount;
+	pageTable[3] = tileSize;
+	pageTable[4] = GetPhysicalTileSize();
+	pageTable[5] = GetPhysicalTileSize() * cacheSide;
+	pageTable[6] = kBorder;
+	for (uint32_t level = 0; level < levelCount; level++) {
+		pageTable[8 + 4 * level] = levels[level].tilesX;
+		pageTable[8 + 4 * level + 1] = levels[level].tilesY;
+		pageTable[8 + 4 * level + 2] = levels[level].firstTile;
+	}
+
+	tileSlots.assign(tileCount, -1);
+	tileLoading.assign(tileCount, false);
+	slots.assign(cacheSide * cacheSide, Slot());
+	for (uint32_t slot = cacheSide * cacheSide; slot > 0; slot--) {
+		freeSlots.push_back(slot - 1);
+	}
+
+	// The coarsest level is the fallback of every tile, it is loaded in parallel before the first frame
+	std::vector<LoadedTile> coarsestTiles(tileCount - coarsest.firstTile);
+	jobSystem->ParallelFor(static_cast<uint32_t>(coarsestTiles.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			coarsestTiles[i] = { coarsest.firstTile + i, LoadTile(coarsest.firstTile + i) };
+		}
+	});
+	for (auto& tile : coarsestTiles) {
+		tileLoading[tile.tile] = true;
+		pendingLoads++;
+		results.push_back(std::move(tile));
+	}
+
+	std::cout << "Virtual texture: " << width << "x" << height << " in " << levelCount << " levels of "
+		<< tileSize << "x" << tileSize << " tiles, " << cacheSide * cacheSide << " tile cache" << std::endl;
+}
+
+void Engine::VirtualTexture::Shutdown()
+{
+	if (!jobSystem) return;
+
+	// Background jobs finding the queue empty return right away
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.clear();
+	}
+	jobSystem->Wait(runningJobs);
+	jobSystem = nullptr;
+}
+
+void Engine::VirtualTexture::ProcessFeedback(const uint32_t* feedback)
+{
+	frame++;
+	missingTiles.clear();
+
+	uint32_t words = (tileCount + 31) / 32;
+	for (uint32_t word = 0; word < words; word++) {
+		uint32_t bits = feedback[word];
+		for (uint32_t bit = 0; bits != 0; bit++, bits >>= 1) {
+			if (!(bits & 1)) continue;
+
+			// Walk up to the tile that is actually shown, requesting the missing ones on the way
+			int32_t tile = static_cast<int32_t>(word * 32 + bit);
+			if (tile >= static_cast<int32_t>(tileCount)) break;
+			while (tile >= 0) {
+				if (tileSlots[tile] >= 0) {
+					slots[tileSlots[tile]].lastUsedFrame = frame;
+					break;
+				}
+				if (!tileLoading[tile]) {
+					missingTiles.push_back(static_cast<uint32_t>(tile));
+				}
+				tile = ParentOf(static_cast<uint32_t>(tile));
+			}
+		}
+	}
+
+	// Coarse tiles first, they replace the blurriest fallbacks and cover the most screen
+	std::sort(missingTiles.begin(), missingTiles.end());
+	missingTiles.erase(std::unique(missingTiles.begin(), missingTiles.end()), missingTiles.end());
+	std::stable_sort(missingTiles.begin(), missingTiles.end(), [this](uint32_t a, uint32_t b) {
+		return LevelOf(a) > LevelOf(b);
+	});
+	requestedTiles = static_cast<uint32_t>(missingTiles.size());
+
+	if (missingTiles.empty() || pendingLoads >= kMaxPendingLoads) return;
+	uint32_t queued = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t tile : missingTiles) {
+			if (pendingLoads >= kMaxPendingLoads) break;
+			jobs.push_back(tile);
+			tileLoading[tile] = true;
+			pendingLoads++;
+			queued++;
+		}
+	}
+	for (uint32_t i = 0; i < queued; i++) {
+		jobSystem->RunBackground([this] { RunJob(); }, &runningJobs);
+	}
+}
+
+void Engine::VirtualTexture::Update(uint32_t maxUploads, std::vector<TileUpload>& uploads, std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges)
+{
+	std::vector<LoadedTile> loaded;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!results.empty() && loaded.size() < maxUploads) {
+			loaded.push_back(std::move(results.front()));
+			results.pop_front();
+		}
+	}
+
+	for (auto& tile : loaded) {
+		tileLoading[tile.tile] = false;
+		pendingLoads--;
+
+		// Every slot holds a tile seen this frame, the tile is requested again if still needed
+		int32_t slot = AllocateSlot(dirtyRanges);
+		if (slot < 0) continue;
+
+		slots[slot].tile = static_cast<int32_t>(tile.tile);
+		slots[slot].lastUsedFrame = frame;
+		slots[slot].pinned = LevelOf(tile.tile) == levels.size() - 1;
+		tileSlots[tile.tile] = slot;
+		MapTile(tile.tile, static_cast<uint32_t>(slot), dirtyRanges);
+		uploads.push_back({ static_cast<uint32_t>(slot), std::move(tile.rgba) });
+	}
+
+	// Merge overlapping ranges so every word is uploaded once
+	std::sort(dirtyRanges.begin(), dirtyRanges.end());
+	size_t merged = 0;
+	for (size_t i = 0; i < dirtyRanges.size(); i++) {
+		if (merged > 0 && dirtyRanges[i].first <= dirtyRanges[merged - 1].second) {
+			dirtyRanges[merged - 1].second = std::max(dirtyRanges[merged - 1].second, dirtyRanges[i].second);
+		}
+		else {
+			dirtyRanges[merged++] = dirtyRanges[i];
+		}
+	}
+	dirtyRanges.resize(merged);
+}
+
+Engine::VirtualTexture::Stats Engine::VirtualTexture::GetStats()
+{
+	Stats stats;
+	stats.residentTiles = static_cast<uint32_t>(slots.size() - freeSlots.size());
+	stats.requestedTiles = requestedTiles;
+	stats.pendingLoads = pendingLoads;
+	return stats;
+}
+
+void Engine::VirtualTexture::RunJob()
+{
+	uint32_t tile;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty()) return;
+
+		tile = jobs.front();
+		jobs.pop_front();
+	}
+
+	std::vector<uint8_t> rgba = LoadTile(tile);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	results.push_back({ tile, std::move(rgba) });
+}
+
+std::vector<uint8_t> Engine::VirtualTexture::LoadTile(uint32_t tile) const
+{
+	PROFILE_SCOPE("LoadTile");
+	uint32_t level = LevelOf(tile);
+	uint32_t index = tile - levels[level].firstTile;
+	std::string path = directory + TileName(level, index % levels[level].tilesX, index / levels[level].tilesX);
+
+	const uint32_t physicalSize = GetPhysicalTileSize();
+	int tileWidth, tileHeight, tileChannels;
+	stbi_uc* pixels = stbi_load(path.c_str(), &tileWidth, &tileHeight, &tileChannels, STBI_rgb_alpha);
+	if (!pixels || uint32_t(tileWidth) != physicalSize || uint32_t(tileHeight) != physicalSize) {
+		// A grey tile keeps the page table consistent, the imagery just has a hole
+		std::cerr << "Virtual texture: failed to load " << path << std::endl;
+		stbi_image_free(pixels);
+		return std::vector<uint8_t>(size_t(physicalSize) * physicalSize * 4, 128);
+	}
+
+	std::vector<uint8_t> rgba(pixels, pixels + size_t(physicalSize) * physicalSize * 4);
+	stbi_image_free(pixels);
+	return rgba;
+}
+
+uint32_t Engine::VirtualTexture::LevelOf(uint32_t tile) const
+{
+	uint32_t level = 0;
+	while (level + 1 < levels.size() && tile >= levels[level + 1].firstTile) {
+		level++;
+	}
+	return level;
+}
+
+int32_t Engine::VirtualTexture::ParentOf(uint32_t tile) const
+{
+	uint32_t level = LevelOf(tile);
+	if (level + 1 >= levels.size()) return -1;
+
+	uint32_t index = tile - levels[level].firstTile;
+	uint32_t x = index % levels[level].tilesX;
+	uint32_t y = index / levels[level].tilesX;
+	const Level& parent = levels[level + 1];
+	return static_cast<int32_t>(parent.firstTile + (y / 2) * parent.tilesX + x / 2);
+}
+
+int32_t Engine::VirtualTexture::AllocateSlot(std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges)
+{
+	if (!freeSlots.empty()) {
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		return static_cast<int32_t>(slot);
+	}
+
+	// Least recently used, tiles seen in this frame's feedback are never evicted
+	int32_t victim = -1;
+	uint64_t oldestFrame = frame;
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].pinned || slots[i].lastUsedFrame >= oldestFrame) continue;
+		oldestFrame = slots[i].lastUsedFrame;
+		victim = static_cast<int32_t>(i);
+	}
+	if (victim < 0) return -1;
+
+	uint32_t tile = static_cast<uint32_t>(slots[victim].tile);
+	UnmapTile(tile, dirtyRanges);
+	tileSlots[tile] = -1;
+	slots[victim].tile = -1;
+	return victim;
+}
+
+void Engine::VirtualTexture::MapTile(uint32_t tile, uint32_t slot, std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges)
+{
+	uint32_t level = LevelOf(tile);
+	uint32_t index = tile - levels[level].firstTile;
+	uint32_t x = index % levels[level].tilesX;
+	uint32_t y = index / levels[level].tilesX;
+	uint32_t entry = (slot % cacheTilesPerSide) | ((slot / cacheTilesPerSide) << 8) | (level << 16) | (1u << 24);
+
+	// Entries of the tile and its descendants that fell back to a coarser tile now use this one
+	for (int32_t l = static_cast<int32_t>(level); l >= 0; l--) {
+		const Level& info = levels[l];
+		uint32_t shift = level - l;
+		uint32_t x0 = x << shift;
+		uint32_t y0 = y << shift;
+		uint32_t x1 = std::min((x + 1) << shift, info.tilesX);
+		uint32_t y1 = std::min((y + 1) << shift, info.tilesY);
+
+		for (uint32_t ty = y0; ty < y1; ty++) {
+			uint32_t* row = &pageTable[kHeaderWords + info.firstTile + ty * info.tilesX];
+			for (uint32_t tx = x0; tx < x1; tx++) {
+				if (!(row[tx] >> 24) || ((row[tx] >> 16) & 0xFF) > level) {
+					row[tx] = entry;
+				}
+			}
+		}
+		dirtyRanges.push_back({ kHeaderWords + info.firstTile + y0 * info.tilesX + x0,
+			kHeaderWords + info.firstTile + (y1 - 1) * info.tilesX + x1 });
+	}
+}
+
+void Engine::VirtualTexture::UnmapTile(uint32_t tile, std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges)
+{
+	uint32_t level = LevelOf(tile);
+	uint32_t index = tile - levels[level].firstTile;
+	uint32_t x = index % levels[level].tilesX;
+	uint32_t y = index / levels[level].tilesX;
+
+	// Slot and level make the entry unique, so it identifies everything that fell back to this tile
+	uint32_t entry = pageTable[kHeaderWords + tile];
+	int32_t parent = ParentOf(tile);
+	uint32_t replacement = parent >= 0 ? pageTable[kHeaderWords + parent] : 0;
+
+	for (int32_t l = static_cast<int32_t>(level); l >= 0; l--) {
+		const Level& info = levels[l];
+		uint32_t shift = level - l;
+		uint32_t x0 = x << shift;
+		uint32_t y0 = y << shift;
+		uint32_t x1 = std::min((x + 1) << shift, info.tilesX);
+		uint32_t y1 = std::min((y + 1) << shift, info.tilesY);
+
+		for (uint32_t ty = y0; ty < y1; ty++) {
+			uint32_t* row = &pageTable[kHeaderWords + info.firstTile + ty * info.tilesX];
+			for (uint32_t tx = x0; tx < x1; tx++) {
+				if (row[tx] == entry) {
+					row[tx] = replacement;
+				}
+			}
+		}
+		dirtyRanges.push_back({ kHeaderWords + info.firstTile + y0 * info.tilesX + x0,
+			kHeaderWords + info.firstTile + (y1 - 1) * info.tilesX + x1 });
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+// User-defined Headers
+#include "JobSystem.h"
+
+// System Headers
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <mutex>
+
+namespace Engine {
+
+	/*
+	* Cuts an image into the tile pyramid read by VirtualTexture. directory
+	* receives pyramid.txt ("width height tileSize levelCount") and one
+	* tile_L_Y_X.png per tile. Level 0 is the full resolution image, every
+	* further level halves it until a single tile covers it. Tiles carry a
+	* VirtualTexture::kBorder texel border copied from their neighbours so they
+	* can be filtered in the cache atlas. The source is decoded as a whole, so it
+	* must fit in memory, larger imagery needs its pyramid cut by external tools
+	*/
+	void BuildTilePyramid(const std::string& sourceImage, const std::string& directory, uint32_t tileSize);
+
+	/*
+	* CPU side of the virtual texture that replaces Textures/Earth.png.
+	*
+	* The imagery lives on disk as a tile pyramid. A fixed atlas of
+	* cacheTilesPerSide x cacheTilesPerSide tiles in GPU memory holds the
+	* resident tiles, and the page table maps every tile of every level to the
+	* atlas slot of its finest resident ancestor, so a missing tile shows a
+	* blurrier version of itself rather than a hole. GPU memory only depends on
+	* the cache size, plus 4 bytes of page table per tile.
+	*
+	* The fragment shader sets one bit per tile it would like to sample in a
+	* feedback buffer. ProcessFeedback reads those bits back, keeps used tiles
+	* resident and queues missing ones, coarse levels first, as background
+	* jobs. Update then places loaded tiles into the least recently used
+	* slots and patches the page table. The coarsest level is loaded up front
+	* and never evicted.
+	*
+	* Page table layout, shared with Shaders/virtual.frag (uints):
+	* [0..3]   width, height, levelCount, tileSize
+	* [4..7]   physical tile size, atlas size in texels, border, 0
+	* [8..71]  per level: tilesX, tilesY, first tile index, 0
+	* [72..]   one entry per tile: atlas x | atlas y << 8 | level << 16 | valid << 24
+	*/
+	class VirtualTexture {
+	public:
+		static const uint32_t kBorder = 1;
+		static const uint32_t kMaxLevels = 16;
+		static const uint32_t kHeaderWords = 8 + 4 * kMaxLevels;
+
+		struct Level {
+			uint32_t tilesX;
+			uint32_t tilesY;
+			uint32_t firstTile;
+		};
+
+		~VirtualTexture();
+
+		void Init(const std::string& directory, uint32_t cacheTilesPerSide, JobSystem* jobSystem);
+		void Shutdown();
+
+		uint32_t GetTileCount() const { return tileCount; }
+		uint32_t GetPhysicalTileSize() const { return tileSize + 2 * kBorder; }
+		uint32_t GetCacheTilesPerSide() const { return cacheTilesPerSide; }
+		// Header followed by the entries, the GPU buffer is a copy of it
+		const std::vector<uint32_t>& GetPageTable() const { return pageTable; }
+
+		// feedback holds one bit per tile, as written by the fragment shader
+		void ProcessFeedback(const uint32_t* feedback);
+
+		struct TileUpload {
+			uint32_t slot;
+			std::vector<uint8_t> rgba;
+		};
+		/*
+		* Moves up to maxUploads loaded tiles into cache slots. Appends their pixels
+		* to uploads and the page table word ranges [first, last) that changed to dirtyRanges
+		*/
+		void Update(uint32_t maxUploads, std::vector<TileUpload>& uploads, std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges);
+
+		struct Stats {
+			uint32_t residentTiles = 0;
+			uint32_t requestedTiles = 0;
+			size_t pendingLoads = 0;
+		};
+		Stats GetStats();
+
+	private:
+		struct Slot {
+			int32_t tile = -1;
+			uint64_t lastUsedFrame = 0;
+			bool pinned = false;
+		};
+
+		struct LoadedTile {
+			uint32_t tile;
+			std::vector<uint8_t> rgba;
+		};
+
+		// Background job loading the first queued tile
+		void RunJob();
+		std::vector<uint8_t> LoadTile(uint32_t tile) const;
+
+		uint32_t LevelOf(uint32_t tile) const;
+		int32_t ParentOf(uint32_t tile) const;
+		// Free slot, or the least recently used one after unmapping its tile, -1 if all are in use
+		int32_t AllocateSlot(std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges);
+
+		// Points the page table entries of the tile and its descendants at slot
+		void MapTile(uint32_t tile, uint32_t slot, std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges);
+		// Points the entries that referenced the tile at its parent's entry again
+		void UnmapTile(uint32_t tile, std::vector<std::pair<uint32_t, uint32_t>>& dirtyRanges);
+
+		std::string directory;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t tileSize = 0;
+		std::vector<Level> levels;
+		uint32_t tileCount = 0;
+		uint32_t cacheTilesPerSide = 0;
+		uint64_t frame = 0;
+
+		std::vector<uint32_t> pageTable;
+		// Cache slot of every tile, -1 if not resident
+		std::vector<int32_t> tileSlots;
+		// Tiles queued for or being loaded
+		std::vector<bool> tileLoading;
+		std::vector<Slot> slots;
+		std::vector<uint32_t> freeSlots;
+		std::vector<uint32_t> missingTiles;
+		uint32_t requestedTiles = 0;
+
+		// Jobs and results guarded by mutex. Every queued tile has one background job to load it
+		JobSystem* jobSystem = nullptr;
+		JobCounter runningJobs;
+		std::deque<uint32_t> jobs;
+		std::deque<LoadedTile> results;
+		size_t pendingLoads = 0;
+		std::mutex mutex;
+	};
+}
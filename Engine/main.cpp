@@ -1,9 +1,41 @@
 #include "Renderer.h"
+#include "TextureCompression.h"
+#include "JobBenchmark.h"
+#include "VertexBenchmark.h"
+#include "SphereBenchmark.h"
 
-int main() {
-	Engine::Renderer app;
-
+int main(int argc, char** argv) {
 	try {
+		Engine::Settings settings = Engine::ParseSettings(argc, argv);
+		if (!settings.buildTilesSource.empty()) {
+			Engine::BuildTilePyramid(settings.buildTilesSource, settings.virtualTextureDirectory, 128);
+			return EXIT_SUCCESS;
+		}
+		if (!settings.compressTextureSource.empty()) {
+			Engine::BlockFormat format = settings.blockFormat == "bc4" ? Engine::BlockFormat::BC4 :
+				settings.blockFormat == "bc5" ? Engine::BlockFormat::BC5 : Engine::BlockFormat::BC7;
+			std::string destination = settings.compressTextureSource.substr(0, settings.compressTextureSource.find_last_of('.')) + ".ktx2";
+			Engine::WriteKTX2(destination, Engine::CompressImageFile(format, settings.compressTextureSource));
+			std::cout << "Wrote " << destination << std::endl;
+			return EXIT_SUCCESS;
+		}
+
+		if (settings.benchJobs) {
+			uint32_t maxThreads = settings.workerThreads != 0 ? settings.workerThreads + 1 : std::max(1u, std::thread::hardware_concurrency());
+			Engine::RunJobBenchmarks(maxThreads, std::cout);
+			return EXIT_SUCCESS;
+		}
+		if (settings.benchVertices) {
+			Engine::RunVertexBenchmarks(std::cout);
+			return EXIT_SUCCESS;
+		}
+		if (settings.benchSphere) {
+			uint32_t maxThreads = settings.workerThreads != 0 ? settings.workerThreads + 1 : std::max(1u, std::thread::hardware_concurrency());
+			Engine::RunSphereBenchmarks(maxThreads, std::cout);
+			return EXIT_SUCCESS;
+		}
+
+		Engine::Renderer app(settings);
 		app.Run();
 	}
 	catch (const std::runtime_error& e) {